@@ -0,0 +1,497 @@
+#include "../src/nes.h"
+#include "../src/apu.h"
+#include "../ui/netplay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../ui/assets/default-rom.h"
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+
+#define BENCH_FRAMES      600
+#define BENCH_SAMPLE_RATE 44100
+#define MAX_ARG_LEN       256
+#define MAX_ROMS          64
+#define CHECK_FRAMES      300
+
+// commercial style workloads are listed first, followed by the timing heavy test roms
+static const char *CORPUS[] = {
+	"test/misc_other/DROPOFF7.NES",
+	"test/misc_other/SOF_v1d.nes",
+	"test/misc_other/smwstomp.nes",
+	"test/misc_other/firefly.nes",
+	"test/misc_other/cuter.nes",
+	"test/misc_other/CHESS.NES",
+	"test/misc_other/Sayoonara!.NES",
+	"test/misc_other/nesmas.nes",
+	"test/misc_other/spritecans.nes",
+	"test/misc_other/physics.nes",
+	"test/cpu_instr_test_v5/all_instrs.nes",
+	"test/cpu_interrupts_v2/cpu_interrupts.nes",
+	"test/ppu_vbl_nmi/ppu_vbl_nmi.nes",
+	"test/ppu_sprite_hit/ppu_sprite_hit.nes",
+	"test/ppu_sprite_overflow/ppu_sprite_overflow.nes",
+	"test/apu_test/apu_test.nes",
+	"test/apu_mixer/dmc.nes",
+	"test/ppu_dpcm_split/dpcmsplit.nes",
+	"test/mapper_mmc3_test_2/4-scanline_timing.nes",
+	"test/mapper_mmc5test_v2/mmc5test_v2.nes",
+	"test/mapper_vrctest/vrctest25s1.nes",
+	"test/mapper_vrc6test/vrc6test24.nes",
+	"test/mapper_fme7acktest-r1/fme7acktest.nes",
+};
+
+struct bench_result {
+	const char *name;
+	uint32_t frames;
+	uint64_t cycles;
+	double seconds;
+	uint32_t frame_crc;
+	uint32_t audio_crc;
+	size_t samples;
+};
+
+struct bench_ctx {
+	uint32_t *pixels;
+	uint16_t *indexes;
+	uint32_t palette[8 * 64];
+	uint32_t expanded[256 * 240];
+	uint32_t sliced[256 * 240];
+	uint32_t slice_rows;
+	uint32_t audio_crc;
+	size_t samples;
+};
+
+
+/*** UTIL ***/
+
+static uint32_t CRC_TABLE[0x100];
+
+static void bench_crc32_init(void)
+{
+	for (uint32_t x = 0; x < 0x100; x++) {
+		uint32_t r = x;
+
+		for (uint8_t y = 0; y < 8; y++)
+			r = (r & 1 ? 0 : 0xEDB88320) ^ r >> 1;
+
+		CRC_TABLE[x] = r ^ 0xFF000000;
+	}
+}
+
+static uint32_t bench_crc32(uint32_t crc, const void *data, size_t n_bytes)
+{
+	const uint8_t *bytes = data;
+
+	for (size_t x = 0; x < n_bytes; x++)
+		crc = CRC_TABLE[(uint8_t) crc ^ bytes[x]] ^ crc >> 8;
+
+	return crc;
+}
+
+static double bench_time(void)
+{
+	#if defined(_WIN32)
+		LARGE_INTEGER freq, now;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&now);
+
+		return (double) now.QuadPart / (double) freq.QuadPart;
+	#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		return (double) ts.tv_sec + (double) ts.tv_nsec / 1.0e9;
+	#endif
+}
+
+static uint8_t *bench_read(const char *name, size_t *size)
+{
+	FILE *f = fopen(name, "rb");
+	if (!f) return NULL;
+
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	uint8_t *data = len > 0 ? malloc(len) : NULL;
+
+	if (data && fread(data, 1, len, f) != (size_t) len) {
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+	*size = len;
+
+	return data;
+}
+
+
+/*** CALLBACKS ***/
+
+static void bench_new_frame(uint32_t *pixels, void *opaque)
+{
+	struct bench_ctx *ctx = opaque;
+
+	ctx->pixels = pixels;
+}
+
+static void bench_new_indexes(uint16_t *indexes, void *opaque)
+{
+	struct bench_ctx *ctx = opaque;
+
+	ctx->indexes = indexes;
+}
+
+static void bench_new_slice(uint32_t first_row, uint32_t row_count, const uint32_t *pixels, void *opaque)
+{
+	struct bench_ctx *ctx = opaque;
+
+	memcpy(ctx->sliced + first_row * 256, pixels, row_count * 256 * sizeof(uint32_t));
+	ctx->slice_rows += row_count;
+}
+
+static void bench_new_samples(int16_t *samples, size_t count, void *opaque)
+{
+	struct bench_ctx *ctx = opaque;
+
+	ctx->audio_crc = bench_crc32(ctx->audio_crc, samples, count * sizeof(int16_t));
+	ctx->samples += count;
+}
+
+
+/*** RUN ***/
+
+static bool BENCH_INDEXED;
+static uint16_t BENCH_SLICES;
+
+static void bench_set_video(struct nes *nes, struct bench_ctx *ctx)
+{
+	if (BENCH_INDEXED) {
+		nes_set_index_callback(nes, bench_new_indexes);
+		nes_get_palette(nes, ctx->palette);
+	}
+
+	if (BENCH_SLICES > 0)
+		nes_set_slice_callback(nes, bench_new_slice, BENCH_SLICES);
+}
+
+// indexed frames are expanded through the palette so both formats hash the same, except for
+// the black frames before the first palette write which have no alpha in RGBA
+static uint32_t bench_frame_crc(struct bench_ctx *ctx)
+{
+	if (ctx->indexes) {
+		for (uint32_t x = 0; x < 256 * 240; x++)
+			ctx->expanded[x] = ctx->palette[ctx->indexes[x]];
+
+		return bench_crc32(0, ctx->expanded, sizeof(ctx->expanded));
+	}
+
+	// the frame as put together from slices must match the one handed over whole
+	if (ctx->slice_rows > 0)
+		return bench_crc32(0, ctx->sliced, sizeof(ctx->sliced));
+
+	return ctx->pixels ? bench_crc32(0, ctx->pixels, 256 * 240 * sizeof(uint32_t)) : 0;
+}
+
+static void bench_run(const char *name, uint8_t *rom, size_t rom_size, uint32_t frames,
+	struct bench_result *res)
+{
+	struct bench_ctx *ctx = calloc(1, sizeof(struct bench_ctx));
+	struct nes *nes = NULL;
+
+	nes_init(&nes, BENCH_SAMPLE_RATE, false, bench_new_frame, bench_new_samples, ctx);
+	bench_set_video(nes, ctx);
+	nes_cart_load(nes, rom, rom_size, NULL, 0, NULL);
+
+	uint64_t cycles = nes_cycles(nes);
+	double start = bench_time();
+
+	for (uint32_t x = 0; x < frames; x++)
+		nes_step(nes);
+
+	res->seconds = bench_time() - start;
+	res->cycles = nes_cycles(nes) - cycles;
+	res->name = name;
+	res->frames = frames;
+	res->frame_crc = bench_frame_crc(ctx);
+	res->audio_crc = ctx->audio_crc;
+	res->samples = ctx->samples;
+
+	nes_destroy(&nes);
+	free(ctx);
+}
+
+// every rom runs as its own instance, all stepped together through a pool of worker threads
+static void bench_run_pool(const char **names, uint8_t **roms, size_t *sizes, uint32_t n,
+	uint32_t frames, uint32_t threads, struct bench_result *res)
+{
+	struct bench_ctx *ctx = calloc(MAX_ROMS + 1, sizeof(struct bench_ctx));
+	struct nes *nes[MAX_ROMS + 1] = {0};
+	uint64_t cycles[MAX_ROMS + 1] = {0};
+	struct nes_pool *pool = NULL;
+
+	nes_pool_init(&pool, threads);
+
+	for (uint32_t x = 0; x < n; x++) {
+		nes_init(&nes[x], BENCH_SAMPLE_RATE, false, bench_new_frame, bench_new_samples, &ctx[x]);
+		bench_set_video(nes[x], &ctx[x]);
+		nes_cart_load(nes[x], roms[x], sizes[x], NULL, 0, NULL);
+		nes_pool_add(pool, nes[x]);
+		cycles[x] = nes_cycles(nes[x]);
+	}
+
+	double start = bench_time();
+
+	for (uint32_t x = 0; x < frames; x++)
+		nes_pool_step_all(pool);
+
+	double seconds = bench_time() - start;
+
+	nes_pool_destroy(&pool);
+
+	for (uint32_t x = 0; x < n; x++) {
+		res[x].seconds = seconds;
+		res[x].cycles = nes_cycles(nes[x]) - cycles[x];
+		res[x].name = names[x];
+		res[x].frames = frames;
+		res[x].frame_crc = bench_frame_crc(&ctx[x]);
+		res[x].audio_crc = ctx[x].audio_crc;
+		res[x].samples = ctx[x].samples;
+
+		nes_destroy(&nes[x]);
+	}
+
+	free(ctx);
+}
+
+static void bench_print_result(FILE *f, const struct bench_result *res, bool last)
+{
+	fprintf(f, "\t\t{\n");
+	fprintf(f, "\t\t\t\"rom\": \"%s\",\n", res->name);
+	fprintf(f, "\t\t\t\"frames\": %u,\n", res->frames);
+	fprintf(f, "\t\t\t\"cycles\": %llu,\n", (unsigned long long) res->cycles);
+	fprintf(f, "\t\t\t\"seconds\": %.6f,\n", res->seconds);
+	fprintf(f, "\t\t\t\"fps\": %.2f,\n", res->frames / res->seconds);
+	fprintf(f, "\t\t\t\"ns_per_cycle\": %.3f,\n", res->seconds * 1.0e9 / (double) res->cycles);
+	fprintf(f, "\t\t\t\"cycles_per_frame\": %.1f,\n", (double) res->cycles / res->frames);
+	fprintf(f, "\t\t\t\"samples\": %zu,\n", res->samples);
+	fprintf(f, "\t\t\t\"frame_crc32\": \"%08X\",\n", res->frame_crc);
+	fprintf(f, "\t\t\t\"audio_crc32\": \"%08X\"\n", res->audio_crc);
+	fprintf(f, "\t\t}%s\n", last ? "" : ",");
+}
+
+static void bench_print(FILE *f, const struct bench_result *res, uint32_t n, bool batch)
+{
+	uint64_t frames = 0, cycles = 0;
+	double seconds = 0.0;
+
+	for (uint32_t x = 0; x < n; x++) {
+		frames += res[x].frames;
+		cycles += res[x].cycles;
+
+		// batched roms share the same wall time
+		seconds = batch ? res[x].seconds : seconds + res[x].seconds;
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"results\": [\n");
+
+	for (uint32_t x = 0; x < n; x++)
+		bench_print_result(f, &res[x], x == n - 1);
+
+	fprintf(f, "\t],\n");
+	fprintf(f, "\t\"total\": {\n");
+	fprintf(f, "\t\t\"frames\": %llu,\n", (unsigned long long) frames);
+	fprintf(f, "\t\t\"cycles\": %llu,\n", (unsigned long long) cycles);
+	fprintf(f, "\t\t\"seconds\": %.6f,\n", seconds);
+	fprintf(f, "\t\t\"fps\": %.2f,\n", seconds > 0.0 ? frames / seconds : 0.0);
+	fprintf(f, "\t\t\"ns_per_cycle\": %.3f\n", cycles > 0 ? seconds * 1.0e9 / (double) cycles : 0.0);
+	fprintf(f, "\t}\n");
+	fprintf(f, "}\n");
+}
+
+
+/*** CHECK ***/
+
+// latency in frames and loss in percent for each loopback netplay run
+static const uint32_t CHECK_LINKS[][2] = {
+	{0, 0},
+	{3, 10},
+	{6, 25},
+};
+
+static bool bench_check_netplay(const char *name, uint8_t *rom, size_t rom_size)
+{
+	bool match = true;
+
+	for (uint32_t x = 0; x < sizeof(CHECK_LINKS) / sizeof(CHECK_LINKS[0]); x++) {
+		struct bench_ctx *ctx = calloc(2, sizeof(struct bench_ctx));
+		struct nes *nes[2] = {0};
+
+		// no audio callback, re-simulated frames skip the dac so its position is local to each side
+		for (uint8_t y = 0; y < 2; y++) {
+			nes_init(&nes[y], BENCH_SAMPLE_RATE, false, bench_new_frame, NULL, &ctx[y]);
+			nes_cart_load(nes[y], rom, rom_size, NULL, 0, NULL);
+		}
+
+		bool ok = netplay_check_loopback(nes, CHECK_FRAMES, CHECK_LINKS[x][0], CHECK_LINKS[x][1]);
+
+		fprintf(stderr, "%-48s netplay latency %u loss %2u%% %s\n", name, CHECK_LINKS[x][0],
+			CHECK_LINKS[x][1], ok ? "converged" : "DIVERGED");
+
+		match = match && ok;
+
+		for (uint8_t y = 0; y < 2; y++)
+			nes_destroy(&nes[y]);
+
+		free(ctx);
+	}
+
+	return match;
+}
+
+
+/*** MAIN ***/
+
+int32_t main(int32_t argc, char **argv)
+{
+	uint32_t frames = BENCH_FRAMES;
+	uint32_t threads = 0;
+	bool check = false;
+	char out[MAX_ARG_LEN] = {0};
+
+	const char *roms[MAX_ROMS];
+	uint32_t n_roms = 0;
+
+	for (int32_t x = 1; x < argc; x++) {
+		if (!strncmp(argv[x], "-frames=", 8)) {
+			frames = strtoul(argv[x] + 8, NULL, 10);
+
+		} else if (!strncmp(argv[x], "-threads=", 9)) {
+			threads = strtoul(argv[x] + 9, NULL, 10);
+
+		} else if (!strcmp(argv[x], "-check")) {
+			check = true;
+
+		} else if (!strcmp(argv[x], "-indexed")) {
+			BENCH_INDEXED = true;
+
+		} else if (!strncmp(argv[x], "-slices=", 8)) {
+			BENCH_SLICES = (uint16_t) strtoul(argv[x] + 8, NULL, 10);
+
+		} else if (!strncmp(argv[x], "-out=", 5)) {
+			snprintf(out, MAX_ARG_LEN, "%s", argv[x] + 5);
+
+		} else if (argv[x][0] == '-') {
+			fprintf(stderr, "Usage: %s [-check] [-frames=N] [-threads=N] [-indexed] [-slices=N] [-out=FILE] [ROM ...]\n", argv[0]);
+			return 1;
+
+		} else if (n_roms < MAX_ROMS) {
+			roms[n_roms++] = argv[x];
+		}
+	}
+
+	// audio hashes are only comparable across machines if the vector kernels match the scalar ones
+	const char *kernels = NULL;
+
+	if (!apu_dac_check_kernels(&kernels)) {
+		fprintf(stderr, "DAC kernels (%s) differ from the scalar kernels\n", kernels);
+		return 1;
+	}
+
+	if (check) {
+		fprintf(stderr, "DAC kernels (%s) match the scalar kernels\n", kernels);
+
+		// two netplay sessions with input going both ways must end up in the same state
+		bool match = bench_check_netplay("default-rom", DEFAULT_ROM, sizeof(DEFAULT_ROM));
+
+		for (uint32_t x = 0; x < n_roms; x++) {
+			size_t size = 0;
+			uint8_t *rom = bench_read(roms[x], &size);
+
+			if (!rom) {
+				fprintf(stderr, "Failed to read '%s', skipping\n", roms[x]);
+				continue;
+			}
+
+			match = bench_check_netplay(roms[x], rom, size) && match;
+			free(rom);
+		}
+
+		return match ? 0 : 1;
+	}
+
+	// with no roms specified, run the built in corpus
+	bool corpus = n_roms == 0;
+
+	if (corpus)
+		for (; n_roms < sizeof(CORPUS) / sizeof(CORPUS[0]); n_roms++)
+			roms[n_roms] = CORPUS[n_roms];
+
+	if (frames == 0)
+		frames = BENCH_FRAMES;
+
+	bench_crc32_init();
+
+	struct bench_result res[MAX_ROMS + 1];
+	const char *names[MAX_ROMS + 1];
+	uint8_t *data[MAX_ROMS + 1];
+	size_t sizes[MAX_ROMS + 1];
+	uint32_t n = 0;
+
+	if (corpus) {
+		names[n] = "default-rom";
+		data[n] = DEFAULT_ROM;
+		sizes[n++] = sizeof(DEFAULT_ROM);
+	}
+
+	for (uint32_t x = 0; x < n_roms; x++) {
+		data[n] = bench_read(roms[x], &sizes[n]);
+
+		if (!data[n]) {
+			fprintf(stderr, "Failed to read '%s', skipping\n", roms[x]);
+			continue;
+		}
+
+		names[n++] = roms[x];
+	}
+
+	if (threads > 0)
+		bench_run_pool(names, data, sizes, n, frames, threads, res);
+
+	for (uint32_t x = 0; x < n; x++) {
+		if (threads == 0)
+			bench_run(names[x], data[x], sizes[x], frames, &res[x]);
+
+		fprintf(stderr, "%-48s %8.1f fps\n", res[x].name, res[x].frames / res[x].seconds);
+
+		if (data[x] != DEFAULT_ROM)
+			free(data[x]);
+	}
+
+	FILE *f = stdout;
+
+	if (out[0] != '\0') {
+		f = fopen(out, "w");
+
+		if (!f) {
+			fprintf(stderr, "Failed to open '%s' for writing\n", out);
+			return 1;
+		}
+	}
+
+	bench_print(f, res, n, threads > 0);
+
+	if (f != stdout)
+		fclose(f);
+
+	return 0;
+}
@@ -2,10 +2,63 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
 
-static int16_t PULSE_TABLE[31];
-static int16_t TND_TABLE[203];
+#if !defined(APU_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+	#define APU_SSE2
+	#include <emmintrin.h>
+	#include <immintrin.h>
+
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define APU_AVX2
+	#else
+		#define APU_AVX2 __attribute__((target("avx2")))
+	#endif
+
+#elif !defined(APU_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+	#define APU_NEON
+	#include <arm_neon.h>
+#endif
+
+// 95.52 / (8128 / n + 100) as 16-bit PCM
+static const int16_t PULSE_TABLE[31] = {
+	    0,   380,   752,  1114,  1468,  1814,  2152,  2482,
+	 2805,  3120,  3429,  3731,  4027,  4316,  4599,  4876,
+	 5148,  5414,  5675,  5930,  6181,  6426,  6667,  6904,
+	 7135,  7363,  7586,  7805,  8020,  8231,  8438,
+};
+
+// 163.67 / (24329 / n + 100) as 16-bit PCM
+static const int16_t TND_TABLE[203] = {
+	    0,   220,   437,   653,   868,  1080,  1291,  1500,
+	 1707,  1913,  2117,  2320,  2521,  2720,  2918,  3115,
+	 3309,  3503,  3695,  3885,  4074,  4261,  4448,  4632,
+	 4816,  4998,  5178,  5357,  5535,  5712,  5887,  6061,
+	 6234,  6406,  6576,  6745,  6913,  7080,  7245,  7409,
+	 7573,  7735,  7896,  8055,  8214,  8371,  8528,  8683,
+	 8838,  8991,  9143,  9294,  9444,  9594,  9742,  9889,
+	10035, 10180, 10324, 10468, 10610, 10751, 10892, 11031,
+	11170, 11308, 11445, 11580, 11716, 11850, 11983, 12116,
+	12247, 12378, 12508, 12637, 12766, 12893, 13020, 13146,
+	13271, 13396, 13520, 13642, 13765, 13886, 14007, 14127,
+	14246, 14365, 14482, 14599, 14716, 14832, 14947, 15061,
+	15175, 15288, 15400, 15512, 15623, 15733, 15843, 15952,
+	16061, 16168, 16276, 16382, 16488, 16594, 16699, 16803,
+	16907, 17010, 17112, 17214, 17315, 17416, 17516, 17616,
+	17715, 17814, 17912, 18009, 18106, 18203, 18299, 18394,
+	18489, 18583, 18677, 18771, 18864, 18956, 19048, 19139,
+	19230, 19321, 19411, 19500, 19589, 19678, 19766, 19854,
+	19941, 20028, 20114, 20200, 20285, 20370, 20455, 20539,
+	20623, 20706, 20789, 20871, 20953, 21035, 21116, 21197,
+	21278, 21358, 21437, 21516, 21595, 21674, 21752, 21830,
+	21907, 21984, 22060, 22137, 22212, 22288, 22363, 22438,
+	22512, 22586, 22660, 22733, 22806, 22879, 22951, 23023,
+	23095, 23166, 23237, 23308, 23378, 23448, 23518, 23587,
+	23656, 23725, 23793, 23861, 23929, 23996, 24064, 24130,
+	24197, 24263, 24329,
+};
 
 
 /*** LENGTH COUNTER ***/
@@ -92,12 +145,12 @@ struct pulse {
 	uint8_t duty_value;
 };
 
-static uint8_t LENGTH_TABLE[] = {
+static const uint8_t LENGTH_TABLE[] = {
 	10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
 	12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
 };
 
-static uint8_t DUTY_TABLE[4][8] = {
+static const uint8_t DUTY_TABLE[4][8] = {
 	{0, 1, 0, 0, 0, 0, 0, 0},
 	{0, 1, 1, 0, 0, 0, 0, 0},
 	{0, 1, 1, 1, 1, 0, 0, 0},
@@ -177,7 +230,7 @@ struct triangle {
 	uint8_t duty_value;
 };
 
-static uint8_t TRIANGLE_TABLE[] = {
+static const uint8_t TRIANGLE_TABLE[] = {
 	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
 	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
 };
@@ -236,7 +289,7 @@ struct noise {
 	uint16_t shift_register;
 };
 
-static uint16_t NOISE_TABLE[] = {
+static const uint16_t NOISE_TABLE[] = {
 	4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
 };
 
@@ -249,6 +302,12 @@ static void apu_noise_output(struct noise *n)
 	n->output = TND_TABLE[level] * 2;
 }
 
+static void apu_noise_shift(struct noise *n)
+{
+	uint16_t feedback = (n->shift_register & 0x0001) ^ ((n->shift_register >> (n->mode ? 6 : 1)) & 0x0001);
+	n->shift_register = (n->shift_register >> 1) | (feedback << 14);
+}
+
 static void apu_noise_step_timer(struct noise *n)
 {
 	if (n->timer.value > 0)
@@ -257,9 +316,7 @@ static void apu_noise_step_timer(struct noise *n)
 	if (n->timer.value == 0) {
 		n->timer.value = n->timer.period;
 
-		uint16_t feedback = (n->shift_register & 0x0001) ^ ((n->shift_register >> (n->mode ? 6 : 1)) & 0x0001);
-		n->shift_register = (n->shift_register >> 1) | (feedback << 14);
-
+		apu_noise_shift(n);
 		apu_noise_output(n);
 	}
 }
@@ -294,7 +351,7 @@ struct dmc {
 	bool irq_flag;
 };
 
-static uint8_t DMC_TABLE[] = {
+static const uint8_t DMC_TABLE[] = {
 	214, 190, 170, 160, 143, 127, 113, 107, 95, 80, 71, 64, 53, 42, 36, 27,
 };
 
@@ -382,6 +439,11 @@ static void apu_dmc_step_timer(struct dmc *d, struct nes *nes, struct cpu *cpu)
 #define CLOCK_RATE    1789773
 #define OUTPUT_SIZE   1024
 
+struct dac;
+
+typedef void (*DAC_INSERT)(int32_t *out, const int16_t *a, const int16_t *b, int32_t delta, int32_t delta2);
+typedef void (*DAC_MIX)(struct dac *dac, int32_t samples);
+
 struct dac {
 	bool stereo;
 	uint32_t frame_samples;
@@ -392,42 +454,46 @@ struct dac {
 	int32_t integrator[2];
 	int32_t samples[2][2048];
 	int16_t output[OUTPUT_SIZE];
+
+	// picked for the host cpu at init, never saved
+	DAC_INSERT insert;
+	DAC_MIX mix;
 };
 
-static int16_t SINC[PHASE_COUNT + 1][16] = {
-	{43, -115,  350, -488, 1136, -914,  5861, 21022},
-	{44, -118,  348, -473, 1076, -799,  5274, 21001},
-	{45, -121,  344, -454, 1011, -677,  4706, 20936},
-	{46, -122,  336, -431,  942, -549,  4156, 20829},
-	{47, -123,  327, -404,  868, -418,  3629, 20679},
-	{47, -122,  316, -375,  792, -285,  3124, 20488},
-	{47, -120,  303, -344,  714, -151,  2644, 20256},
-	{46, -117,  289, -310,  634,  -17,  2188, 19985},
-	{46, -114,  273, -275,  553,  117,  1758, 19675},
-	{44, -108,  255, -237,  471,  247,  1356, 19327},
-	{43, -103,  237, -199,  390,  373,   981, 18944},
-	{42,  -98,  218, -160,  310,  495,   633, 18527},
-	{40,  -91,  198, -121,  231,  611,   314, 18078},
-	{38,  -84,  178,  -81,  153,  722,    22, 17599},
-	{36,  -76,  157,  -43,   80,  824,  -241, 17092},
-	{34,  -68,  135,   -3,    8,  919,  -476, 16558},
-	{32,  -61,  115,   34,  -60, 1006,  -683, 16001},
-	{29,  -52,   94,   70, -123, 1083,  -862, 15422},
-	{27,  -44,   73,  106, -184, 1152, -1015, 14824},
-	{25,  -36,   53,  139, -239, 1211, -1142, 14210},
-	{22,  -27,   34,  170, -290, 1261, -1244, 13582},
-	{20,  -20,   16,  199, -335, 1301, -1322, 12942},
-	{18,  -12,   -3,  226, -375, 1331, -1376, 12293},
-	{15,   -4,  -19,  250, -410, 1351, -1408, 11638},
-	{13,    3,  -35,  272, -439, 1361, -1419, 10979},
-	{11,    9,  -49,  292, -464, 1362, -1410, 10319},
-	{ 9,   16,  -63,  309, -483, 1354, -1383,  9660},
-	{ 7,   22,  -75,  322, -496, 1337, -1339,  9005},
-	{ 6,   26,  -85,  333, -504, 1312, -1280,  8355},
-	{ 4,   31,  -94,  341, -507, 1278, -1205,  7713},
-	{ 3,   35, -102,  347, -506, 1238, -1119,  7082},
-	{ 1,   40, -110,  350, -499, 1190, -1021,  6464},
-	{ 0,   43, -115,  350, -488, 1136,  -914,  5861},
+static const int16_t SINC[PHASE_COUNT + 1][16] = {
+	{43, -115,  350, -488, 1136, -914,  5861, 21022,  5861,  -914, 1136, -488,  350, -115,   43,  0},
+	{44, -118,  348, -473, 1076, -799,  5274, 21001,  6464, -1021, 1190, -499,  350, -110,   40,  1},
+	{45, -121,  344, -454, 1011, -677,  4706, 20936,  7082, -1119, 1238, -506,  347, -102,   35,  3},
+	{46, -122,  336, -431,  942, -549,  4156, 20829,  7713, -1205, 1278, -507,  341,  -94,   31,  4},
+	{47, -123,  327, -404,  868, -418,  3629, 20679,  8355, -1280, 1312, -504,  333,  -85,   26,  6},
+	{47, -122,  316, -375,  792, -285,  3124, 20488,  9005, -1339, 1337, -496,  322,  -75,   22,  7},
+	{47, -120,  303, -344,  714, -151,  2644, 20256,  9660, -1383, 1354, -483,  309,  -63,   16,  9},
+	{46, -117,  289, -310,  634,  -17,  2188, 19985, 10319, -1410, 1362, -464,  292,  -49,    9, 11},
+	{46, -114,  273, -275,  553,  117,  1758, 19675, 10979, -1419, 1361, -439,  272,  -35,    3, 13},
+	{44, -108,  255, -237,  471,  247,  1356, 19327, 11638, -1408, 1351, -410,  250,  -19,   -4, 15},
+	{43, -103,  237, -199,  390,  373,   981, 18944, 12293, -1376, 1331, -375,  226,   -3,  -12, 18},
+	{42,  -98,  218, -160,  310,  495,   633, 18527, 12942, -1322, 1301, -335,  199,   16,  -20, 20},
+	{40,  -91,  198, -121,  231,  611,   314, 18078, 13582, -1244, 1261, -290,  170,   34,  -27, 22},
+	{38,  -84,  178,  -81,  153,  722,    22, 17599, 14210, -1142, 1211, -239,  139,   53,  -36, 25},
+	{36,  -76,  157,  -43,   80,  824,  -241, 17092, 14824, -1015, 1152, -184,  106,   73,  -44, 27},
+	{34,  -68,  135,   -3,    8,  919,  -476, 16558, 15422,  -862, 1083, -123,   70,   94,  -52, 29},
+	{32,  -61,  115,   34,  -60, 1006,  -683, 16001, 16001,  -683, 1006,  -60,   34,  115,  -61, 32},
+	{29,  -52,   94,   70, -123, 1083,  -862, 15422, 16558,  -476,  919,    8,   -3,  135,  -68, 34},
+	{27,  -44,   73,  106, -184, 1152, -1015, 14824, 17092,  -241,  824,   80,  -43,  157,  -76, 36},
+	{25,  -36,   53,  139, -239, 1211, -1142, 14210, 17599,    22,  722,  153,  -81,  178,  -84, 38},
+	{22,  -27,   34,  170, -290, 1261, -1244, 13582, 18078,   314,  611,  231, -121,  198,  -91, 40},
+	{20,  -20,   16,  199, -335, 1301, -1322, 12942, 18527,   633,  495,  310, -160,  218,  -98, 42},
+	{18,  -12,   -3,  226, -375, 1331, -1376, 12293, 18944,   981,  373,  390, -199,  237, -103, 43},
+	{15,   -4,  -19,  250, -410, 1351, -1408, 11638, 19327,  1356,  247,  471, -237,  255, -108, 44},
+	{13,    3,  -35,  272, -439, 1361, -1419, 10979, 19675,  1758,  117,  553, -275,  273, -114, 46},
+	{11,    9,  -49,  292, -464, 1362, -1410, 10319, 19985,  2188,  -17,  634, -310,  289, -117, 46},
+	{ 9,   16,  -63,  309, -483, 1354, -1383,  9660, 20256,  2644, -151,  714, -344,  303, -120, 47},
+	{ 7,   22,  -75,  322, -496, 1337, -1339,  9005, 20488,  3124, -285,  792, -375,  316, -122, 47},
+	{ 6,   26,  -85,  333, -504, 1312, -1280,  8355, 20679,  3629, -418,  868, -404,  327, -123, 47},
+	{ 4,   31,  -94,  341, -507, 1278, -1205,  7713, 20829,  4156, -549,  942, -431,  336, -122, 46},
+	{ 3,   35, -102,  347, -506, 1238, -1119,  7082, 20936,  4706, -677, 1011, -454,  344, -121, 45},
+	{ 1,   40, -110,  350, -499, 1190, -1021,  6464, 21001,  5274, -799, 1076, -473,  348, -118, 44},
+	{ 0,   43, -115,  350, -488, 1136,  -914,  5861, 21022,  5861, -914, 1136, -488,  350, -115, 43},
 };
 
 static int16_t apu_clampi32(int32_t pcmi32)
@@ -435,25 +501,193 @@ static int16_t apu_clampi32(int32_t pcmi32)
 	return pcmi32 < -32768 ? -32768 : pcmi32 > 32767 ? 32767 : (int16_t) pcmi32;
 }
 
-static int16_t apu_clampf64(double pcm)
+static void apu_dac_output_channel(struct dac *dac, uint8_t chan, int32_t offset)
+{
+	int16_t s = apu_clampi32(dac->integrator[chan] >> DELTA_BITS);
+	dac->output[offset * 2 + chan] = s;
+	dac->integrator[chan] += dac->samples[chan][offset];
+	dac->integrator[chan] -= s << (DELTA_BITS - BASS_SHIFT); //high pass filter
+}
+
+static void apu_dac_spatialize(struct dac *dac, int32_t x)
+{
+	int16_t *l = &dac->output[x * 2];
+	int16_t *r = &dac->output[x * 2 + 1];
+
+	if (dac->stereo) {
+		int16_t stereo_l = (int16_t) lrint((*l * 0.65 + *r * 0.35) * 1.65);
+		int16_t stereo_r = (int16_t) lrint((*r * 0.65 + *l * 0.35) * 1.65);
+
+		*l = stereo_l;
+		*r = stereo_r;
+
+	} else {
+		*r = *l;
+	}
+}
+
+
+/*** DAC KERNELS ***/
+
+// step insertion adds two rows of the sinc table scaled by the split delta, the mix runs the
+// integrator, high pass and clamp for both channels then spatializes; every vector version
+// must stay bit-identical to the scalar one, apu_dac_check_kernels compares them
+
+static void apu_dac_insert_scalar(int32_t *out, const int16_t *a, const int16_t *b, int32_t delta, int32_t delta2)
+{
+	for (uint8_t x = 0; x < 16; x++)
+		out[x] += a[x] * delta + b[x] * delta2;
+}
+
+static void apu_dac_mix_scalar(struct dac *dac, int32_t samples)
+{
+	for (int32_t x = 0; x < samples; x++) {
+		apu_dac_output_channel(dac, 0, x);
+		apu_dac_output_channel(dac, 1, x);
+		apu_dac_spatialize(dac, x);
+	}
+}
+
+#if defined(APU_SSE2)
+
+// interleaving the two rows lets madd do both products and the sum in one go
+static void apu_dac_insert_sse2(int32_t *out, const int16_t *a, const int16_t *b, int32_t delta, int32_t delta2)
+{
+	__m128i d = _mm_set1_epi32((int32_t) ((uint32_t) delta2 << 16 | (uint16_t) delta));
+
+	for (uint8_t x = 0; x < 16; x += 8) {
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + x));
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), d);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), d);
+
+		_mm_storeu_si128((__m128i *) (out + x), _mm_add_epi32(_mm_loadu_si128((__m128i *) (out + x)), lo));
+		_mm_storeu_si128((__m128i *) (out + x + 4), _mm_add_epi32(_mm_loadu_si128((__m128i *) (out + x + 4)), hi));
+	}
+}
+
+static APU_AVX2 void apu_dac_insert_avx2(int32_t *out, const int16_t *a, const int16_t *b, int32_t delta, int32_t delta2)
+{
+	__m256i d = _mm256_set1_epi32((int32_t) ((uint32_t) delta2 << 16 | (uint16_t) delta));
+	__m256i va = _mm256_loadu_si256((const __m256i *) a);
+	__m256i vb = _mm256_loadu_si256((const __m256i *) b);
+
+	// unpack works per 128-bit lane, lo holds taps 0-3 and 8-11, hi holds 4-7 and 12-15
+	__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(va, vb), d);
+	__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(va, vb), d);
+	__m256i r0 = _mm256_permute2x128_si256(lo, hi, 0x20);
+	__m256i r1 = _mm256_permute2x128_si256(lo, hi, 0x31);
+
+	_mm256_storeu_si256((__m256i *) out, _mm256_add_epi32(_mm256_loadu_si256((__m256i *) out), r0));
+	_mm256_storeu_si256((__m256i *) (out + 8), _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (out + 8)), r1));
+}
+
+// both channels share one register, the integrator is serial so there is nothing to gain across samples
+static void apu_dac_mix_sse2(struct dac *dac, int32_t samples)
 {
-	return apu_clampi32(lrint(pcm * 32768.0));
+	__m128i integrator = _mm_set_epi32(0, 0, dac->integrator[1], dac->integrator[0]);
+	__m128d c065 = _mm_set1_pd(0.65);
+	__m128d c035 = _mm_set1_pd(0.35);
+	__m128d c165 = _mm_set1_pd(1.65);
+
+	for (int32_t x = 0; x < samples; x++) {
+		// packs saturates to int16 which is exactly the clamp
+		__m128i s16 = _mm_packs_epi32(_mm_srai_epi32(integrator, DELTA_BITS), _mm_setzero_si128());
+		__m128i s = _mm_srai_epi32(_mm_unpacklo_epi16(s16, s16), 16);
+
+		__m128i in = _mm_set_epi32(0, 0, dac->samples[1][x], dac->samples[0][x]);
+		integrator = _mm_add_epi32(integrator, in);
+		integrator = _mm_sub_epi32(integrator, _mm_slli_epi32(s, DELTA_BITS - BASS_SHIFT)); //high pass filter
+
+		if (dac->stereo) {
+			// same operations in the same order as the scalar lrint, rounding follows MXCSR
+			__m128d lr = _mm_cvtepi32_pd(s);
+			__m128d rl = _mm_shuffle_pd(lr, lr, 1);
+			__m128d v = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(lr, c065), _mm_mul_pd(rl, c035)), c165);
+			__m128i i = _mm_cvtpd_epi32(v);
+
+			dac->output[x * 2] = (int16_t) _mm_cvtsi128_si32(i);
+			dac->output[x * 2 + 1] = (int16_t) _mm_cvtsi128_si32(_mm_srli_si128(i, 4));
+
+		} else {
+			dac->output[x * 2] = dac->output[x * 2 + 1] = (int16_t) _mm_cvtsi128_si32(s);
+		}
+	}
+
+	dac->integrator[0] = _mm_cvtsi128_si32(integrator);
+	dac->integrator[1] = _mm_cvtsi128_si32(_mm_srli_si128(integrator, 4));
 }
 
-static void apu_dac_init(void)
+static bool apu_has_avx2(void)
 {
-	for (int32_t x = 0; x < 31; x++)
-		PULSE_TABLE[x] = apu_clampf64(95.52 / (8128.0 / (float) x + 100.0));
+	#if defined(_MSC_VER)
+		int32_t info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		__cpuid(info, 1);
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return false; // osxsave, avx
+		if ((_xgetbv(0) & 0x6) != 0x6) return false; // os saves ymm
+
+		__cpuidex(info, 7, 0);
+		return info[1] & (1 << 5);
+	#else
+		return __builtin_cpu_supports("avx2");
+	#endif
+}
 
-	for (int32_t x = 0; x < 203; x++)
-		TND_TABLE[x] = apu_clampf64(163.67 / (24329.0 / (float) x + 100.0));
+#elif defined(APU_NEON)
 
-	for (int32_t x = 0; x < PHASE_COUNT + 1; x++) {
-		for (int32_t y = 0; y < 8; y++)
-			SINC[PHASE_COUNT - x][15 - y] = SINC[x][y];
+static void apu_dac_insert_neon(int32_t *out, const int16_t *a, const int16_t *b, int32_t delta, int32_t delta2)
+{
+	for (uint8_t x = 0; x < 16; x += 4) {
+		int32x4_t acc = vld1q_s32(out + x);
+		acc = vmlal_n_s16(acc, vld1_s16(a + x), (int16_t) delta);
+		acc = vmlal_n_s16(acc, vld1_s16(b + x), (int16_t) delta2);
+		vst1q_s32(out + x, acc);
 	}
 }
 
+// the stereo mix stays scalar here, compilers are free to fuse its multiply-adds on ARM and
+// only the scalar code is guaranteed to be fused the same way as before
+static void apu_dac_mix_neon(struct dac *dac, int32_t samples)
+{
+	int32x2_t integrator = vld1_s32(dac->integrator);
+
+	for (int32_t x = 0; x < samples; x++) {
+		int16x4_t s16 = vqmovn_s32(vcombine_s32(vshr_n_s32(integrator, DELTA_BITS), vdup_n_s32(0)));
+		int32x2_t s = vget_low_s32(vmovl_s16(s16));
+
+		dac->output[x * 2] = vget_lane_s16(s16, 0);
+		dac->output[x * 2 + 1] = vget_lane_s16(s16, 1);
+
+		int32_t in[2] = {dac->samples[0][x], dac->samples[1][x]};
+		integrator = vadd_s32(integrator, vld1_s32(in));
+		integrator = vsub_s32(integrator, vshl_n_s32(s, DELTA_BITS - BASS_SHIFT)); //high pass filter
+
+		apu_dac_spatialize(dac, x);
+	}
+
+	vst1_s32(dac->integrator, integrator);
+}
+
+#endif
+
+static void apu_dac_select_kernels(struct dac *dac)
+{
+	dac->insert = apu_dac_insert_scalar;
+	dac->mix = apu_dac_mix_scalar;
+
+	#if defined(APU_SSE2)
+		dac->insert = apu_has_avx2() ? apu_dac_insert_avx2 : apu_dac_insert_sse2;
+		dac->mix = apu_dac_mix_sse2;
+
+	#elif defined(APU_NEON)
+		dac->insert = apu_dac_insert_neon;
+		dac->mix = apu_dac_mix_neon;
+	#endif
+}
+
 static void apu_dac_add_sample(struct dac *dac, uint32_t offset, uint8_t chan, int16_t sample, bool fast)
 {
 	if (sample == dac->prev_sample[chan])
@@ -475,56 +709,30 @@ static void apu_dac_add_sample(struct dac *dac, uint32_t offset, uint8_t chan, i
 		int32_t delta2 = (delta * interp) >> DELTA_BITS;
 		delta -= delta2;
 
-		for (uint8_t x = 0; x < 16; x++)
-			out[x] += SINC[phase][x] * delta + SINC[phase + 1][x] * delta2;
+		// the vector kernels multiply in 16 bits, a step bigger than that splits into halves that may not fit
+		if (delta >= INT16_MIN && delta <= INT16_MAX && delta2 >= INT16_MIN && delta2 <= INT16_MAX) {
+			dac->insert(out, SINC[phase], SINC[phase + 1], delta, delta2);
+
+		} else {
+			apu_dac_insert_scalar(out, SINC[phase], SINC[phase + 1], delta, delta2);
+		}
 	}
 
 	dac->prev_sample[chan] = sample;
 }
 
-static void apu_dac_output_channel(struct dac *dac, uint8_t chan, int32_t offset)
-{
-	int16_t s = apu_clampi32(dac->integrator[chan] >> DELTA_BITS);
-	dac->output[offset * 2 + chan] = s;
-	dac->integrator[chan] += dac->samples[chan][offset];
-	dac->integrator[chan] -= s << (DELTA_BITS - BASS_SHIFT); //high pass filter
-}
-
-static void apu_dac_spatialize(struct dac *dac, int32_t x)
-{
-	int16_t *l = &dac->output[x * 2];
-	int16_t *r = &dac->output[x * 2 + 1];
-
-	if (dac->stereo) {
-		int16_t stereo_l = (int16_t) lrint((*l * 0.65 + *r * 0.35) * 1.65);
-		int16_t stereo_r = (int16_t) lrint((*r * 0.65 + *l * 0.35) * 1.65);
-
-		*l = stereo_l;
-		*r = stereo_r;
-
-	} else {
-		*r = *l;
-	}
-}
-
 static void apu_dac_generate_output(struct dac *dac, uint32_t offset, SAMPLE_CALLBACK new_samples, void *opaque)
 {
 	int32_t samples = offset >> TIME_BITS;
 	dac->offset = offset & (TIME_UNIT - 1);
 	dac->cycle = 0;
 
-	for (int32_t x = 0; x < samples; x++) {
-		apu_dac_output_channel(dac, 0, x);
-		apu_dac_output_channel(dac, 1, x);
-		apu_dac_spatialize(dac, x);
+	dac->mix(dac, samples);
 
-		if (x < 18) {
-			dac->samples[0][x] = dac->samples[0][samples + x];
-			dac->samples[1][x] = dac->samples[1][samples + x];
-			dac->samples[0][samples + x]  = dac->samples[1][samples + x] = 0;
-		} else {
-			dac->samples[0][x]  = dac->samples[1][x] = 0;
-		}
+	// the last 18 entries hold the tails of steps past the end of this batch
+	for (uint8_t chan = 0; chan < 2; chan++) {
+		memcpy(dac->samples[chan], dac->samples[chan] + samples, 18 * sizeof(int32_t));
+		memset(dac->samples[chan] + 18, 0, samples * sizeof(int32_t));
 	}
 
 	new_samples(dac->output, samples, opaque);
@@ -545,6 +753,97 @@ static void apu_dac_step(struct dac *dac, int16_t l, int16_t r, SAMPLE_CALLBACK
 }
 
 
+/*** DAC SELF TEST ***/
+
+// a dac on the given kernels and one on the scalar kernels take the same steps and mix the same
+// blocks. levels span +-20000 so some steps split into halves that don't fit 16 bits and have to
+// be kept off the vector kernels by the dispatch, while sums stay clear of int32 overflow
+
+#define TEST_BLOCKS 256
+#define TEST_STEPS  48
+#define TEST_LEVEL  20000
+
+static uint32_t apu_test_rand(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+
+	return *seed >> 8;
+}
+
+static bool apu_dac_kernels_match(DAC_INSERT insert, DAC_MIX mix, bool stereo)
+{
+	struct dac *ref = calloc(1, sizeof(struct dac));
+	struct dac *vec = calloc(1, sizeof(struct dac));
+
+	ref->insert = apu_dac_insert_scalar;
+	ref->mix = apu_dac_mix_scalar;
+	vec->insert = insert;
+	vec->mix = mix;
+	ref->stereo = vec->stereo = stereo;
+
+	uint32_t seed = 1;
+	bool match = true;
+
+	for (int32_t x = 0; x < TEST_BLOCKS && match; x++) {
+		int32_t samples = OUTPUT_SIZE / 4 + apu_test_rand(&seed) % (OUTPUT_SIZE / 4);
+
+		for (int32_t y = 0; y < TEST_STEPS; y++) {
+			uint32_t offset = apu_test_rand(&seed) % ((uint32_t) samples << TIME_BITS);
+			uint8_t chan = apu_test_rand(&seed) & 1;
+			int16_t level = (int16_t) ((int32_t) (apu_test_rand(&seed) % (2 * TEST_LEVEL + 1)) - TEST_LEVEL);
+
+			// the extremes back to back make the largest splits
+			if (y % 8 == 0)
+				level = y % 16 == 0 ? TEST_LEVEL : -TEST_LEVEL;
+
+			apu_dac_add_sample(ref, offset, chan, level, false);
+			apu_dac_add_sample(vec, offset, chan, level, false);
+		}
+
+		match = !memcmp(ref->samples, vec->samples, sizeof(ref->samples));
+
+		ref->mix(ref, samples);
+		vec->mix(vec, samples);
+
+		match = match && !memcmp(ref->output, vec->output, samples * 2 * sizeof(int16_t)) &&
+			ref->integrator[0] == vec->integrator[0] && ref->integrator[1] == vec->integrator[1];
+
+		memset(ref->samples, 0, sizeof(ref->samples));
+		memset(vec->samples, 0, sizeof(vec->samples));
+	}
+
+	free(ref);
+	free(vec);
+
+	return match;
+}
+
+bool apu_dac_check_kernels(const char **name)
+{
+	bool match = true;
+	*name = "scalar";
+
+	#if defined(APU_SSE2)
+		*name = "sse2";
+		match = apu_dac_kernels_match(apu_dac_insert_sse2, apu_dac_mix_sse2, true) &&
+			apu_dac_kernels_match(apu_dac_insert_sse2, apu_dac_mix_sse2, false);
+
+		if (match && apu_has_avx2()) {
+			*name = "sse2, avx2";
+			match = apu_dac_kernels_match(apu_dac_insert_avx2, apu_dac_mix_sse2, true) &&
+				apu_dac_kernels_match(apu_dac_insert_avx2, apu_dac_mix_sse2, false);
+		}
+
+	#elif defined(APU_NEON)
+		*name = "neon";
+		match = apu_dac_kernels_match(apu_dac_insert_neon, apu_dac_mix_neon, true) &&
+			apu_dac_kernels_match(apu_dac_insert_neon, apu_dac_mix_neon, false);
+	#endif
+
+	return match;
+}
+
+
 /*** READ & WRITE ***/
 
 struct apu {
@@ -827,7 +1126,7 @@ static void apu_step_frame_counter(struct apu *apu, struct cpu *cpu)
 	}
 }
 
-void apu_step(struct apu *apu, struct nes *nes, struct cpu *cpu, SAMPLE_CALLBACK new_samples, void *opaque)
+static void apu_step(struct apu *apu, struct nes *nes, struct cpu *cpu, SAMPLE_CALLBACK new_samples, void *opaque)
 {
 	apu->cpu_cycle++;
 	apu->frame_counter++;
@@ -846,7 +1145,8 @@ void apu_step(struct apu *apu, struct nes *nes, struct cpu *cpu, SAMPLE_CALLBACK
 	//sample
 	int16_t l = apu->p[0].output + apu->t.output + apu->d.output;
 	int16_t r = apu->p[1].output + apu->n.output;
-	apu_dac_step(&apu->dac, l, r, new_samples, opaque);
+	if (new_samples)
+		apu_dac_step(&apu->dac, l, r, new_samples, opaque);
 
 	//process the frame counter
 	if (!(apu->delayed_reset > 0 && apu->delayed_reset < 3 && apu->mode))
@@ -871,6 +1171,311 @@ void apu_step(struct apu *apu, struct nes *nes, struct cpu *cpu, SAMPLE_CALLBACK
 }
 
 
+/*** SKIPPING ***/
+
+// between events every timer just counts down and the levels the dac sees hold still, so those
+// spans are run in one go. channels that can't change their output (silent pulse/noise, a halted
+// triangle, an idle dmc) don't end a span, their timers and shifters are advanced analytically
+
+static const int64_t FRAME_STEPS[2][6] = {
+	{7457, 14913, 22371, 29828, 29829, 29830},
+	{7457, 14913, 22371, 29829, 37281, 37282},
+};
+
+// pulse & triangle timers reload when clocked at 0, returns how many times that happened
+static uint64_t apu_timer_skip(struct timer *t, uint64_t clocks)
+{
+	if (clocks <= t->value) {
+		t->value -= (uint16_t) clocks;
+		return 0;
+	}
+
+	uint64_t n = clocks - t->value - 1;
+	t->value = t->period - (uint16_t) (n % ((uint64_t) t->period + 1));
+
+	return 1 + n / ((uint64_t) t->period + 1);
+}
+
+// noise & dmc timers reload when they count down to 0, which is a period shorter
+static uint64_t apu_timer_skip_down(struct timer *t, uint64_t clocks)
+{
+	struct timer u = {
+		.period = t->period > 0 ? t->period - 1 : 0,
+		.value = t->value > 0 ? t->value - 1 : 0,
+	};
+
+	uint64_t n = apu_timer_skip(&u, clocks);
+	t->value = (n == 0 || t->period > 0) ? u.value + 1 : 0;
+
+	return n;
+}
+
+static bool apu_pulse_silent(struct pulse *p)
+{
+	uint8_t volume = p->env.constant_volume ? p->env.v : p->env.decay_level;
+
+	return p->output == 0 && (p->len.value == 0 || volume == 0 || apu_sweep_mute(p));
+}
+
+static bool apu_triangle_halted(struct triangle *t)
+{
+	return t->len.value == 0 || t->counter.value == 0 || t->timer.period == 0;
+}
+
+static bool apu_noise_silent(struct noise *n)
+{
+	uint8_t volume = n->env.constant_volume ? n->env.v : n->env.decay_level;
+
+	return n->output == 0 && (n->len.value == 0 || volume == 0);
+}
+
+static bool apu_dmc_idle(struct dmc *d)
+{
+	return d->out.silence && d->reader.sample_buffer_empty;
+}
+
+static uint64_t apu_odd_steps(struct apu *apu, uint64_t clocks)
+{
+	return clocks * 2 + (apu->cpu_cycle & 1);
+}
+
+static uint64_t apu_quiet_steps(struct apu *apu, bool sampling)
+{
+	if (apu->delayed_reset > 0)
+		return 0;
+
+	uint64_t n = UINT64_MAX;
+
+	for (uint8_t x = 0; x < 6; x++) {
+		if (FRAME_STEPS[apu->mode][x] > apu->frame_counter) {
+			n = FRAME_STEPS[apu->mode][x] - apu->frame_counter - 1;
+			break;
+		}
+	}
+
+	for (uint8_t x = 0; x < 2; x++) {
+		if (!apu_pulse_silent(&apu->p[x])) {
+			uint64_t steps = apu_odd_steps(apu, apu->p[x].timer.value);
+			if (steps < n) n = steps;
+		}
+	}
+
+	if (!apu_triangle_halted(&apu->t) && apu->t.timer.value < n)
+		n = apu->t.timer.value;
+
+	if (!apu_noise_silent(&apu->n)) {
+		uint64_t steps = apu->n.timer.value > 0 ? apu->n.timer.value - 1 : 0;
+		if (steps < n) n = steps;
+	}
+
+	if (!apu_dmc_idle(&apu->d)) {
+		uint64_t steps = apu_odd_steps(apu, apu->d.timer.value > 0 ? apu->d.timer.value - 1 : 0);
+		if (steps < n) n = steps;
+	}
+
+	if (sampling) {
+		struct dac *dac = &apu->dac;
+
+		int16_t l = apu->p[0].output + apu->t.output + apu->d.output;
+		int16_t r = apu->p[1].output + apu->n.output;
+		if (!dac->stereo)
+			l += r;
+
+		// a level changed by a register write or the frame counter reaches the dac on the next step
+		if (l != dac->prev_sample[0] || r != dac->prev_sample[1] || dac->cycle > dac->frame_samples)
+			return 0;
+
+		uint64_t steps = dac->frame_samples - dac->cycle + 1;
+		if (steps < n) n = steps;
+	}
+
+	return n;
+}
+
+static void apu_skip(struct apu *apu, uint32_t steps, bool sampling)
+{
+	uint64_t clocks = ((apu->cpu_cycle + steps + 1) >> 1) - ((apu->cpu_cycle + 1) >> 1);
+
+	apu->cpu_cycle += steps;
+	apu->frame_counter += steps;
+
+	for (uint8_t x = 0; x < 2; x++) {
+		uint64_t n = apu_timer_skip(&apu->p[x].timer, clocks);
+		apu->p[x].duty_value = (apu->p[x].duty_value + n) % 8;
+	}
+
+	apu_timer_skip(&apu->t.timer, steps);
+
+	for (uint64_t n = apu_timer_skip_down(&apu->n.timer, steps); n > 0; n--)
+		apu_noise_shift(&apu->n);
+
+	uint64_t n = apu_timer_skip_down(&apu->d.timer, clocks);
+	if (n > 0) {
+		uint8_t bits = apu->d.out.bits_remaining;
+
+		apu->d.out.shift_register = n < 8 ? apu->d.out.shift_register >> n : 0;
+		apu->d.out.bits_remaining = n <= bits ? bits - (uint8_t) n : 7 - (uint8_t) ((n - bits - 1) % 8);
+	}
+
+	if (sampling)
+		apu->dac.cycle += steps;
+
+	apu_delayed_length_enabled(apu);
+	apu->mode = apu->next_mode;
+}
+
+void apu_run(struct apu *apu, struct nes *nes, struct cpu *cpu, uint32_t cycles, SAMPLE_CALLBACK new_samples, void *opaque)
+{
+	while (cycles > 0) {
+		uint64_t quiet = apu_quiet_steps(apu, new_samples != NULL);
+
+		if (quiet > 0) {
+			uint32_t steps = quiet < cycles ? (uint32_t) quiet : cycles;
+
+			apu_skip(apu, steps, new_samples != NULL);
+			cycles -= steps;
+		}
+
+		if (cycles > 0) {
+			apu_step(apu, nes, cpu, new_samples, opaque);
+			cycles--;
+		}
+	}
+}
+
+uint32_t apu_next_event(struct apu *apu, bool blocks)
+{
+	// the frame counter reset after a $4017 write is short, step through it
+	if (apu->delayed_reset > 0)
+		return 1;
+
+	uint64_t n = UINT32_MAX;
+
+	// frame IRQ
+	if (!apu->mode && !apu->irq_disabled) {
+		for (uint8_t x = 3; x < 6; x++) {
+			if (FRAME_STEPS[0][x] > apu->frame_counter) {
+				n = FRAME_STEPS[0][x] - apu->frame_counter;
+				break;
+			}
+		}
+	}
+
+	// DMC DMA, the buffer is refilled at the end of the out cycle that empties it
+	struct dmc *d = &apu->d;
+
+	if (!d->reader.sample_buffer_empty && d->current_length > 0) {
+		uint64_t clocks = (d->timer.value > 0 ? d->timer.value : 1) +
+			(uint64_t) d->out.bits_remaining * (d->timer.period > 0 ? d->timer.period : 1);
+		uint64_t steps = clocks * 2 - 1 + (apu->cpu_cycle & 1);
+
+		if (steps < n) n = steps;
+	}
+
+	// the next block of samples, for hosts that stop as soon as audio is ready
+	if (blocks) {
+		struct dac *dac = &apu->dac;
+		uint64_t steps = dac->cycle <= dac->frame_samples + 1 ? dac->frame_samples + 2 - dac->cycle : 1;
+
+		if (steps < n) n = steps;
+	}
+
+	return (uint32_t) n;
+}
+
+/*** STATE ***/
+
+// the band-limited step buffer is only ever written up to a bound set by the sample rate,
+// entries past it stay zero so only the live part is saved
+
+#define APU_STATE_OFFSET offsetof(struct apu, dac.samples)
+
+static uint32_t apu_dac_live(struct dac *dac)
+{
+	uint64_t end = ((uint64_t) (dac->frame_samples + 2) * dac->factor + TIME_UNIT) >> TIME_BITS;
+
+	return end + 18 < 2048 ? (uint32_t) end + 18 : 2048;
+}
+
+size_t apu_state_size(struct apu *apu)
+{
+	return APU_STATE_OFFSET + sizeof(uint32_t) + 2 * apu_dac_live(&apu->dac) * sizeof(int32_t);
+}
+
+void apu_state_save(struct apu *apu, void *buf)
+{
+	uint8_t *b = buf;
+	uint32_t n = apu_dac_live(&apu->dac);
+
+	memcpy(b, apu, APU_STATE_OFFSET);
+	b += APU_STATE_OFFSET;
+
+	memcpy(b, &n, sizeof(uint32_t));
+	b += sizeof(uint32_t);
+
+	memcpy(b, apu->dac.samples[0], n * sizeof(int32_t));
+	memcpy(b + n * sizeof(int32_t), apu->dac.samples[1], n * sizeof(int32_t));
+}
+
+// a state saved at another sample rate carries a different number of live entries, anything
+// that couldn't have come from apu_state_save is turned away. the dac position is checked against
+// this instance's rate since the next block is mixed with it
+bool apu_state_valid(struct apu *apu, const void *buf, size_t size)
+{
+	const uint8_t *b = buf;
+
+	if (size < APU_STATE_OFFSET + sizeof(uint32_t))
+		return false;
+
+	uint32_t n, cycle, offset;
+	memcpy(&n, b + APU_STATE_OFFSET, sizeof(uint32_t));
+	memcpy(&cycle, b + offsetof(struct apu, dac.cycle), sizeof(uint32_t));
+	memcpy(&offset, b + offsetof(struct apu, dac.offset), sizeof(uint32_t));
+
+	if (n > 2048 || size != APU_STATE_OFFSET + sizeof(uint32_t) + 2 * (size_t) n * sizeof(int32_t))
+		return false;
+
+	uint64_t end = ((uint64_t) cycle * apu->dac.factor + offset) >> TIME_BITS;
+
+	return offset < TIME_UNIT && end + 18 <= 2048;
+}
+
+bool apu_state_load(struct apu *apu, const void *buf, size_t size)
+{
+	if (!apu_state_valid(apu, buf, size))
+		return false;
+
+	const uint8_t *b = buf;
+	uint32_t live = apu_dac_live(&apu->dac);
+
+	// output settings belong to the frontend, not the saved console
+	bool stereo = apu->dac.stereo;
+	uint32_t factor = apu->dac.factor;
+	uint32_t frame_samples = apu->dac.frame_samples;
+
+	memcpy(apu, b, APU_STATE_OFFSET);
+	b += APU_STATE_OFFSET;
+
+	apu->dac.stereo = stereo;
+	apu->dac.factor = factor;
+	apu->dac.frame_samples = frame_samples;
+
+	uint32_t n;
+	memcpy(&n, b, sizeof(uint32_t));
+	b += sizeof(uint32_t);
+
+	memcpy(apu->dac.samples[0], b, n * sizeof(int32_t));
+	memcpy(apu->dac.samples[1], b + n * sizeof(int32_t), n * sizeof(int32_t));
+
+	if (live > n) {
+		memset(apu->dac.samples[0] + n, 0, (live - n) * sizeof(int32_t));
+		memset(apu->dac.samples[1] + n, 0, (live - n) * sizeof(int32_t));
+	}
+
+	return true;
+}
+
+
 /*** INIT & DESTROY ***/
 
 void apu_set_stereo(struct apu *apu, bool stereo)
@@ -890,7 +1495,7 @@ void apu_init(struct apu **apu_out, uint32_t sample_rate, bool stereo)
 
 	apu_set_stereo(apu, stereo);
 	apu_set_sample_rate(apu, sample_rate);
-	apu_dac_init();
+	apu_dac_select_kernels(&apu->dac);
 }
 
 void apu_destroy(struct apu **apu_out)
@@ -13,7 +13,18 @@ uint8_t apu_read_status(struct apu *apu, struct cpu *cpu);
 void apu_write(struct apu *apu, struct nes *nes, struct cpu *cpu, uint16_t addr, uint8_t v);
 
 /*** RUN ***/
-void apu_step(struct apu *apu, struct nes *nes, struct cpu *cpu, SAMPLE_CALLBACK new_samples, void *opaque);
+void apu_run(struct apu *apu, struct nes *nes, struct cpu *cpu, uint32_t cycles, SAMPLE_CALLBACK new_samples, void *opaque);
+uint32_t apu_next_event(struct apu *apu, bool blocks);
+
+/*** STATE ***/
+size_t apu_state_size(struct apu *apu);
+void apu_state_save(struct apu *apu, void *buf);
+bool apu_state_valid(struct apu *apu, const void *buf, size_t size);
+bool apu_state_load(struct apu *apu, const void *buf, size_t size);
+
+/*** SELF TEST ***/
+// the vector dac kernels in use against the scalar ones, name lists the kernels that were compared
+bool apu_dac_check_kernels(const char **name);
 
 /*** INIT & DESTROY ***/
 void apu_set_stereo(struct apu *apu, bool stereo);
@@ -13,13 +13,26 @@
 #define PRG_SHIFT 12
 #define CHR_SHIFT 10
 
+#define PAGE_SHIFT 10
+#define PAGE_SIZE  0x0400
+
 #define ROM ROM_SPRITE
 
 struct memory {
 	uint8_t *data;
 	size_t size;
+	size_t used; //everything past the highest byte ever mapped is still zero
+
+	uint8_t *tiles;   //CHR only, 8 decoded rows of 8 pixels per 16 byte tile
+	uint8_t *decoded; //one flag per tile, set the first time it's fetched
 };
 
+static void memory_use(struct memory *mem, size_t offset, size_t len)
+{
+	if (offset + len > mem->used)
+		mem->used = offset + len;
+}
+
 struct map {
 	enum mem type;
 	uint8_t *ptr;
@@ -34,8 +47,22 @@ struct asset {
 	struct memory ciram;
 	size_t sram;
 	size_t wram;
+	uint8_t **pages;
 };
 
+static void map_update_pages(struct asset *asset, int32_t slot)
+{
+	// only PRG at $6000 and above is read directly through the cpu page table
+	if (!asset->pages || slot < (0x6000 >> PRG_SHIFT))
+		return;
+
+	uint8_t *ptr = asset->map[0][slot].ptr;
+	int32_t n = PRG_SLOT / PAGE_SIZE;
+
+	for (int32_t x = 0; x < n; x++)
+		asset->pages[slot * n + x] = ptr ? ptr + x * PAGE_SIZE : NULL;
+}
+
 static uint8_t map_read(struct asset *asset, uint8_t index, uint16_t addr, bool *hit)
 {
 	uint8_t *mapped_addr = asset->map[index][addr >> asset->shift].ptr;
@@ -60,6 +87,9 @@ static void map_write(struct asset *asset, uint8_t index, uint16_t addr, uint8_t
 static void map_unmap(struct asset *asset, uint8_t index, uint16_t addr)
 {
 	asset->map[index][addr >> asset->shift].ptr = NULL;
+
+	if (index == 0)
+		map_update_pages(asset, addr >> asset->shift);
 }
 
 static void cart_map(struct asset *asset, enum mem type, uint16_t addr, uint16_t bank, uint8_t bank_size_kb)
@@ -73,9 +103,16 @@ static void cart_map(struct asset *asset, enum mem type, uint16_t addr, uint16_t
 
 	for (int32_t x = start_slot, y = 0; x < end_slot; x++, y++) {
 		struct map *m = &asset->map[type & 0x0F][x];
+		size_t offset = (bank_offset + (y << asset->shift)) % mem->size;
 
-		m->ptr = mem->data + (bank_offset + (y << asset->shift)) % mem->size;
+		m->ptr = mem->data + offset;
 		m->type = type;
+
+		if (type & RAM)
+			memory_use(mem, offset, (size_t) 1 << asset->shift);
+
+		if ((type & 0x0F) == 0)
+			map_update_pages(asset, x);
 	}
 }
 
@@ -92,6 +129,7 @@ static void cart_map_ciram_buf(struct asset *asset, uint8_t dest, enum mem type,
 
 static void cart_map_ciram_slot(struct asset *asset, uint8_t dest, uint8_t src)
 {
+	memory_use(&asset->ciram, src * CHR_SLOT, CHR_SLOT);
 	cart_map_ciram_buf(asset, dest, CIRAM, asset->ciram.data + src * CHR_SLOT);
 }
 
@@ -117,14 +155,51 @@ static uint8_t cart_bus_conflict(struct asset *asset, uint16_t addr, uint8_t v)
 
 #define KB(b) ((b) / 0x0400)
 
+struct mapper {
+	uint16_t reg_low;
+	uint16_t reg_high;
+	uint8_t prg_size;
+	uint8_t chr_size;
+	uint8_t chr_slots;
+	uint16_t prg_addr;
+	uint8_t prg_mask;
+	uint8_t prg_shift;
+	uint8_t chr0_mask;
+	int8_t chr0_shift;
+	uint8_t chr1_mask;
+	int8_t chr1_shift;
+	bool chr_combine;
+	uint8_t mirror_table;
+	uint8_t mirror_mask;
+	uint8_t mirror_shift;
+};
+
+// hooks are bound once in cart_init, NULL hooks fall back to the default mapping or are skipped
+struct mapper_ops {
+	void (*init)(struct cart *cart);
+	uint8_t (*prg_read)(struct cart *cart, struct cpu *cpu, uint16_t addr, bool *mem_hit);
+	void (*prg_write)(struct cart *cart, struct cpu *cpu, uint16_t addr, uint8_t v);
+	uint8_t (*chr_read)(struct cart *cart, uint16_t addr, enum mem type, bool nt);
+	void (*ppu_a12_toggle)(struct cart *cart);
+	void (*ppu_write_hook)(struct cart *cart, uint16_t addr, uint8_t v);
+	void (*ppu_scanline_hook)(struct cart *cart, struct cpu *cpu, uint16_t scanline);
+	bool (*block_2007)(struct cart *cart);
+	void (*step)(struct cart *cart, struct cpu *cpu, uint64_t cycles);
+	uint64_t (*next_irq)(struct cart *cart);
+};
+
 struct cart {
+	const struct mapper_ops *ops;
+	struct nes *nes; //only used for logging
 	struct nes_header hdr;
 	struct asset prg;
 	struct asset chr;
+	struct mapper mapper;
 
 	size_t sram_dirty;
+	uint32_t crc32; //PRG and CHR ROM as loaded
 	uint64_t read_counter;
-	uint64_t cycle;
+	uint64_t cycle; //the next cpu cycle the cart has not been stepped through
 
 	bool ram_enable;
 	uint8_t prg_mode;
@@ -204,88 +279,28 @@ struct cart {
 
 /*** READ & WRITE ***/
 
-uint8_t cart_prg_read(struct cart *cart, struct cpu *cpu, uint16_t addr, bool *mem_hit)
+uint8_t cart_prg_read(struct cart *cart, struct cpu *cpu, uint64_t cycle, uint16_t addr, bool *mem_hit)
 {
-	switch (cart->hdr.mapper) {
-		case 5:  return mmc5_prg_read(cart, cpu, addr, mem_hit);
-		case 19: return namco_prg_read(cart, addr, mem_hit);
-		default:
-			return map_read(&cart->prg, 0, addr, mem_hit);
-	}
-}
+	cart_step(cart, cpu, cycle);
 
-void cart_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uint8_t v)
-{
-	switch (cart->hdr.mapper) {
-		case 1:  mmc1_prg_write(cart, addr, v);       break;
-		case 4:  mmc3_prg_write(cart, cpu, addr, v);  break;
-		case 5:  mmc5_prg_write(cart, addr, v);       break;
-		case 9:  mmc2_prg_write(cart, addr, v);       break;
-		case 10: mmc2_prg_write(cart, addr, v);       break;
-		case 19: namco_prg_write(cart, cpu, addr, v); break;
-		case 21: vrc_prg_write(cart, cpu, addr, v);   break;
-		case 22: vrc_prg_write(cart, cpu, addr, v);   break;
-		case 24: vrc6_prg_write(cart, cpu, addr, v);  break;
-		case 26: vrc6_prg_write(cart, cpu, addr, v);  break;
-		case 23: vrc_prg_write(cart, cpu, addr, v);   break;
-		case 25: vrc_prg_write(cart, cpu, addr, v);   break;
-		case 69: fme7_prg_write(cart, cpu, addr, v);  break;
-		case 85: vrc7_prg_write(cart, cpu, addr, v);  break;
-		case 16:
-		case 159: fcg_prg_write(cart, cpu, addr, v);  break;
-		case 0:
-		case 2:
-		case 3:
-		case 7:
-		case 11:
-		case 13:
-		case 30:
-		case 31:
-		case 34:
-		case 38:
-		case 66:
-		case 70:
-		case 71:
-		case 77:
-		case 78:
-		case 79:
-		case 87:
-		case 89:
-		case 93:
-		case 94:
-		case 97:
-		case 101:
-		case 107:
-		case 111:
-		case 113:
-		case 140:
-		case 145:
-		case 146:
-		case 148:
-		case 149:
-		case 152:
-		case 180:
-		case 184:
-		case 185: mapper_prg_write(cart, addr, v);   break;
-	}
+	if (cart->ops->prg_read)
+		return cart->ops->prg_read(cart, cpu, addr, mem_hit);
+
+	return map_read(&cart->prg, 0, addr, mem_hit);
 }
 
-uint8_t cart_chr_read(struct cart *cart, uint16_t addr, enum mem type, bool nt)
+void cart_prg_write(struct cart *cart, struct cpu *cpu, uint64_t cycle, uint16_t addr, uint8_t v)
 {
-	bool chr = addr < 0x2000;
+	cart_step(cart, cpu, cycle);
 
-	if (chr) {
-		switch (cart->hdr.mapper) {
-			case 5:  return mmc5_chr_read(cart, addr, type);
-			case 9:
-			case 10: mmc2_chr_read(cart, addr); break;
-		}
+	if (cart->ops->prg_write)
+		cart->ops->prg_write(cart, cpu, addr, v);
+}
 
-	} else {
-		switch (cart->hdr.mapper) {
-			case 5: return mmc5_nt_read_hook(cart, addr, type, nt);
-		}
-	}
+uint8_t cart_chr_read(struct cart *cart, uint16_t addr, enum mem type, bool nt)
+{
+	if (cart->ops->chr_read)
+		return cart->ops->chr_read(cart, addr, type, nt);
 
 	return map_read(&cart->chr, 0, addr, NULL);
 }
@@ -293,6 +308,72 @@ uint8_t cart_chr_read(struct cart *cart, uint16_t addr, enum mem type, bool nt)
 void cart_chr_write(struct cart *cart, uint16_t addr, uint8_t v)
 {
 	map_write(&cart->chr, 0, addr, v);
+
+	struct map *m = &cart->chr.map[0][addr >> CHR_SHIFT];
+
+	if (m->ptr && m->type == RAM && cart->chr.ram.decoded) {
+		size_t offset = (size_t) (m->ptr - cart->chr.ram.data) + (addr & cart->chr.mask);
+		cart->chr.ram.decoded[offset >> 4] = 0;
+	}
+}
+
+
+/*** TILE CACHE ***/
+
+// pattern rows are decoded once into one 2-bit pixel per byte, left to right. tiles are keyed by
+// their place in CHR ROM/RAM rather than the address they're fetched from, so bank switches need
+// nothing and only CHR RAM writes drop a tile. the cache is 4x the size of the CHR it covers, so
+// it's only allocated on the first fetch that uses it
+
+static void memory_alloc_tiles(struct memory *mem)
+{
+	mem->tiles = calloc(mem->size * 4, 1);
+	mem->decoded = calloc(mem->size / 16, 1);
+}
+
+static void memory_decode_tile(struct memory *mem, size_t tile)
+{
+	const uint8_t *src = mem->data + tile * 16;
+	uint8_t *dst = mem->tiles + tile * 64;
+
+	for (uint8_t y = 0; y < 8; y++)
+		for (uint8_t x = 0; x < 8; x++)
+			dst[y * 8 + x] = (((src[y + 8] >> (7 - x)) & 0x01) << 1) | ((src[y] >> (7 - x)) & 0x01);
+
+	mem->decoded[tile] = 1;
+}
+
+const uint8_t *cart_chr_row(struct cart *cart, uint16_t addr)
+{
+	// mappers that watch or redirect pattern reads have to see every one
+	if (cart->ops->chr_read)
+		return NULL;
+
+	struct map *m = &cart->chr.map[0][addr >> CHR_SHIFT];
+
+	if (!m->ptr || (m->type & CIRAM) == CIRAM)
+		return NULL;
+
+	struct memory *mem = (m->type & RAM) ? &cart->chr.ram : &cart->chr.rom;
+	size_t offset = (size_t) (m->ptr - mem->data) + (addr & cart->chr.mask);
+	size_t tile = offset >> 4;
+
+	if (!mem->decoded)
+		memory_alloc_tiles(mem);
+
+	if (!mem->decoded[tile])
+		memory_decode_tile(mem, tile);
+
+	return mem->tiles + tile * 64 + (offset & 0x07) * 8;
+}
+
+
+void cart_map_pages(struct cart *cart, uint8_t **pages)
+{
+	cart->prg.pages = pages;
+
+	for (int32_t x = 0; x < 16; x++)
+		map_update_pages(&cart->prg, x);
 }
 
 
@@ -300,35 +381,49 @@ void cart_chr_write(struct cart *cart, uint16_t addr, uint8_t v)
 
 void cart_ppu_a12_toggle(struct cart *cart)
 {
-	switch (cart->hdr.mapper) {
-		case 4: mmc3_ppu_a12_toggle(cart);
-	}
+	if (cart->ops->ppu_a12_toggle)
+		cart->ops->ppu_a12_toggle(cart);
 }
 
 void cart_ppu_write_hook(struct cart *cart, uint16_t addr, uint8_t v)
 {
-	switch (cart->hdr.mapper) {
-		case 5: mmc5_ppu_write_hook(cart, addr, v); break;
-	}
+	if (cart->ops->ppu_write_hook)
+		cart->ops->ppu_write_hook(cart, addr, v);
 }
 
 void cart_ppu_scanline_hook(struct cart *cart, struct cpu *cpu, uint16_t scanline)
 {
-	switch (cart->hdr.mapper) {
-		case 5: mmc5_scanline(cart, cpu, scanline); break;
-	}
+	if (cart->ops->ppu_scanline_hook)
+		cart->ops->ppu_scanline_hook(cart, cpu, scanline);
+}
+
+bool cart_has_a12_hook(struct cart *cart)
+{
+	return cart->ops->ppu_a12_toggle != NULL;
+}
+
+bool cart_has_scanline_hook(struct cart *cart)
+{
+	return cart->ops->ppu_scanline_hook != NULL;
 }
 
 bool cart_block_2007(struct cart *cart)
 {
-	switch (cart->hdr.mapper) {
-		case 185: return mapper_block_2007(cart);
-	}
+	if (cart->ops->block_2007)
+		return cart->ops->block_2007(cart);
 
 	return false;
 }
 
 
+/*** STATE ***/
+
+uint32_t cart_rom_crc32(struct cart *cart)
+{
+	return cart->crc32;
+}
+
+
 /*** SRAM ***/
 
 size_t cart_sram_dirty(struct cart *cart)
@@ -350,28 +445,286 @@ void cart_sram_get(struct cart *cart, uint8_t *buf, size_t size)
 
 /*** RUN ***/
 
-void cart_step(struct cart *cart, struct cpu *cpu)
-{
-	switch (cart->hdr.mapper) {
-		case 4:  mmc3_step(cart, cpu);  break;
-		case 19: namco_step(cart, cpu); break;
-		case 21: vrc_step(cart, cpu);   break;
-		case 23: vrc_step(cart, cpu);   break;
-		case 24: vrc_step(cart, cpu);   break;
-		case 26: vrc_step(cart, cpu);   break;
-		case 25: vrc_step(cart, cpu);   break;
-		case 69: fme7_step(cart, cpu);  break;
-		case 85: vrc_step(cart, cpu);   break;
-		case 16:
-		case 159: fcg_step(cart, cpu);  break;
+// mapper counters are only run when they can be observed, nes schedules a call to cart_step
+// for the cycle returned by cart_next_irq
+
+void cart_step(struct cart *cart, struct cpu *cpu, uint64_t cycle)
+{
+	if (cycle <= cart->cycle)
+		return;
+
+	if (cart->ops->step)
+		cart->ops->step(cart, cpu, cycle - cart->cycle);
+
+	cart->cycle = cycle;
+}
+
+uint64_t cart_next_irq(struct cart *cart)
+{
+	uint64_t n = cart->ops->next_irq ? cart->ops->next_irq(cart) : 0;
+
+	return n > 0 ? cart->cycle + n - 1 : UINT64_MAX;
+}
+
+void cart_set_cycle(struct cart *cart, uint64_t cycle)
+{
+	cart->cycle = cycle;
+}
+
+
+/*** STATE ***/
+
+// the cart struct is saved whole with its pointers fixed up on load, bank maps are stored as
+// a region and offset, then the used part of each RAM region follows, ROM is never saved
+
+#define REF_SHIFT 24
+#define REF_MASK  0x00FFFFFF
+
+enum ref_region {
+	REF_NULL  = 0,
+	REF_ROM   = 1,
+	REF_RAM   = 2,
+	REF_CIRAM = 3,
+	REF_EXRAM = 4,
+};
+
+static uint32_t cart_map_ref(struct cart *cart, struct asset *asset, uint8_t *ptr)
+{
+	if (!ptr)
+		return REF_NULL;
+
+	struct memory *mem[3] = {&asset->rom, &asset->ram, &asset->ciram};
+
+	for (uint8_t x = 0; x < 3; x++)
+		if (mem[x]->data && ptr >= mem[x]->data && ptr < mem[x]->data + mem[x]->size)
+			return (uint32_t) (REF_ROM + x) << REF_SHIFT | (uint32_t) (ptr - mem[x]->data);
+
+	if (ptr >= cart->mmc5.exram && ptr < cart->mmc5.exram + sizeof(cart->mmc5.exram))
+		return (uint32_t) REF_EXRAM << REF_SHIFT | (uint32_t) (ptr - cart->mmc5.exram);
+
+	assert(!"Bank map points outside of the cart");
+	return REF_NULL;
+}
+
+// a slot reads up to its own size past the pointer, or the whole region when that is smaller
+static bool cart_map_ref_valid(struct cart *cart, struct asset *asset, uint32_t ref)
+{
+	size_t offset = ref & REF_MASK;
+	size_t size = 0;
+
+	switch (ref >> REF_SHIFT) {
+		case REF_NULL:  return offset == 0;
+		case REF_ROM:   size = asset->rom.size; break;
+		case REF_RAM:   size = asset->ram.size; break;
+		case REF_CIRAM: size = asset->ciram.size; break;
+		case REF_EXRAM: size = sizeof(cart->mmc5.exram); break;
+		default:        return false;
 	}
 
-	cart->cycle++;
+	size_t slot = (size_t) 1 << asset->shift;
+
+	return offset < size && offset + (slot < size ? slot : size) <= size;
+}
+
+static uint8_t *cart_map_deref(struct cart *cart, struct asset *asset, uint32_t ref)
+{
+	uint32_t offset = ref & REF_MASK;
+
+	switch (ref >> REF_SHIFT) {
+		case REF_ROM:   return asset->rom.data + offset;
+		case REF_RAM:   return asset->ram.data + offset;
+		case REF_CIRAM: return asset->ciram.data + offset;
+		case REF_EXRAM: return cart->mmc5.exram + offset;
+	}
+
+	return NULL;
+}
+
+size_t cart_state_size(struct cart *cart)
+{
+	return sizeof(struct cart) + 2 * sizeof(uint32_t[2][16]) +
+		cart->prg.ram.used + cart->chr.ram.used + cart->chr.ciram.used;
+}
+
+void cart_state_save(struct cart *cart, void *buf)
+{
+	uint8_t *b = buf;
+
+	// pointers are rebound from the live cart on load, leave them out so identical carts save identically
+	struct cart *saved = (struct cart *) b;
+	memcpy(saved, cart, sizeof(struct cart));
+	saved->ops = NULL;
+	saved->nes = NULL;
+
+	for (uint8_t x = 0; x < 2; x++) {
+		struct asset *asset = x == 0 ? &saved->prg : &saved->chr;
+		struct memory *mem[3] = {&asset->rom, &asset->ram, &asset->ciram};
+
+		for (uint8_t y = 0; y < 3; y++) {
+			mem[y]->data = NULL;
+			mem[y]->tiles = NULL;
+			mem[y]->decoded = NULL;
+		}
+
+		for (uint8_t y = 0; y < 2; y++)
+			for (uint8_t z = 0; z < 16; z++)
+				asset->map[y][z].ptr = NULL;
+
+		asset->pages = NULL;
+	}
+
+	b += sizeof(struct cart);
+
+	struct asset *assets[2] = {&cart->prg, &cart->chr};
+
+	for (uint8_t x = 0; x < 2; x++) {
+		uint32_t refs[2][16];
+
+		for (uint8_t y = 0; y < 2; y++)
+			for (uint8_t z = 0; z < 16; z++)
+				refs[y][z] = cart_map_ref(cart, assets[x], assets[x]->map[y][z].ptr);
+
+		memcpy(b, refs, sizeof(refs));
+		b += sizeof(refs);
+	}
+
+	struct memory *mem[3] = {&cart->prg.ram, &cart->chr.ram, &cart->chr.ciram};
+
+	for (uint8_t x = 0; x < 3; x++) {
+		memcpy(b, mem[x]->data, mem[x]->used);
+		b += mem[x]->used;
+	}
+}
+
+bool cart_state_load(struct cart *cart, const void *buf, size_t size)
+{
+	const uint8_t *b = buf;
+	struct cart live = *cart;
+
+	if (size < sizeof(struct cart) + 2 * sizeof(uint32_t[2][16]))
+		return false;
+
+	memcpy(cart, b, sizeof(struct cart));
+	b += sizeof(struct cart);
+
+	// nes_state_load has matched the ROM checksum, the geometry everything below indexes by is
+	// still checked before any of it is used
+	bool valid = cart->hdr.mapper == live.hdr.mapper && cart->hdr.prg == live.hdr.prg &&
+		cart->hdr.chr == live.hdr.chr && cart->prg.ram.size == live.prg.ram.size &&
+		cart->chr.ram.size == live.chr.ram.size && cart->chr.ciram.size == live.chr.ciram.size &&
+		cart->prg.shift == live.prg.shift && cart->chr.shift == live.chr.shift &&
+		cart->prg.mask == live.prg.mask && cart->chr.mask == live.chr.mask;
+
+	// sizes describe the loaded ROM and its allocations, not the console
+	for (uint8_t x = 0; x < 2; x++) {
+		struct asset *asset = x == 0 ? &cart->prg : &cart->chr;
+		struct asset *live_asset = x == 0 ? &live.prg : &live.chr;
+
+		asset->rom.size = live_asset->rom.size;
+		asset->sram = live_asset->sram;
+		asset->wram = live_asset->wram;
+	}
+
+	struct asset *assets[2] = {&cart->prg, &cart->chr};
+	size_t total = sizeof(struct cart) + 2 * sizeof(uint32_t[2][16]);
+
+	for (uint8_t x = 0; x < 2 && valid; x++) {
+		uint32_t refs[2][16];
+		memcpy(refs, b + x * sizeof(refs), sizeof(refs));
+
+		for (uint8_t y = 0; y < 2; y++)
+			for (uint8_t z = 0; z < 16; z++)
+				valid = valid && cart_map_ref_valid(cart, assets[x], refs[y][z]);
+	}
+
+	struct memory *mem[3] = {&cart->prg.ram, &cart->chr.ram, &cart->chr.ciram};
+
+	for (uint8_t x = 0; x < 3 && valid; x++) {
+		valid = mem[x]->used <= mem[x]->size;
+		total += mem[x]->used;
+	}
+
+	if (!valid || total != size) {
+		*cart = live;
+		return false;
+	}
+
+	cart->ops = live.ops;
+	cart->nes = live.nes;
+	cart->hdr = live.hdr;
+	cart->sram_dirty = live.sram_dirty;
+	cart->crc32 = live.crc32;
+
+	struct asset *live_assets[2] = {&live.prg, &live.chr};
+
+	for (uint8_t x = 0; x < 2; x++) {
+		struct asset *asset = assets[x];
+		uint32_t refs[2][16];
+
+		asset->rom.data = live_assets[x]->rom.data;
+		asset->ram.data = live_assets[x]->ram.data;
+		asset->ciram.data = live_assets[x]->ciram.data;
+		asset->rom.tiles = live_assets[x]->rom.tiles;
+		asset->rom.decoded = live_assets[x]->rom.decoded;
+		asset->ram.tiles = live_assets[x]->ram.tiles;
+		asset->ram.decoded = live_assets[x]->ram.decoded;
+		asset->pages = live_assets[x]->pages;
+
+		memcpy(refs, b, sizeof(refs));
+		b += sizeof(refs);
+
+		for (uint8_t y = 0; y < 2; y++)
+			for (uint8_t z = 0; z < 16; z++)
+				asset->map[y][z].ptr = cart_map_deref(cart, asset, refs[y][z]);
+	}
+
+	for (int32_t x = 0; x < 16; x++)
+		map_update_pages(&cart->prg, x);
+
+	// CHR RAM contents are replaced, decode them again as they're fetched
+	if (cart->chr.ram.decoded)
+		memset(cart->chr.ram.decoded, 0, cart->chr.ram.size / 16);
+
+	// whatever was mapped after the save goes back to zero
+	size_t live_used[3] = {live.prg.ram.used, live.chr.ram.used, live.chr.ciram.used};
+
+	for (uint8_t x = 0; x < 3; x++) {
+		size_t used = mem[x]->used;
+
+		memcpy(mem[x]->data, b, used);
+		b += used;
+
+		if (live_used[x] > used) {
+			memset(mem[x]->data + used, 0, live_used[x] - used);
+			mem[x]->used = live_used[x];
+		}
+	}
+
+	return true;
 }
 
 
 /*** INIT & DESTROY ***/
 
+static uint32_t cart_crc32(uint32_t crc, const uint8_t *data, size_t n_bytes)
+{
+	uint32_t table[0x100];
+
+	for (uint32_t x = 0; x < 0x100; x++) {
+		uint32_t r = x;
+
+		for (uint8_t y = 0; y < 8; y++)
+			r = (r & 1 ? 0 : 0xEDB88320) ^ r >> 1;
+
+		table[x] = r ^ 0xFF000000;
+	}
+
+	for (size_t x = 0; x < n_bytes; x++)
+		crc = table[(uint8_t) crc ^ data[x]] ^ crc >> 8;
+
+	return crc;
+}
+
 static void cart_parse_header(uint8_t *rom, struct nes_header *hdr)
 {
 	if (rom[0] == 'U' && rom[1] == 'N' && rom[2] == 'I' && rom[3] == 'F')
@@ -414,35 +767,97 @@ static void cart_parse_header(uint8_t *rom, struct nes_header *hdr)
 	}
 }
 
-static void cart_log_header(struct nes_header *hdr)
+static void cart_log_header(struct nes *nes, struct nes_header *hdr)
 {
-	nes_log("Mapper: %u", hdr->mapper);
-	nes_log("PRG Size: %uKB", KB(hdr->prg * 0x4000));
-	nes_log("CHR Size: %uKB", KB(hdr->chr * 0x2000));
-	nes_log("Mirroring: %s", hdr->mirroring == MIRROR_VERTICAL ? "Vertical" :
+	nes_log(nes, "Mapper: %u", hdr->mapper);
+	nes_log(nes, "PRG Size: %uKB", KB(hdr->prg * 0x4000));
+	nes_log(nes, "CHR Size: %uKB", KB(hdr->chr * 0x2000));
+	nes_log(nes, "Mirroring: %s", hdr->mirroring == MIRROR_VERTICAL ? "Vertical" :
 		hdr->mirroring == MIRROR_HORIZONTAL ? "Horizontal" : "Four Screen");
-	nes_log("Trainer: %s", hdr->trainer ? "true" : "false");
-	nes_log("PRG RAM Battery: %s", hdr->battery ? "true" : "false");
+	nes_log(nes, "Trainer: %s", hdr->trainer ? "true" : "false");
+	nes_log(nes, "PRG RAM Battery: %s", hdr->battery ? "true" : "false");
 
 	if (hdr->has_nes2) {
-		nes_log("NES 2.0 Submapper: %x", hdr->nes2.submapper);
-		nes_log("NES 2.0 PRG RAM (volatile): %uKB", KB(hdr->nes2.prg_wram));
-		nes_log("NES 2.0 PRG RAM (non-volatile): %uKB", KB(hdr->nes2.prg_sram));
-		nes_log("NES 2.0 CHR RAM (volatile): %uKB", KB(hdr->nes2.chr_wram));
-		nes_log("NES 2.0 CHR RAM (non-volatile): %uKB", KB(hdr->nes2.chr_sram));
+		nes_log(nes, "NES 2.0 Submapper: %x", hdr->nes2.submapper);
+		nes_log(nes, "NES 2.0 PRG RAM (volatile): %uKB", KB(hdr->nes2.prg_wram));
+		nes_log(nes, "NES 2.0 PRG RAM (non-volatile): %uKB", KB(hdr->nes2.prg_sram));
+		nes_log(nes, "NES 2.0 CHR RAM (volatile): %uKB", KB(hdr->nes2.chr_wram));
+		nes_log(nes, "NES 2.0 CHR RAM (non-volatile): %uKB", KB(hdr->nes2.chr_sram));
 	}
 }
 
-void cart_init(struct cart **cart_out, uint8_t *rom, size_t rom_len,
+static const struct mapper_ops *cart_mapper_ops(uint16_t mapper)
+{
+	switch (mapper) {
+		case 1:   return &MMC1;
+		case 4:   return &MMC3;
+		case 5:   return &MMC5;
+		case 9:
+		case 10:  return &MMC2;
+		case 19:  return &NAMCO;
+		case 21:
+		case 23:
+		case 25:  return &VRC2_4;
+		case 22:  return &VRC22;
+		case 24:
+		case 26:  return &VRC6;
+		case 69:  return &FME7;
+		case 85:  return &VRC7;
+		case 16:
+		case 159: return &FCG;
+		case 185: return &MAPPER_185;
+		case 0:
+		case 2:
+		case 3:
+		case 7:
+		case 11:
+		case 13:
+		case 30:
+		case 31:
+		case 34:
+		case 38:
+		case 66:
+		case 70:
+		case 71:
+		case 77:
+		case 78:
+		case 79:
+		case 87:
+		case 89:
+		case 93:
+		case 94:
+		case 97:
+		case 101:
+		case 107:
+		case 111:
+		case 113:
+		case 140:
+		case 145:
+		case 146:
+		case 148:
+		case 149:
+		case 152:
+		case 180:
+		case 184: return &MAPPER;
+	}
+
+	return NULL;
+}
+
+// unsupported mappers keep the fixed 32K PRG and 8K CHR mapping cart_init starts with
+static const struct mapper_ops NROM = {0};
+
+void cart_init(struct cart **cart_out, struct nes *nes, uint8_t *rom, size_t rom_len,
 	uint8_t *sram, size_t sram_len, struct nes_header *hdr)
 {
 	struct cart *cart = *cart_out = calloc(1, sizeof(struct cart));
+	cart->nes = nes;
 	cart->prg.mask = PRG_SLOT - 1;
 	cart->chr.mask = CHR_SLOT - 1;
 	cart->prg.shift = PRG_SHIFT;
 	cart->chr.shift = CHR_SHIFT;
 
-	nes_log("ROM size: %uKB", rom_len / 0x0400);
+	nes_log(nes, "ROM size: %uKB", rom_len / 0x0400);
 
 	if (sram_len > 0x2000)
 		assert(!"SRAM is lager than 8K");
@@ -457,7 +872,7 @@ void cart_init(struct cart **cart_out, uint8_t *rom, size_t rom_len,
 		cart_parse_header(rom, &cart->hdr);
 	}
 
-	cart_log_header(&cart->hdr);
+	cart_log_header(nes, &cart->hdr);
 
 	cart->prg.rom.size = cart->hdr.prg * 0x4000;
 	cart->chr.rom.size = cart->hdr.chr * 0x2000;
@@ -484,11 +899,14 @@ void cart_init(struct cart **cart_out, uint8_t *rom, size_t rom_len,
 		assert(!"ROM is not large enough to support PRG ROM size in iNES header");
 
 	cart->prg.ram.data = calloc(cart->prg.ram.size, 1);
-	if (sram && sram_len > 0)
+	if (sram && sram_len > 0) {
 		memcpy(cart->prg.ram.data, sram, sram_len);
+		memory_use(&cart->prg.ram, 0, sram_len);
+	}
 
 	cart->prg.rom.data = calloc(cart->prg.rom.size, 1);
 	memcpy(cart->prg.rom.data, rom + cart->hdr.offset + trainer, cart->prg.rom.size);
+	cart->crc32 = cart_crc32(0, cart->prg.rom.data, cart->prg.rom.size);
 	cart_map(&cart->prg, ROM, 0x8000, 0, 32);
 
 	cart->chr.ram.data = calloc(cart->chr.ram.size, 1);
@@ -506,65 +924,19 @@ void cart_init(struct cart **cart_out, uint8_t *rom, size_t rom_len,
 
 		cart->chr.rom.data = calloc(chr_len, 1);
 		memcpy(cart->chr.rom.data, rom + cart->hdr.offset + trainer + cart->prg.rom.size, chr_len);
+		cart->crc32 = cart_crc32(cart->crc32, cart->chr.rom.data, chr_len);
 	}
 	cart_map(&cart->chr, cart->chr.rom.size > 0 ? ROM : RAM, 0x0000, 0, 8);
 
-	switch (cart->hdr.mapper) {
-		case 1:   mmc1_init(cart);    break;
-		case 4:   mmc3_init(cart);    break;
-		case 5:   mmc5_init(cart);    break;
-		case 9:   mmc2_init(cart);    break;
-		case 10:  mmc2_init(cart);    break;
-		case 19:  namco_init(cart);   break;
-		case 21:  vrc2_4_init(cart);  break;
-		case 22:  vrc2_4_init(cart);  break;
-		case 24:  vrc_init(cart);     break;
-		case 26:  vrc_init(cart);     break;
-		case 23:  vrc2_4_init(cart);  break;
-		case 25:  vrc2_4_init(cart);  break;
-		case 69:  fme7_init(cart);    break;
-		case 85:  vrc_init(cart);     break;
-		case 16:
-		case 159: fcg_init(cart);     break;
-		case 0:
-		case 2:
-		case 3:
-		case 7:
-		case 11:
-		case 13:
-		case 30:
-		case 31:
-		case 34:
-		case 38:
-		case 66:
-		case 70:
-		case 71:
-		case 77:
-		case 78:
-		case 79:
-		case 87:
-		case 89:
-		case 93:
-		case 94:
-		case 97:
-		case 101:
-		case 107:
-		case 111:
-		case 113:
-		case 140:
-		case 145:
-		case 146:
-		case 148:
-		case 149:
-		case 152:
-		case 180:
-		case 184:
-		case 185: mapper_init(cart);  break;
+	cart->ops = cart_mapper_ops(cart->hdr.mapper);
 
-		default:
-			assert(!"Unsupported mapper");
-			break;
+	if (!cart->ops) {
+		nes_log(nes, "Unsupported mapper %u, running as NROM", cart->hdr.mapper);
+		cart->ops = &NROM;
 	}
+
+	if (cart->ops->init)
+		cart->ops->init(cart);
 }
 
 void cart_destroy(struct cart **cart_out)
@@ -578,6 +950,10 @@ void cart_destroy(struct cart **cart_out)
 	free(cart->chr.rom.data);
 	free(cart->chr.ram.data);
 	free(cart->chr.ciram.data);
+	free(cart->chr.rom.tiles);
+	free(cart->chr.rom.decoded);
+	free(cart->chr.ram.tiles);
+	free(cart->chr.ram.decoded);
 
 	free(*cart_out);
 	*cart_out = NULL;
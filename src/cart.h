@@ -8,25 +8,40 @@
 struct cart;
 
 /*** READ & WRITE ***/
-uint8_t cart_prg_read(struct cart *cart, struct cpu *cpu, uint16_t addr, bool *mem_hit);
-void cart_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uint8_t v);
+uint8_t cart_prg_read(struct cart *cart, struct cpu *cpu, uint64_t cycle, uint16_t addr, bool *mem_hit);
+void cart_prg_write(struct cart *cart, struct cpu *cpu, uint64_t cycle, uint16_t addr, uint8_t v);
 uint8_t cart_chr_read(struct cart *cart, uint16_t addr, enum mem type, bool nt);
 void cart_chr_write(struct cart *cart, uint16_t addr, uint8_t v);
+void cart_map_pages(struct cart *cart, uint8_t **pages);
+
+/*** TILE CACHE ***/
+// the decoded pattern row at addr as 8 pixels 0-3, NULL when the fetch has to go through the mapper
+const uint8_t *cart_chr_row(struct cart *cart, uint16_t addr);
 
 /*** HOOKS ***/
 void cart_ppu_a12_toggle(struct cart *cart);
 void cart_ppu_write_hook(struct cart *cart, uint16_t addr, uint8_t v);
 void cart_ppu_scanline_hook(struct cart *cart, struct cpu *cpu, uint16_t scanline);
+bool cart_has_a12_hook(struct cart *cart);
+bool cart_has_scanline_hook(struct cart *cart);
 bool cart_block_2007(struct cart *cart);
 
 /*** RUN ***/
-void cart_step(struct cart *cart, struct cpu *cpu);
+void cart_step(struct cart *cart, struct cpu *cpu, uint64_t cycle);
+uint64_t cart_next_irq(struct cart *cart);
+void cart_set_cycle(struct cart *cart, uint64_t cycle);
+
+/*** STATE ***/
+size_t cart_state_size(struct cart *cart);
+void cart_state_save(struct cart *cart, void *buf);
+bool cart_state_load(struct cart *cart, const void *buf, size_t size);
+uint32_t cart_rom_crc32(struct cart *cart);
 
 /*** SRAM ***/
 size_t cart_sram_dirty(struct cart *cart);
 void cart_sram_get(struct cart *cart, uint8_t *buf, size_t size);
 
 /*** INIT & DESTROY ***/
-void cart_init(struct cart **cart_out, uint8_t *rom, size_t rom_len,
+void cart_init(struct cart **cart_out, struct nes *nes, uint8_t *rom, size_t rom_len,
 	uint8_t *sram, size_t sram_len, struct nes_header *hdr);
 void cart_destroy(struct cart **cart_out);
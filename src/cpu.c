@@ -1,6 +1,7 @@
 #include "cpu.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 enum cpu_flags {
@@ -14,26 +15,23 @@ enum cpu_flags {
 	FLAG_N = 0x80, // negative
 };
 
+#if defined(_MSC_VER)
+	#define CPU_INLINE __forceinline
+#else
+	#define CPU_INLINE inline __attribute__((always_inline))
+#endif
+
 enum irq_vector {
 	NMI_VECTOR   = 0xFFFA,
 	RESET_VECTOR = 0xFFFC,
 	BRK_VECTOR   = 0xFFFE,
 };
 
-struct opcode {
-	const char *name;
-	int32_t mode;
-	int32_t lookup;
-	int32_t io_mode;
-};
-
 struct cpu {
 	bool NMI;
 	enum irq IRQ;
 	bool irq_pending;
 
-	struct opcode OP[0x100];
-
 	uint16_t PC; // program counter
 	uint8_t SP;  // stack pointer
 	uint8_t A;   // accumulator
@@ -107,7 +105,7 @@ static uint16_t cpu_read16(struct cpu *cpu, struct nes *nes, uint16_t addr)
 	return h | l;
 }
 
-static void cpu_indexed_dummy_read(struct cpu *cpu, struct nes *nes, enum io_mode io_mode, bool pagex, uint16_t addr)
+static CPU_INLINE void cpu_indexed_dummy_read(struct cpu *cpu, struct nes *nes, enum io_mode io_mode, bool pagex, uint16_t addr)
 {
 	if (io_mode == IO_RMW || io_mode == IO_W) {
 		cpu_read(cpu, nes, pagex ? addr - 0x0100 : addr);
@@ -117,7 +115,7 @@ static void cpu_indexed_dummy_read(struct cpu *cpu, struct nes *nes, enum io_mod
 	}
 }
 
-static uint16_t cpu_opcode_address(struct cpu *cpu, struct nes *nes,
+static CPU_INLINE uint16_t cpu_opcode_address(struct cpu *cpu, struct nes *nes,
 	enum address_mode mode, enum io_mode io_mode, bool *pagex)
 {
 	uint16_t addr = 0;
@@ -215,318 +213,323 @@ enum opcode_name {
 
 	// UNOFFICIAL
 	DOP, AAC, ASR, ARR, ATX, AXS, SLO, RLA, SRE, RRA, AAX, LAX,
-	DCP, ISC, TOP, SYA, SXA, XAA, AXA, LAR, XAS,
+	DCP, ISC, TOP, SYA, SXA, XAA, AXA, LAR, XAS, KIL,
 };
 
-#define SET_OP(_table, _code, _name, _mode, _io) \
-	(_table)[(_code)].name        = #_name;      \
-	(_table)[(_code)].lookup      = (_name);     \
-	(_table)[(_code)].mode        = (_mode);     \
-	(_table)[(_code)].io_mode     = (_io)
-
-static void cpu_fill_op_table(struct opcode *OP)
-{
-	// http://nesdev.com/6502_cpu.txt -- the best reference
-	// http://www.obelisk.me.uk/6502/reference.html
-
-	SET_OP(OP, 0xA9, LDA, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xA5, LDA, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xB5, LDA, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0xAD, LDA, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0xBD, LDA, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0xB9, LDA, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0xA1, LDA, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0xB1, LDA, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0xA2, LDX, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xA6, LDX, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xB6, LDX, MODE_ZERO_PAGE_Y, IO_R);
-	SET_OP(OP, 0xAE, LDX, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0xBE, LDX, MODE_ABSOLUTE_Y,  IO_R);
-
-	SET_OP(OP, 0xA0, LDY, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xA4, LDY, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xB4, LDY, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0xAC, LDY, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0xBC, LDY, MODE_ABSOLUTE_X,  IO_R);
-
-	SET_OP(OP, 0x29, AND, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x25, AND, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x35, AND, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0x2D, AND, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0x3D, AND, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0x39, AND, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0x21, AND, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0x31, AND, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0x49, EOR, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x45, EOR, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x55, EOR, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0x4D, EOR, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0x5D, EOR, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0x59, EOR, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0x41, EOR, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0x51, EOR, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0xC9, CMP, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xC5, CMP, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xD5, CMP, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0xCD, CMP, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0xDD, CMP, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0xD9, CMP, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0xC1, CMP, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0xD1, CMP, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0xC0, CPY, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xC4, CPY, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xCC, CPY, MODE_ABSOLUTE,    IO_R);
-
-	SET_OP(OP, 0xE0, CPX, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xE4, CPX, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xEC, CPX, MODE_ABSOLUTE,    IO_R);
-
-	SET_OP(OP, 0x69, ADC, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x65, ADC, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x75, ADC, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0x6D, ADC, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0x7D, ADC, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0x79, ADC, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0x61, ADC, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0x71, ADC, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0xE9, SBC, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xE5, SBC, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xF5, SBC, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0xED, SBC, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0xFD, SBC, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0xF9, SBC, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0xE1, SBC, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0xF1, SBC, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0x09, ORA, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x05, ORA, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x15, ORA, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0x0D, ORA, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0x1D, ORA, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0x19, ORA, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0x01, ORA, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0x11, ORA, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0x24, BIT, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x2C, BIT, MODE_ABSOLUTE,    IO_R);
-
-	SET_OP(OP, 0x85, STA, MODE_ZERO_PAGE,   IO_W);
-	SET_OP(OP, 0x95, STA, MODE_ZERO_PAGE_X, IO_W);
-	SET_OP(OP, 0x8D, STA, MODE_ABSOLUTE,    IO_W);
-	SET_OP(OP, 0x9D, STA, MODE_ABSOLUTE_X,  IO_W);
-	SET_OP(OP, 0x99, STA, MODE_ABSOLUTE_Y,  IO_W);
-	SET_OP(OP, 0x81, STA, MODE_INDIRECT_X,  IO_W);
-	SET_OP(OP, 0x91, STA, MODE_INDIRECT_Y,  IO_W);
-
-	SET_OP(OP, 0x86, STX, MODE_ZERO_PAGE,   IO_W);
-	SET_OP(OP, 0x96, STX, MODE_ZERO_PAGE_Y, IO_W);
-	SET_OP(OP, 0x8E, STX, MODE_ABSOLUTE,    IO_W);
-
-	SET_OP(OP, 0x84, STY, MODE_ZERO_PAGE,   IO_W);
-	SET_OP(OP, 0x94, STY, MODE_ZERO_PAGE_X, IO_W);
-	SET_OP(OP, 0x8C, STY, MODE_ABSOLUTE,    IO_W);
-
-	SET_OP(OP, 0xC6, DEC, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0xD6, DEC, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0xCE, DEC, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0xDE, DEC, MODE_ABSOLUTE_X,  IO_RMW);
-
-	SET_OP(OP, 0xEE, INC, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0xE6, INC, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0xF6, INC, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0xFE, INC, MODE_ABSOLUTE_X,  IO_RMW);
-
-	SET_OP(OP, 0x4A, LSR, MODE_ACCUMULATOR, IO_NONE);
-	SET_OP(OP, 0x46, LSR, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x56, LSR, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x4E, LSR, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x5E, LSR, MODE_ABSOLUTE_X,  IO_RMW);
-
-	SET_OP(OP, 0x0A, ASL, MODE_ACCUMULATOR, IO_NONE);
-	SET_OP(OP, 0x06, ASL, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x16, ASL, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x0E, ASL, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x1E, ASL, MODE_ABSOLUTE_X,  IO_RMW);
-
-	SET_OP(OP, 0x6A, ROR, MODE_ACCUMULATOR, IO_NONE);
-	SET_OP(OP, 0x66, ROR, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x76, ROR, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x6E, ROR, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x7E, ROR, MODE_ABSOLUTE_X,  IO_RMW);
-
-	SET_OP(OP, 0x2A, ROL, MODE_ACCUMULATOR, IO_NONE);
-	SET_OP(OP, 0x26, ROL, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x36, ROL, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x2E, ROL, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x3E, ROL, MODE_ABSOLUTE_X,  IO_RMW);
-
-	SET_OP(OP, 0xF0, BEQ, MODE_RELATIVE,    IO_NONE);
-	SET_OP(OP, 0xD0, BNE, MODE_RELATIVE,    IO_NONE);
-	SET_OP(OP, 0x10, BPL, MODE_RELATIVE,    IO_NONE);
-	SET_OP(OP, 0x30, BMI, MODE_RELATIVE,    IO_NONE);
-	SET_OP(OP, 0xB0, BCS, MODE_RELATIVE,    IO_NONE);
-	SET_OP(OP, 0x90, BCC, MODE_RELATIVE,    IO_NONE);
-	SET_OP(OP, 0x50, BVC, MODE_RELATIVE,    IO_NONE);
-	SET_OP(OP, 0x70, BVS, MODE_RELATIVE,    IO_NONE);
-
-	SET_OP(OP, 0x00, BRK, MODE_IMPLIED,     IO_STACK);
-	SET_OP(OP, 0x40, RTI, MODE_IMPLIED,     IO_STACK);
-	SET_OP(OP, 0x48, PHA, MODE_IMPLIED,     IO_STACK);
-	SET_OP(OP, 0x08, PHP, MODE_IMPLIED,     IO_STACK);
-	SET_OP(OP, 0x68, PLA, MODE_IMPLIED,     IO_STACK);
-	SET_OP(OP, 0x28, PLP, MODE_IMPLIED,     IO_STACK);
-	SET_OP(OP, 0x78, SEI, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xF8, SED, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xD8, CLD, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x58, CLI, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x9A, TXS, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x88, DEY, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xAA, TAX, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xA8, TAY, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x8A, TXA, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x98, TYA, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xBA, TSX, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x60, RTS, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x18, CLC, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xB8, CLV, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xCA, DEX, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x38, SEC, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xE8, INX, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xC8, INY, MODE_IMPLIED,     IO_NONE);
-
-	SET_OP(OP, 0x20, JSR, MODE_ABSOLUTE,    IO_STACK);
-
-	SET_OP(OP, 0x4C, JMP, MODE_ABSOLUTE,    IO_NONE);
-	SET_OP(OP, 0x6C, JMP, MODE_INDIRECT,    IO_NONE);
-
-	SET_OP(OP, 0xEA, NOP, MODE_IMPLIED,     IO_NONE);
-
-
-	// UNOFFICIAL -- not used by nearly any games, but good for testing
-	// http://nesdev.com/undocumented_opcodes.txt
-
-	SET_OP(OP, 0xE9, SBC, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xEB, SBC, MODE_IMMEDIATE,   IO_R);
-
-	SET_OP(OP, 0x80, DOP, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x82, DOP, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x89, DOP, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xC2, DOP, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0xE2, DOP, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x04, DOP, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x44, DOP, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x64, DOP, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0x14, DOP, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0x34, DOP, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0x54, DOP, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0x74, DOP, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0xD4, DOP, MODE_ZERO_PAGE_X, IO_R);
-	SET_OP(OP, 0xF4, DOP, MODE_ZERO_PAGE_X, IO_R);
-
-	SET_OP(OP, 0x0C, TOP, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0x1C, TOP, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0x3C, TOP, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0x5C, TOP, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0x7C, TOP, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0xDC, TOP, MODE_ABSOLUTE_X,  IO_R);
-	SET_OP(OP, 0xFC, TOP, MODE_ABSOLUTE_X,  IO_R);
-
-	SET_OP(OP, 0xA7, LAX, MODE_ZERO_PAGE,   IO_R);
-	SET_OP(OP, 0xB7, LAX, MODE_ZERO_PAGE_Y, IO_R);
-	SET_OP(OP, 0xAF, LAX, MODE_ABSOLUTE,    IO_R);
-	SET_OP(OP, 0xBF, LAX, MODE_ABSOLUTE_Y,  IO_R);
-	SET_OP(OP, 0xA3, LAX, MODE_INDIRECT_X,  IO_R);
-	SET_OP(OP, 0xB3, LAX, MODE_INDIRECT_Y,  IO_R);
-
-	SET_OP(OP, 0x0B, AAC, MODE_IMMEDIATE,   IO_R);
-	SET_OP(OP, 0x2B, AAC, MODE_IMMEDIATE,   IO_R);
-
-	SET_OP(OP, 0x4B, ASR, MODE_IMMEDIATE,   IO_R);
-
-	SET_OP(OP, 0x6B, ARR, MODE_IMMEDIATE,   IO_R);
-
-	SET_OP(OP, 0xAB, ATX, MODE_IMMEDIATE,   IO_R);
-
-	SET_OP(OP, 0xCB, AXS, MODE_IMMEDIATE,   IO_R);
-
-	SET_OP(OP, 0x8B, XAA, MODE_IMMEDIATE,   IO_R);
-
-	SET_OP(OP, 0xBB, LAR, MODE_ABSOLUTE_Y,  IO_R);
-
-	SET_OP(OP, 0x87, AAX, MODE_ZERO_PAGE,   IO_W);
-	SET_OP(OP, 0x97, AAX, MODE_ZERO_PAGE_Y, IO_W);
-	SET_OP(OP, 0x8F, AAX, MODE_ABSOLUTE,    IO_W);
-	SET_OP(OP, 0x83, AAX, MODE_INDIRECT_X,  IO_W);
-
-	SET_OP(OP, 0x9F, AXA, MODE_ABSOLUTE_Y,  IO_W);
-	SET_OP(OP, 0x93, AXA, MODE_INDIRECT_Y,  IO_W);
-
-	SET_OP(OP, 0x9C, SYA, MODE_ABSOLUTE_X,  IO_W);
-
-	SET_OP(OP, 0x9E, SXA, MODE_ABSOLUTE_Y,  IO_W);
-
-	SET_OP(OP, 0x9B, XAS, MODE_ABSOLUTE_Y,  IO_W);
-
-	SET_OP(OP, 0x07, SLO, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x17, SLO, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x0F, SLO, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x1F, SLO, MODE_ABSOLUTE_X,  IO_RMW);
-	SET_OP(OP, 0x1B, SLO, MODE_ABSOLUTE_Y,  IO_RMW);
-	SET_OP(OP, 0x03, SLO, MODE_INDIRECT_X,  IO_RMW);
-	SET_OP(OP, 0x13, SLO, MODE_INDIRECT_Y,  IO_RMW);
-
-	SET_OP(OP, 0x27, RLA, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x37, RLA, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x2F, RLA, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x3F, RLA, MODE_ABSOLUTE_X,  IO_RMW);
-	SET_OP(OP, 0x3B, RLA, MODE_ABSOLUTE_Y,  IO_RMW);
-	SET_OP(OP, 0x23, RLA, MODE_INDIRECT_X,  IO_RMW);
-	SET_OP(OP, 0x33, RLA, MODE_INDIRECT_Y,  IO_RMW);
-
-	SET_OP(OP, 0x47, SRE, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x57, SRE, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x4F, SRE, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x5F, SRE, MODE_ABSOLUTE_X,  IO_RMW);
-	SET_OP(OP, 0x5B, SRE, MODE_ABSOLUTE_Y,  IO_RMW);
-	SET_OP(OP, 0x43, SRE, MODE_INDIRECT_X,  IO_RMW);
-	SET_OP(OP, 0x53, SRE, MODE_INDIRECT_Y,  IO_RMW);
-
-	SET_OP(OP, 0x67, RRA, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0x77, RRA, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0x6F, RRA, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0x7F, RRA, MODE_ABSOLUTE_X,  IO_RMW);
-	SET_OP(OP, 0x7B, RRA, MODE_ABSOLUTE_Y,  IO_RMW);
-	SET_OP(OP, 0x63, RRA, MODE_INDIRECT_X,  IO_RMW);
-	SET_OP(OP, 0x73, RRA, MODE_INDIRECT_Y,  IO_RMW);
-
-	SET_OP(OP, 0xC7, DCP, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0xD7, DCP, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0xCF, DCP, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0xDF, DCP, MODE_ABSOLUTE_X,  IO_RMW);
-	SET_OP(OP, 0xDB, DCP, MODE_ABSOLUTE_Y,  IO_RMW);
-	SET_OP(OP, 0xC3, DCP, MODE_INDIRECT_X,  IO_RMW);
-	SET_OP(OP, 0xD3, DCP, MODE_INDIRECT_Y,  IO_RMW);
-
-	SET_OP(OP, 0xE7, ISC, MODE_ZERO_PAGE,   IO_RMW);
-	SET_OP(OP, 0xF7, ISC, MODE_ZERO_PAGE_X, IO_RMW);
-	SET_OP(OP, 0xEF, ISC, MODE_ABSOLUTE,    IO_RMW);
-	SET_OP(OP, 0xFF, ISC, MODE_ABSOLUTE_X,  IO_RMW);
-	SET_OP(OP, 0xFB, ISC, MODE_ABSOLUTE_Y,  IO_RMW);
-	SET_OP(OP, 0xE3, ISC, MODE_INDIRECT_X,  IO_RMW);
-	SET_OP(OP, 0xF3, ISC, MODE_INDIRECT_Y,  IO_RMW);
-
-	SET_OP(OP, 0x1A, NOP, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x3A, NOP, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x5A, NOP, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0x7A, NOP, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xDA, NOP, MODE_IMPLIED,     IO_NONE);
-	SET_OP(OP, 0xFA, NOP, MODE_IMPLIED,     IO_NONE);
-}
+// http://nesdev.com/6502_cpu.txt -- the best reference
+// http://www.obelisk.me.uk/6502/reference.html
+
+// X(code, name, address mode, io mode) -- expanded into the per-opcode handlers and dispatch table
+#define CPU_OPCODES(X) \
+	X(0xA9, LDA, MODE_IMMEDIATE,   IO_R) \
+	X(0xA5, LDA, MODE_ZERO_PAGE,   IO_R) \
+	X(0xB5, LDA, MODE_ZERO_PAGE_X, IO_R) \
+	X(0xAD, LDA, MODE_ABSOLUTE,    IO_R) \
+	X(0xBD, LDA, MODE_ABSOLUTE_X,  IO_R) \
+	X(0xB9, LDA, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0xA1, LDA, MODE_INDIRECT_X,  IO_R) \
+	X(0xB1, LDA, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0xA2, LDX, MODE_IMMEDIATE,   IO_R) \
+	X(0xA6, LDX, MODE_ZERO_PAGE,   IO_R) \
+	X(0xB6, LDX, MODE_ZERO_PAGE_Y, IO_R) \
+	X(0xAE, LDX, MODE_ABSOLUTE,    IO_R) \
+	X(0xBE, LDX, MODE_ABSOLUTE_Y,  IO_R) \
+	\
+	X(0xA0, LDY, MODE_IMMEDIATE,   IO_R) \
+	X(0xA4, LDY, MODE_ZERO_PAGE,   IO_R) \
+	X(0xB4, LDY, MODE_ZERO_PAGE_X, IO_R) \
+	X(0xAC, LDY, MODE_ABSOLUTE,    IO_R) \
+	X(0xBC, LDY, MODE_ABSOLUTE_X,  IO_R) \
+	\
+	X(0x29, AND, MODE_IMMEDIATE,   IO_R) \
+	X(0x25, AND, MODE_ZERO_PAGE,   IO_R) \
+	X(0x35, AND, MODE_ZERO_PAGE_X, IO_R) \
+	X(0x2D, AND, MODE_ABSOLUTE,    IO_R) \
+	X(0x3D, AND, MODE_ABSOLUTE_X,  IO_R) \
+	X(0x39, AND, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0x21, AND, MODE_INDIRECT_X,  IO_R) \
+	X(0x31, AND, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0x49, EOR, MODE_IMMEDIATE,   IO_R) \
+	X(0x45, EOR, MODE_ZERO_PAGE,   IO_R) \
+	X(0x55, EOR, MODE_ZERO_PAGE_X, IO_R) \
+	X(0x4D, EOR, MODE_ABSOLUTE,    IO_R) \
+	X(0x5D, EOR, MODE_ABSOLUTE_X,  IO_R) \
+	X(0x59, EOR, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0x41, EOR, MODE_INDIRECT_X,  IO_R) \
+	X(0x51, EOR, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0xC9, CMP, MODE_IMMEDIATE,   IO_R) \
+	X(0xC5, CMP, MODE_ZERO_PAGE,   IO_R) \
+	X(0xD5, CMP, MODE_ZERO_PAGE_X, IO_R) \
+	X(0xCD, CMP, MODE_ABSOLUTE,    IO_R) \
+	X(0xDD, CMP, MODE_ABSOLUTE_X,  IO_R) \
+	X(0xD9, CMP, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0xC1, CMP, MODE_INDIRECT_X,  IO_R) \
+	X(0xD1, CMP, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0xC0, CPY, MODE_IMMEDIATE,   IO_R) \
+	X(0xC4, CPY, MODE_ZERO_PAGE,   IO_R) \
+	X(0xCC, CPY, MODE_ABSOLUTE,    IO_R) \
+	\
+	X(0xE0, CPX, MODE_IMMEDIATE,   IO_R) \
+	X(0xE4, CPX, MODE_ZERO_PAGE,   IO_R) \
+	X(0xEC, CPX, MODE_ABSOLUTE,    IO_R) \
+	\
+	X(0x69, ADC, MODE_IMMEDIATE,   IO_R) \
+	X(0x65, ADC, MODE_ZERO_PAGE,   IO_R) \
+	X(0x75, ADC, MODE_ZERO_PAGE_X, IO_R) \
+	X(0x6D, ADC, MODE_ABSOLUTE,    IO_R) \
+	X(0x7D, ADC, MODE_ABSOLUTE_X,  IO_R) \
+	X(0x79, ADC, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0x61, ADC, MODE_INDIRECT_X,  IO_R) \
+	X(0x71, ADC, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0xE9, SBC, MODE_IMMEDIATE,   IO_R) \
+	X(0xE5, SBC, MODE_ZERO_PAGE,   IO_R) \
+	X(0xF5, SBC, MODE_ZERO_PAGE_X, IO_R) \
+	X(0xED, SBC, MODE_ABSOLUTE,    IO_R) \
+	X(0xFD, SBC, MODE_ABSOLUTE_X,  IO_R) \
+	X(0xF9, SBC, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0xE1, SBC, MODE_INDIRECT_X,  IO_R) \
+	X(0xF1, SBC, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0x09, ORA, MODE_IMMEDIATE,   IO_R) \
+	X(0x05, ORA, MODE_ZERO_PAGE,   IO_R) \
+	X(0x15, ORA, MODE_ZERO_PAGE_X, IO_R) \
+	X(0x0D, ORA, MODE_ABSOLUTE,    IO_R) \
+	X(0x1D, ORA, MODE_ABSOLUTE_X,  IO_R) \
+	X(0x19, ORA, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0x01, ORA, MODE_INDIRECT_X,  IO_R) \
+	X(0x11, ORA, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0x24, BIT, MODE_ZERO_PAGE,   IO_R) \
+	X(0x2C, BIT, MODE_ABSOLUTE,    IO_R) \
+	\
+	X(0x85, STA, MODE_ZERO_PAGE,   IO_W) \
+	X(0x95, STA, MODE_ZERO_PAGE_X, IO_W) \
+	X(0x8D, STA, MODE_ABSOLUTE,    IO_W) \
+	X(0x9D, STA, MODE_ABSOLUTE_X,  IO_W) \
+	X(0x99, STA, MODE_ABSOLUTE_Y,  IO_W) \
+	X(0x81, STA, MODE_INDIRECT_X,  IO_W) \
+	X(0x91, STA, MODE_INDIRECT_Y,  IO_W) \
+	\
+	X(0x86, STX, MODE_ZERO_PAGE,   IO_W) \
+	X(0x96, STX, MODE_ZERO_PAGE_Y, IO_W) \
+	X(0x8E, STX, MODE_ABSOLUTE,    IO_W) \
+	\
+	X(0x84, STY, MODE_ZERO_PAGE,   IO_W) \
+	X(0x94, STY, MODE_ZERO_PAGE_X, IO_W) \
+	X(0x8C, STY, MODE_ABSOLUTE,    IO_W) \
+	\
+	X(0xC6, DEC, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0xD6, DEC, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0xCE, DEC, MODE_ABSOLUTE,    IO_RMW) \
+	X(0xDE, DEC, MODE_ABSOLUTE_X,  IO_RMW) \
+	\
+	X(0xEE, INC, MODE_ABSOLUTE,    IO_RMW) \
+	X(0xE6, INC, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0xF6, INC, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0xFE, INC, MODE_ABSOLUTE_X,  IO_RMW) \
+	\
+	X(0x4A, LSR, MODE_ACCUMULATOR, IO_NONE) \
+	X(0x46, LSR, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x56, LSR, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x4E, LSR, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x5E, LSR, MODE_ABSOLUTE_X,  IO_RMW) \
+	\
+	X(0x0A, ASL, MODE_ACCUMULATOR, IO_NONE) \
+	X(0x06, ASL, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x16, ASL, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x0E, ASL, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x1E, ASL, MODE_ABSOLUTE_X,  IO_RMW) \
+	\
+	X(0x6A, ROR, MODE_ACCUMULATOR, IO_NONE) \
+	X(0x66, ROR, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x76, ROR, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x6E, ROR, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x7E, ROR, MODE_ABSOLUTE_X,  IO_RMW) \
+	\
+	X(0x2A, ROL, MODE_ACCUMULATOR, IO_NONE) \
+	X(0x26, ROL, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x36, ROL, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x2E, ROL, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x3E, ROL, MODE_ABSOLUTE_X,  IO_RMW) \
+	\
+	X(0xF0, BEQ, MODE_RELATIVE,    IO_NONE) \
+	X(0xD0, BNE, MODE_RELATIVE,    IO_NONE) \
+	X(0x10, BPL, MODE_RELATIVE,    IO_NONE) \
+	X(0x30, BMI, MODE_RELATIVE,    IO_NONE) \
+	X(0xB0, BCS, MODE_RELATIVE,    IO_NONE) \
+	X(0x90, BCC, MODE_RELATIVE,    IO_NONE) \
+	X(0x50, BVC, MODE_RELATIVE,    IO_NONE) \
+	X(0x70, BVS, MODE_RELATIVE,    IO_NONE) \
+	\
+	X(0x00, BRK, MODE_IMPLIED,     IO_STACK) \
+	X(0x40, RTI, MODE_IMPLIED,     IO_STACK) \
+	X(0x48, PHA, MODE_IMPLIED,     IO_STACK) \
+	X(0x08, PHP, MODE_IMPLIED,     IO_STACK) \
+	X(0x68, PLA, MODE_IMPLIED,     IO_STACK) \
+	X(0x28, PLP, MODE_IMPLIED,     IO_STACK) \
+	X(0x78, SEI, MODE_IMPLIED,     IO_NONE) \
+	X(0xF8, SED, MODE_IMPLIED,     IO_NONE) \
+	X(0xD8, CLD, MODE_IMPLIED,     IO_NONE) \
+	X(0x58, CLI, MODE_IMPLIED,     IO_NONE) \
+	X(0x9A, TXS, MODE_IMPLIED,     IO_NONE) \
+	X(0x88, DEY, MODE_IMPLIED,     IO_NONE) \
+	X(0xAA, TAX, MODE_IMPLIED,     IO_NONE) \
+	X(0xA8, TAY, MODE_IMPLIED,     IO_NONE) \
+	X(0x8A, TXA, MODE_IMPLIED,     IO_NONE) \
+	X(0x98, TYA, MODE_IMPLIED,     IO_NONE) \
+	X(0xBA, TSX, MODE_IMPLIED,     IO_NONE) \
+	X(0x60, RTS, MODE_IMPLIED,     IO_NONE) \
+	X(0x18, CLC, MODE_IMPLIED,     IO_NONE) \
+	X(0xB8, CLV, MODE_IMPLIED,     IO_NONE) \
+	X(0xCA, DEX, MODE_IMPLIED,     IO_NONE) \
+	X(0x38, SEC, MODE_IMPLIED,     IO_NONE) \
+	X(0xE8, INX, MODE_IMPLIED,     IO_NONE) \
+	X(0xC8, INY, MODE_IMPLIED,     IO_NONE) \
+	\
+	X(0x20, JSR, MODE_ABSOLUTE,    IO_STACK) \
+	\
+	X(0x4C, JMP, MODE_ABSOLUTE,    IO_NONE) \
+	X(0x6C, JMP, MODE_INDIRECT,    IO_NONE) \
+	\
+	X(0xEA, NOP, MODE_IMPLIED,     IO_NONE) \
+	\
+	/* UNOFFICIAL -- not used by nearly any games, but good for testing */ \
+	/* http://nesdev.com/undocumented_opcodes.txt */ \
+	\
+	X(0xEB, SBC, MODE_IMMEDIATE,   IO_R) \
+	\
+	X(0x80, DOP, MODE_IMMEDIATE,   IO_R) \
+	X(0x82, DOP, MODE_IMMEDIATE,   IO_R) \
+	X(0x89, DOP, MODE_IMMEDIATE,   IO_R) \
+	X(0xC2, DOP, MODE_IMMEDIATE,   IO_R) \
+	X(0xE2, DOP, MODE_IMMEDIATE,   IO_R) \
+	X(0x04, DOP, MODE_ZERO_PAGE,   IO_R) \
+	X(0x44, DOP, MODE_ZERO_PAGE,   IO_R) \
+	X(0x64, DOP, MODE_ZERO_PAGE,   IO_R) \
+	X(0x14, DOP, MODE_ZERO_PAGE_X, IO_R) \
+	X(0x34, DOP, MODE_ZERO_PAGE_X, IO_R) \
+	X(0x54, DOP, MODE_ZERO_PAGE_X, IO_R) \
+	X(0x74, DOP, MODE_ZERO_PAGE_X, IO_R) \
+	X(0xD4, DOP, MODE_ZERO_PAGE_X, IO_R) \
+	X(0xF4, DOP, MODE_ZERO_PAGE_X, IO_R) \
+	\
+	X(0x0C, TOP, MODE_ABSOLUTE,    IO_R) \
+	X(0x1C, TOP, MODE_ABSOLUTE_X,  IO_R) \
+	X(0x3C, TOP, MODE_ABSOLUTE_X,  IO_R) \
+	X(0x5C, TOP, MODE_ABSOLUTE_X,  IO_R) \
+	X(0x7C, TOP, MODE_ABSOLUTE_X,  IO_R) \
+	X(0xDC, TOP, MODE_ABSOLUTE_X,  IO_R) \
+	X(0xFC, TOP, MODE_ABSOLUTE_X,  IO_R) \
+	\
+	X(0xA7, LAX, MODE_ZERO_PAGE,   IO_R) \
+	X(0xB7, LAX, MODE_ZERO_PAGE_Y, IO_R) \
+	X(0xAF, LAX, MODE_ABSOLUTE,    IO_R) \
+	X(0xBF, LAX, MODE_ABSOLUTE_Y,  IO_R) \
+	X(0xA3, LAX, MODE_INDIRECT_X,  IO_R) \
+	X(0xB3, LAX, MODE_INDIRECT_Y,  IO_R) \
+	\
+	X(0x0B, AAC, MODE_IMMEDIATE,   IO_R) \
+	X(0x2B, AAC, MODE_IMMEDIATE,   IO_R) \
+	\
+	X(0x4B, ASR, MODE_IMMEDIATE,   IO_R) \
+	\
+	X(0x6B, ARR, MODE_IMMEDIATE,   IO_R) \
+	\
+	X(0xAB, ATX, MODE_IMMEDIATE,   IO_R) \
+	\
+	X(0xCB, AXS, MODE_IMMEDIATE,   IO_R) \
+	\
+	X(0x8B, XAA, MODE_IMMEDIATE,   IO_R) \
+	\
+	X(0xBB, LAR, MODE_ABSOLUTE_Y,  IO_R) \
+	\
+	X(0x87, AAX, MODE_ZERO_PAGE,   IO_W) \
+	X(0x97, AAX, MODE_ZERO_PAGE_Y, IO_W) \
+	X(0x8F, AAX, MODE_ABSOLUTE,    IO_W) \
+	X(0x83, AAX, MODE_INDIRECT_X,  IO_W) \
+	\
+	X(0x9F, AXA, MODE_ABSOLUTE_Y,  IO_W) \
+	X(0x93, AXA, MODE_INDIRECT_Y,  IO_W) \
+	\
+	X(0x9C, SYA, MODE_ABSOLUTE_X,  IO_W) \
+	\
+	X(0x9E, SXA, MODE_ABSOLUTE_Y,  IO_W) \
+	\
+	X(0x9B, XAS, MODE_ABSOLUTE_Y,  IO_W) \
+	\
+	X(0x07, SLO, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x17, SLO, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x0F, SLO, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x1F, SLO, MODE_ABSOLUTE_X,  IO_RMW) \
+	X(0x1B, SLO, MODE_ABSOLUTE_Y,  IO_RMW) \
+	X(0x03, SLO, MODE_INDIRECT_X,  IO_RMW) \
+	X(0x13, SLO, MODE_INDIRECT_Y,  IO_RMW) \
+	\
+	X(0x27, RLA, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x37, RLA, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x2F, RLA, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x3F, RLA, MODE_ABSOLUTE_X,  IO_RMW) \
+	X(0x3B, RLA, MODE_ABSOLUTE_Y,  IO_RMW) \
+	X(0x23, RLA, MODE_INDIRECT_X,  IO_RMW) \
+	X(0x33, RLA, MODE_INDIRECT_Y,  IO_RMW) \
+	\
+	X(0x47, SRE, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x57, SRE, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x4F, SRE, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x5F, SRE, MODE_ABSOLUTE_X,  IO_RMW) \
+	X(0x5B, SRE, MODE_ABSOLUTE_Y,  IO_RMW) \
+	X(0x43, SRE, MODE_INDIRECT_X,  IO_RMW) \
+	X(0x53, SRE, MODE_INDIRECT_Y,  IO_RMW) \
+	\
+	X(0x67, RRA, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0x77, RRA, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0x6F, RRA, MODE_ABSOLUTE,    IO_RMW) \
+	X(0x7F, RRA, MODE_ABSOLUTE_X,  IO_RMW) \
+	X(0x7B, RRA, MODE_ABSOLUTE_Y,  IO_RMW) \
+	X(0x63, RRA, MODE_INDIRECT_X,  IO_RMW) \
+	X(0x73, RRA, MODE_INDIRECT_Y,  IO_RMW) \
+	\
+	X(0xC7, DCP, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0xD7, DCP, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0xCF, DCP, MODE_ABSOLUTE,    IO_RMW) \
+	X(0xDF, DCP, MODE_ABSOLUTE_X,  IO_RMW) \
+	X(0xDB, DCP, MODE_ABSOLUTE_Y,  IO_RMW) \
+	X(0xC3, DCP, MODE_INDIRECT_X,  IO_RMW) \
+	X(0xD3, DCP, MODE_INDIRECT_Y,  IO_RMW) \
+	\
+	X(0xE7, ISC, MODE_ZERO_PAGE,   IO_RMW) \
+	X(0xF7, ISC, MODE_ZERO_PAGE_X, IO_RMW) \
+	X(0xEF, ISC, MODE_ABSOLUTE,    IO_RMW) \
+	X(0xFF, ISC, MODE_ABSOLUTE_X,  IO_RMW) \
+	X(0xFB, ISC, MODE_ABSOLUTE_Y,  IO_RMW) \
+	X(0xE3, ISC, MODE_INDIRECT_X,  IO_RMW) \
+	X(0xF3, ISC, MODE_INDIRECT_Y,  IO_RMW) \
+	\
+	X(0x1A, NOP, MODE_IMPLIED,     IO_NONE) \
+	X(0x3A, NOP, MODE_IMPLIED,     IO_NONE) \
+	X(0x5A, NOP, MODE_IMPLIED,     IO_NONE) \
+	X(0x7A, NOP, MODE_IMPLIED,     IO_NONE) \
+	X(0xDA, NOP, MODE_IMPLIED,     IO_NONE) \
+	X(0xFA, NOP, MODE_IMPLIED,     IO_NONE) \
+	\
+	/* KIL -- jams the CPU, not supported */ \
+	X(0x02, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x12, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x22, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x32, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x42, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x52, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x62, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x72, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0x92, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0xB2, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0xD2, KIL, MODE_IMPLIED,     IO_NONE) \
+	X(0xF2, KIL, MODE_IMPLIED,     IO_NONE)
 
 
 /*** STACK HELPERS ***/
@@ -768,16 +771,10 @@ static void cpu_branch(struct cpu *cpu, struct nes *nes, uint16_t addr)
 	}
 }
 
-static void cpu_exec(struct cpu *cpu, struct nes *nes)
+static CPU_INLINE void cpu_op(struct cpu *cpu, struct nes *nes, uint8_t code,
+	enum opcode_name lookup, enum address_mode mode, uint16_t addr)
 {
-	//attempt to read the next opcode
-	uint8_t code = cpu_read(cpu, nes, cpu->PC++);
-	struct opcode *op = &cpu->OP[code];
-
-	bool pagex = false;
-	uint16_t addr = cpu_opcode_address(cpu, nes, op->mode, op->io_mode, &pagex);
-
-	switch (op->lookup) {
+	switch (lookup) {
 		case SEI:
 			SET_FLAG(cpu->P, FLAG_I);
 			break;
@@ -982,19 +979,19 @@ static void cpu_exec(struct cpu *cpu, struct nes *nes)
 			break;
 
 		case LSR:
-			cpu_lsr(cpu, nes, op->mode, addr);
+			cpu_lsr(cpu, nes, mode, addr);
 			break;
 
 		case ASL:
-			cpu_asl(cpu, nes, op->mode, addr);
+			cpu_asl(cpu, nes, mode, addr);
 			break;
 
 		case ROR:
-			cpu_ror(cpu, nes, op->mode, addr);
+			cpu_ror(cpu, nes, mode, addr);
 			break;
 
 		case ROL:
-			cpu_rol(cpu, nes, op->mode, addr);
+			cpu_rol(cpu, nes, mode, addr);
 			break;
 
 		case ORA:
@@ -1113,19 +1110,19 @@ static void cpu_exec(struct cpu *cpu, struct nes *nes)
 			break;
 
 		} case SLO:
-			cpu_ora(cpu, cpu_asl(cpu, nes, op->mode, addr));
+			cpu_ora(cpu, cpu_asl(cpu, nes, mode, addr));
 			break;
 
 		case RLA:
-			cpu_and(cpu, cpu_rol(cpu, nes, op->mode, addr));
+			cpu_and(cpu, cpu_rol(cpu, nes, mode, addr));
 			break;
 
 		case SRE:
-			cpu_eor(cpu, cpu_lsr(cpu, nes, op->mode, addr));
+			cpu_eor(cpu, cpu_lsr(cpu, nes, mode, addr));
 			break;
 
 		case RRA:
-			cpu_adc(cpu, cpu_ror(cpu, nes, op->mode, addr));
+			cpu_adc(cpu, cpu_ror(cpu, nes, mode, addr));
 			break;
 
 		case AAX:
@@ -1180,12 +1177,40 @@ static void cpu_exec(struct cpu *cpu, struct nes *nes)
 			cpu_write(cpu, nes, addr, cpu->SP & ((addr >> 8) + 1));
 			break;
 
+		case KIL:
 		default:
-			nes_log("CPU unknown opcode: %02X", code);
+			nes_log(nes, "CPU unknown opcode: %02X", code);
 			assert(!"CPU unknown opcode");
 	}
 }
 
+// every opcode gets its own handler with the address mode, io mode, and operation
+// known at compile time, leaving a single indirect call as the only dispatch
+#define CPU_OP_HANDLER(_code, _name, _mode, _io) \
+	static void cpu_op_##_code(struct cpu *cpu, struct nes *nes) \
+	{ \
+		bool pagex = false; \
+		uint16_t addr = cpu_opcode_address(cpu, nes, _mode, _io, &pagex); \
+		cpu_op(cpu, nes, _code, _name, _mode, addr); \
+	}
+
+#define CPU_OP_ENTRY(_code, _name, _mode, _io) \
+	[_code] = cpu_op_##_code,
+
+CPU_OPCODES(CPU_OP_HANDLER)
+
+static void (*const CPU_OPS[0x100])(struct cpu *cpu, struct nes *nes) = {
+	CPU_OPCODES(CPU_OP_ENTRY)
+};
+
+static void cpu_exec(struct cpu *cpu, struct nes *nes)
+{
+	//attempt to read the next opcode
+	uint8_t code = cpu_read(cpu, nes, cpu->PC++);
+
+	CPU_OPS[code](cpu, nes);
+}
+
 
 /*** INTERRUPTS ***/
 
@@ -1282,13 +1307,29 @@ void cpu_step(struct cpu *cpu, struct nes *nes)
 }
 
 
+/*** STATE ***/
+
+size_t cpu_state_size(void)
+{
+	return sizeof(struct cpu);
+}
+
+void cpu_state_save(struct cpu *cpu, void *buf)
+{
+	memcpy(buf, cpu, sizeof(struct cpu));
+}
+
+void cpu_state_load(struct cpu *cpu, const void *buf)
+{
+	memcpy(cpu, buf, sizeof(struct cpu));
+}
+
+
 /*** INIT & DESTROY ***/
 
 void cpu_init(struct cpu **cpu_out)
 {
-	struct cpu *cpu = *cpu_out = calloc(1, sizeof(struct cpu));
-
-	cpu_fill_op_table(cpu->OP);
+	*cpu_out = calloc(1, sizeof(struct cpu));
 }
 
 void cpu_destroy(struct cpu **cpu_out)
@@ -24,6 +24,11 @@ uint8_t cpu_dma_dmc(struct cpu *cpu, struct nes *nes, uint16_t addr, bool in_wri
 /*** RUN ***/
 void cpu_step(struct cpu *cpu, struct nes *nes);
 
+/*** STATE ***/
+size_t cpu_state_size(void);
+void cpu_state_save(struct cpu *cpu, void *buf);
+void cpu_state_load(struct cpu *cpu, const void *buf);
+
 /*** INIT & DESTROY ***/
 void cpu_init(struct cpu **cpu_out);
 void cpu_destroy(struct cpu **cpu_out);
@@ -73,19 +73,37 @@ static void fcg_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uin
 			case 0x600D: //EEPROM write
 				break;
 			default:
-				nes_log("Uncaught Bandai FCG write %x: %x", addr, v);
+				nes_log(cart->nes, "Uncaught Bandai FCG write %x: %x", addr, v);
 		}
 	}
 }
 
-static void fcg_step(struct cart *cart, struct cpu *cpu)
+static uint64_t fcg_next_irq(struct cart *cart)
+{
+	if (!cart->irq.enable)
+		return 0;
+
+	// the counter counts down and fires on the cycle after it reaches 0xFFFE
+	return (uint64_t) (uint16_t) (cart->irq.counter - 0xFFFE) + 1;
+}
+
+static void fcg_step(struct cart *cart, struct cpu *cpu, uint64_t cycles)
 {
 	if (cart->irq.enable) {
-		if (cart->irq.counter == 0xFFFE) {
+		if (cycles >= fcg_next_irq(cart)) {
+			cart->irq.counter = 0xFFFE;
 			cpu_irq(cpu, IRQ_MAPPER, true);
 			cart->irq.enable = false;
+
 		} else {
-			cart->irq.counter--;
+			cart->irq.counter -= (uint16_t) cycles;
 		}
 	}
 }
+
+static const struct mapper_ops FCG = {
+	.init = fcg_init,
+	.prg_write = fcg_prg_write,
+	.step = fcg_step,
+	.next_irq = fcg_next_irq,
+};
@@ -71,10 +71,28 @@ static void fme7_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, ui
 	}
 }
 
-static void fme7_step(struct cart *cart, struct cpu *cpu)
+static void fme7_step(struct cart *cart, struct cpu *cpu, uint64_t cycles)
 {
 	if (cart->irq.cycle) {
-		if (--cart->irq.value == 0xFFFF)
+		if (cycles > cart->irq.value)
 			cpu_irq(cpu, IRQ_MAPPER, cart->irq.enable);
+
+		cart->irq.value -= (uint16_t) cycles;
 	}
 }
+
+static uint64_t fme7_next_irq(struct cart *cart)
+{
+	if (!cart->irq.cycle || !cart->irq.enable)
+		return 0;
+
+	// the IRQ fires when the counter wraps from 0 to 0xFFFF
+	return (uint64_t) cart->irq.value + 1;
+}
+
+static const struct mapper_ops FME7 = {
+	.init = fme7_init,
+	.prg_write = fme7_prg_write,
+	.step = fme7_step,
+	.next_irq = fme7_next_irq,
+};
@@ -1,23 +1,4 @@
-struct mapper {
-	uint16_t reg_low;
-	uint16_t reg_high;
-	uint8_t prg_size;
-	uint8_t chr_size;
-	uint8_t chr_slots;
-	uint16_t prg_addr;
-	uint8_t prg_mask;
-	uint8_t prg_shift;
-	uint8_t chr0_mask;
-	int8_t chr0_shift;
-	uint8_t chr1_mask;
-	int8_t chr1_shift;
-	bool chr_combine;
-	uint8_t mirror_table;
-	uint8_t mirror_mask;
-	uint8_t mirror_shift;
-};
-
-static enum mirror MIRROR[6][4] = {
+static const enum mirror MIRROR[6][4] = {
 	{0, 0},
 	{MIRROR_SINGLE1,    MIRROR_SINGLE0},
 	{MIRROR_SINGLE0,    MIRROR_SINGLE1},
@@ -27,7 +8,7 @@ static enum mirror MIRROR[6][4] = {
 	{MIRROR_FOUR8,      MIRROR_FOUR16},
 };
 
-static struct mapper M[256] = {
+static const struct mapper M[256] = {
 	[0]   = {0x8000, 0xFFFF,  0, 0, 0,      0,    0, 0,    0, 0,    0,  0, false, 0,    0, 0},
 	[2]   = {0x8000, 0xFFFF, 16, 0, 0, 0x8000, 0xFF, 0,    0, 0,    0,  0, false, 0,    0, 0},
 	[3]   = {0x8000, 0xFFFF,  0, 8, 1,      0,    0, 0, 0x03, 0,    0,  0, false, 0,    0, 0},
@@ -67,6 +48,8 @@ static void mapper_init(struct cart *cart)
 {
 	uint16_t last_bank = (uint16_t) (cart->prg.rom.size / 0x4000) - 1;
 
+	cart->mapper = M[cart->hdr.mapper];
+
 	// UxROM style 16K bank setup
 	switch (cart->hdr.mapper) {
 		case 2:
@@ -95,20 +78,20 @@ static void mapper_init(struct cart *cart)
 	}
 
 	// default mirroring
-	if (M[cart->hdr.mapper].mirror_table > 0)
-		cart_map_ciram(&cart->chr, MIRROR[M[cart->hdr.mapper].mirror_table][0]);
+	if (cart->mapper.mirror_table > 0)
+		cart_map_ciram(&cart->chr, MIRROR[cart->mapper.mirror_table][0]);
 
 	// Holy Diver vs. that other game
 	if (cart->hdr.mapper == 78 && cart->hdr.nes2.submapper == 1)
-		M[78].mirror_table = 2;
+		cart->mapper.mirror_table = 2;
 
 	//BNROM vs. NINA-001
 	if (cart->hdr.mapper == 34 && cart->chr.rom.size > 8) {
-		M[34].reg_low = 0x7FFD;
-		M[34].reg_high = 0x7FFF;
-		M[34].prg_mask = 0x01;
-		M[34].chr0_mask = 0x0F;
-		M[34].chr1_mask = 0x0F;
+		cart->mapper.reg_low = 0x7FFD;
+		cart->mapper.reg_high = 0x7FFF;
+		cart->mapper.prg_mask = 0x01;
+		cart->mapper.chr0_mask = 0x0F;
+		cart->mapper.chr1_mask = 0x0F;
 	}
 
 	// default SRAM
@@ -125,7 +108,7 @@ static void mapper_prg_write(struct cart *cart, uint16_t addr, uint8_t v)
 	if (cart->hdr.nes2.submapper == 2)
 		v = cart_bus_conflict(&cart->prg, addr, v);
 
-	struct mapper *m = &M[cart->hdr.mapper];
+	struct mapper *m = &cart->mapper;
 
 	bool addr_match = (addr >= m->reg_low && addr <= m->reg_high) || (addr & m->reg_low) == m->reg_high;
 	uint8_t chr_start = 0;
@@ -203,3 +186,20 @@ static bool mapper_block_2007(struct cart *cart)
 {
 	return cart->read_counter++ < 2;
 }
+
+static void mapper_ops_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uint8_t v)
+{
+	(void) cpu;
+	mapper_prg_write(cart, addr, v);
+}
+
+static const struct mapper_ops MAPPER = {
+	.init = mapper_init,
+	.prg_write = mapper_ops_prg_write,
+};
+
+static const struct mapper_ops MAPPER_185 = {
+	.init = mapper_init,
+	.prg_write = mapper_ops_prg_write,
+	.block_2007 = mapper_block_2007,
+};
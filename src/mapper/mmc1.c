@@ -131,3 +131,14 @@ static void mmc1_prg_write(struct cart *cart, uint16_t addr, uint8_t v)
 		}
 	}
 }
+
+static void mmc1_ops_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uint8_t v)
+{
+	(void) cpu;
+	mmc1_prg_write(cart, addr, v);
+}
+
+static const struct mapper_ops MMC1 = {
+	.init = mmc1_init,
+	.prg_write = mmc1_ops_prg_write,
+};
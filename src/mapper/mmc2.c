@@ -75,3 +75,26 @@ static void mmc2_prg_write(struct cart *cart, uint16_t addr, uint8_t v)
 		}
 	}
 }
+
+static void mmc2_ops_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uint8_t v)
+{
+	(void) cpu;
+	mmc2_prg_write(cart, addr, v);
+}
+
+static uint8_t mmc2_ops_chr_read(struct cart *cart, uint16_t addr, enum mem type, bool nt)
+{
+	(void) type;
+	(void) nt;
+
+	if (addr < 0x2000)
+		mmc2_chr_read(cart, addr);
+
+	return map_read(&cart->chr, 0, addr, NULL);
+}
+
+static const struct mapper_ops MMC2 = {
+	.init = mmc2_init,
+	.prg_write = mmc2_ops_prg_write,
+	.chr_read = mmc2_ops_chr_read,
+};
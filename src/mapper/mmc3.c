@@ -67,7 +67,7 @@ static void mmc3_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, ui
 					cart_map_ciram(&cart->chr, (v & 0x01) ? MIRROR_HORIZONTAL : MIRROR_VERTICAL);
 				break;
 			case 0xA001: // RAM protect
-				nes_log("MMC3 RAM protect: %x", v);
+				nes_log(cart->nes, "MMC3 RAM protect: %x", v);
 				break;
 			case 0xC000:
 				cart->irq.period = v;
@@ -83,7 +83,7 @@ static void mmc3_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, ui
 				cart->irq.enable = true;
 				break;
 			default:
-				nes_log("Uncaught MMC3 write %X: %X", addr, v);
+				nes_log(cart->nes, "Uncaught MMC3 write %X: %X", addr, v);
 				break;
 		}
 	}
@@ -94,9 +94,15 @@ static void mmc3_ppu_a12_toggle(struct cart *cart)
 	cart->irq.pending = true;
 }
 
-static void mmc3_step(struct cart *cart, struct cpu *cpu)
+static uint64_t mmc3_next_irq(struct cart *cart)
 {
-	if (cart->irq.pending) {
+	// an A12 rise is handled at the end of the cycle it happened on
+	return cart->irq.pending ? 1 : 0;
+}
+
+static void mmc3_step(struct cart *cart, struct cpu *cpu, uint64_t cycles)
+{
+	if (cart->irq.pending && cycles > 0) {
 		bool set_irq = true;
 
 		if (cart->irq.counter == 0 || cart->irq.reload) {
@@ -116,3 +122,11 @@ static void mmc3_step(struct cart *cart, struct cpu *cpu)
 		cart->irq.pending = false;
 	}
 }
+
+static const struct mapper_ops MMC3 = {
+	.init = mmc3_init,
+	.prg_write = mmc3_prg_write,
+	.ppu_a12_toggle = mmc3_ppu_a12_toggle,
+	.step = mmc3_step,
+	.next_irq = mmc3_next_irq,
+};
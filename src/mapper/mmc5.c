@@ -63,7 +63,7 @@ static void mmc5_map_chr(struct cart *cart, int32_t slot, uint16_t bank, enum me
 			cart_map(&cart->chr, type | ram, (uint16_t) (slot * 0x0400), bank, 1);
 			break;
 		default:
-			nes_log("Unsupported CHR mode %x", cart->chr_mode);
+			nes_log(cart->nes, "Unsupported CHR mode %x", cart->chr_mode);
 	}
 }
 
@@ -188,7 +188,7 @@ static void mmc5_prg_write(struct cart *cart, uint16_t addr, uint8_t v)
 			case 0x5800: //Just Breed unknown
 				break;
 			default:
-				nes_log("Uncaught MMC5 write %x", addr);
+				nes_log(cart->nes, "Uncaught MMC5 write %x", addr);
 		}
 
 	} else {
@@ -252,7 +252,7 @@ static uint8_t mmc5_prg_read(struct cart *cart, struct cpu *cpu, uint16_t addr,
 			case 0x5206:
 				return (cart->mmc5.multiplier * cart->mmc5.multiplicand) >> 8;
 			default:
-				nes_log("Uncaught MMC5 read %x", addr);
+				nes_log(cart->nes, "Uncaught MMC5 read %x", addr);
 				break;
 		}
 	}
@@ -385,3 +385,26 @@ static void mmc5_scanline(struct cart *cart, struct cpu *cpu, uint16_t scanline)
 	if (scanline == 0)
 		cart->mmc5.vs.scroll = cart->mmc5.vs.scroll_reload;
 }
+
+static void mmc5_ops_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uint8_t v)
+{
+	(void) cpu;
+	mmc5_prg_write(cart, addr, v);
+}
+
+static uint8_t mmc5_ops_chr_read(struct cart *cart, uint16_t addr, enum mem type, bool nt)
+{
+	if (addr < 0x2000)
+		return mmc5_chr_read(cart, addr, type);
+
+	return mmc5_nt_read_hook(cart, addr, type, nt);
+}
+
+static const struct mapper_ops MMC5 = {
+	.init = mmc5_init,
+	.prg_read = mmc5_prg_read,
+	.prg_write = mmc5_ops_prg_write,
+	.chr_read = mmc5_ops_chr_read,
+	.ppu_write_hook = mmc5_ppu_write_hook,
+	.ppu_scanline_hook = mmc5_scanline,
+};
@@ -80,7 +80,7 @@ static void namco_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, u
 			case 0xF800: //Expansion audio etc.
 				break;
 			default:
-				nes_log("Uncaught Namco 163/129 write %x: %x", addr, v);
+				nes_log(cart->nes, "Uncaught Namco 163/129 write %x: %x", addr, v);
 		}
 	}
 }
@@ -108,12 +108,41 @@ static uint8_t namco_prg_read(struct cart *cart, uint16_t addr, bool *mem_hit)
 	return 0;
 }
 
-static void namco_step(struct cart *cart, struct cpu *cpu)
+static uint64_t namco_next_irq(struct cart *cart)
+{
+	if (!cart->irq.enable)
+		return 0;
+
+	// the counter counts up and fires when it reaches 0x7FFE
+	uint16_t n = 0x7FFE - cart->irq.counter;
+
+	return n == 0 ? 0x10000 : n;
+}
+
+static void namco_step(struct cart *cart, struct cpu *cpu, uint64_t cycles)
 {
 	if (cart->irq.enable) {
-		if (++cart->irq.counter == 0x7FFE) {
+		if (cycles >= namco_next_irq(cart)) {
+			cart->irq.counter = 0x7FFE;
 			cpu_irq(cpu, IRQ_MAPPER, true);
 			cart->irq.enable = false;
+
+		} else {
+			cart->irq.counter += (uint16_t) cycles;
 		}
 	}
 }
+
+static uint8_t namco_ops_prg_read(struct cart *cart, struct cpu *cpu, uint16_t addr, bool *mem_hit)
+{
+	(void) cpu;
+	return namco_prg_read(cart, addr, mem_hit);
+}
+
+static const struct mapper_ops NAMCO = {
+	.init = namco_init,
+	.prg_read = namco_ops_prg_read,
+	.prg_write = namco_prg_write,
+	.step = namco_step,
+	.next_irq = namco_next_irq,
+};
@@ -202,35 +202,96 @@ static void vrc_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, uin
 				vrc_ack_irq(cart, cpu);
 				break;
 			default:
-				nes_log("Uncaught VRC2/4 write %x: %x", addr, v);
+				nes_log(cart->nes, "Uncaught VRC2/4 write %x: %x", addr, v);
 		}
 	}
 }
 
-static void vrc_step(struct cart *cart, struct cpu *cpu)
+// the prescaler counts down 3 per cycle and wraps every 341 / 3 cycles, clocking the
+// counter in scanline mode -- in cycle mode the counter is clocked every cycle
+
+static uint64_t vrc_prescaler_step(struct cart *cart, uint64_t cycles)
+{
+	uint64_t wraps = 0;
+
+	while (cycles > 0) {
+		if (cart->irq.scanline <= 0) {
+			cart->irq.scanline += 341 - 3;
+			wraps++;
+			cycles--;
+
+		} else {
+			uint64_t n = (cart->irq.scanline + 2) / 3;
+			if (n > cycles) n = cycles;
+
+			cart->irq.scanline -= (int16_t) (n * 3);
+			cycles -= n;
+		}
+	}
+
+	return wraps;
+}
+
+static void vrc_step(struct cart *cart, struct cpu *cpu, uint64_t cycles)
 {
 	if (cart->vrc.is2)
 		return;
 
-	bool clock = false;
+	uint64_t wraps = vrc_prescaler_step(cart, cycles);
+	uint64_t clocks = cart->irq.cycle ? cycles : wraps;
 
-	if (cart->irq.cycle)
-		clock = true;
+	while (cart->irq.enable && clocks > 0) {
+		uint64_t to_irq = 0x100 - cart->irq.counter;
+
+		if (clocks < to_irq) {
+			cart->irq.counter += (uint16_t) clocks;
+			break;
+		}
 
-	if (cart->irq.scanline <= 0) {
-		if (!cart->irq.cycle)
-			clock = true;
-		cart->irq.scanline += 341;
+		cpu_irq(cpu, IRQ_MAPPER, true);
+		cart->irq.counter = cart->irq.value;
+		clocks -= to_irq;
 	}
-	cart->irq.scanline -= 3;
+}
 
-	if (cart->irq.enable && clock) {
-		if (cart->irq.counter == 0xFF) {
-			cpu_irq(cpu, IRQ_MAPPER, true);
-			cart->irq.counter = cart->irq.value;
+static uint64_t vrc_next_irq(struct cart *cart)
+{
+	if (cart->vrc.is2 || !cart->irq.enable)
+		return 0;
 
-		} else {
-			cart->irq.counter++;
+	uint64_t to_irq = 0x100 - cart->irq.counter;
+
+	if (cart->irq.cycle)
+		return to_irq;
+
+	// walk the prescaler wraps, at most 256 of them
+	int32_t scanline = cart->irq.scanline;
+	uint64_t cycles = 0;
+
+	while (true) {
+		if (scanline > 0) {
+			int32_t n = (scanline + 2) / 3;
+			scanline -= n * 3;
+			cycles += n;
 		}
+
+		cycles++;
+		scanline += 341 - 3;
+
+		if (--to_irq == 0)
+			return cycles;
 	}
 }
+
+static const struct mapper_ops VRC2_4 = {
+	.init = vrc2_4_init,
+	.prg_write = vrc_prg_write,
+	.step = vrc_step,
+	.next_irq = vrc_next_irq,
+};
+
+// mapper 22 (VRC2a) has no IRQ
+static const struct mapper_ops VRC22 = {
+	.init = vrc2_4_init,
+	.prg_write = vrc_prg_write,
+};
@@ -137,7 +137,14 @@ static void vrc6_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, ui
 				vrc_ack_irq(cart, cpu);
 				break;
 			default:
-				nes_log("Uncaught VRC6 write %x: %x", addr, v);
+				nes_log(cart->nes, "Uncaught VRC6 write %x: %x", addr, v);
 		}
 	}
 }
+
+static const struct mapper_ops VRC6 = {
+	.init = vrc_init,
+	.prg_write = vrc6_prg_write,
+	.step = vrc_step,
+	.next_irq = vrc_next_irq,
+};
@@ -49,7 +49,14 @@ static void vrc7_prg_write(struct cart *cart, struct cpu *cpu, uint16_t addr, ui
 				vrc_ack_irq(cart, cpu);
 				break;
 			default:
-				nes_log("Uncaught VRC7 write %x: %x", addr, v);
+				nes_log(cart->nes, "Uncaught VRC7 write %x: %x", addr, v);
 		}
 	}
 }
+
+static const struct mapper_ops VRC7 = {
+	.init = vrc_init,
+	.prg_write = vrc7_prg_write,
+	.step = vrc_step,
+	.next_irq = vrc_next_irq,
+};
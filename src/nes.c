@@ -17,7 +17,19 @@
 #include "ppu.h"
 #include "apu.h"
 
+#define PAGE_SHIFT 10
+#define PAGE_MASK  0x03FF
+#define NUM_PAGES  64
+
+enum nes_event {
+	EVENT_CART_IRQ = 0,
+	NUM_EVENTS,
+};
+
 struct nes {
+	uint8_t *page[NUM_PAGES];
+
+	// everything from ram through next_event is saved as one block
 	uint8_t ram[0x0800];
 	uint8_t io_open_bus;
 
@@ -26,11 +38,8 @@ struct nes {
 	uint32_t controller_bits[2];
 	uint8_t buttons[4];
 	uint8_t safe_buttons[4];
-
-	struct cart *cart;
-	struct cpu *cpu;
-	struct ppu *ppu;
-	struct apu *apu;
+	bool polled;
+	bool lag;
 
 	bool odd_cycle;
 	uint32_t frame_count;
@@ -39,9 +48,43 @@ struct nes {
 	uint64_t cycle;
 	uint64_t cycle_2007;
 
+	uint32_t ppu_pending;
+	uint32_t ppu_deadline;
+	bool a12_hook;
+	bool scanline_hook;
+
+	uint32_t apu_pending;
+	uint32_t apu_deadline;
+
+	uint64_t events[NUM_EVENTS];
+	uint64_t next_event;
+
+	struct cart *cart;
+	struct cpu *cpu;
+	struct ppu *ppu;
+	struct apu *apu;
+
 	void *opaque;
 	FRAME_CALLBACK new_frame;
+	INDEX_CALLBACK new_indexes;
+	SLICE_CALLBACK new_slice;
 	SAMPLE_CALLBACK new_samples;
+	INPUT_CALLBACK input_poll;
+	LOG_CALLBACK log;
+
+	// what the ppu/apu are handed, NULL while that output is suppressed
+	FRAME_CALLBACK frame_out;
+	INDEX_CALLBACK indexes_out;
+	SLICE_CALLBACK slice_out;
+	SAMPLE_CALLBACK samples_out;
+	bool video;
+
+	// set while the apu itself is running, DMC DMA cycles stolen from inside it step it right away
+	bool apu_stepping;
+
+	// what nes_run_until is waiting for and what has happened since it started
+	uint32_t until;
+	uint32_t fired;
 };
 
 
@@ -49,23 +92,21 @@ struct nes {
 
 #define MAX_LOG_LEN 1024
 
-static LOG_CALLBACK LOG = NULL;
-
-EXPORT void nes_set_log_callback(LOG_CALLBACK log_callback)
+EXPORT void nes_set_log_callback(struct nes *nes, LOG_CALLBACK log_callback)
 {
-	LOG = log_callback;
+	nes->log = log_callback;
 }
 
-void nes_log(const char *fmt, ...)
+void nes_log(struct nes *nes, const char *fmt, ...)
 {
-	if (LOG) {
+	if (nes->log) {
 		va_list args;
 		va_start(args, fmt);
 
 		char str[MAX_LOG_LEN];
 		vsnprintf(str, MAX_LOG_LEN, fmt, args);
 
-		LOG(str);
+		nes->log(str, nes->opaque);
 
 		va_end(args);
 	}
@@ -130,34 +171,196 @@ static uint8_t nes_controller_read(struct nes *nes, uint8_t n)
 static void nes_controller_write(struct nes *nes, bool strobe)
 {
 	if (nes->controller_strobe && !strobe) {
+		// the host gets to set the buttons right as the game latches them
+		if (nes->input_poll)
+			nes->input_poll(nes->opaque);
+
+		nes->polled = true;
 		nes->controller_bits[0] = nes->controller_state[0];
 		nes->controller_bits[1] = nes->controller_state[1];
+		nes->fired |= NES_UNTIL_INPUT;
 	}
 
 	nes->controller_strobe = strobe;
 }
 
+EXPORT void nes_set_input_callback(struct nes *nes, INPUT_CALLBACK input_poll)
+{
+	nes->input_poll = input_poll;
+}
+
+EXPORT bool nes_lag_frame(struct nes *nes)
+{
+	return nes->lag;
+}
+
+
+/*** SCHEDULER ***/
+
+// events fire at the end of the cpu cycle they are scheduled for, UINT64_MAX is never
+
+static void nes_schedule(struct nes *nes, enum nes_event event, uint64_t cycle)
+{
+	nes->events[event] = cycle;
+	nes->next_event = UINT64_MAX;
+
+	for (uint8_t x = 0; x < NUM_EVENTS; x++)
+		if (nes->events[x] < nes->next_event)
+			nes->next_event = nes->events[x];
+}
+
+static void nes_cart_schedule(struct nes *nes)
+{
+	nes_schedule(nes, EVENT_CART_IRQ, cart_next_irq(nes->cart));
+}
+
+static void nes_run_events(struct nes *nes)
+{
+	if (nes->events[EVENT_CART_IRQ] <= nes->cycle) {
+		cart_step(nes->cart, nes->cpu, nes->cycle + 1);
+		nes_cart_schedule(nes);
+	}
+}
+
+
+/*** PPU CATCH-UP ***/
+
+// the ppu runs behind the cpu and only catches up when its state can be observed: cpu accesses
+// to the ppu or cart, new frames, the vblank NMI, and mapper A12/scanline hooks
+
+static void nes_ppu_catch_up(struct nes *nes)
+{
+	// A12 rises are clocked by the cart at the end of the current cycle
+	if (nes->a12_hook)
+		cart_step(nes->cart, nes->cpu, nes->cycle);
+
+	if (nes->ppu_pending > 0) {
+		uint8_t frames = ppu_run(nes->ppu, nes->cpu, nes->cart, nes->ppu_pending,
+			nes->frame_out, nes->indexes_out, nes->slice_out, nes->opaque);
+		nes->ppu_pending = 0;
+
+		if (frames > 0) {
+			nes->frame_count += frames;
+			nes->lag = !nes->polled;
+			nes->polled = false;
+		}
+
+		if (nes->a12_hook)
+			nes_cart_schedule(nes);
+	}
+}
+
+static void nes_ppu_sync(struct nes *nes)
+{
+	nes_ppu_catch_up(nes);
+
+	// the access may change the ppu's next deadline, recalculate it on the next dot
+	nes->ppu_deadline = 0;
+}
+
+static void nes_ppu_tick(struct nes *nes, uint32_t dots)
+{
+	nes->ppu_pending += dots;
+
+	if (nes->ppu_pending >= nes->ppu_deadline) {
+		nes_ppu_catch_up(nes);
+		nes->ppu_deadline = ppu_deadline(nes->ppu, nes->a12_hook, nes->scanline_hook, nes->slice_out != NULL);
+	}
+}
+
+
+/*** APU CATCH-UP ***/
+
+// the apu runs behind the cpu the same way, catching up on $4015 reads, register writes, frame IRQs,
+// DMC DMAs and the end of each frame
+
+static void nes_apu_samples(int16_t *samples, size_t count, void *opaque)
+{
+	struct nes *nes = opaque;
+
+	nes->fired |= NES_UNTIL_AUDIO;
+	nes->samples_out(samples, count, nes->opaque);
+}
+
+static void nes_apu_catch_up(struct nes *nes)
+{
+	if (nes->apu_pending > 0) {
+		uint32_t cycles = nes->apu_pending;
+		nes->apu_pending = 0;
+
+		bool stepping = nes->apu_stepping;
+		nes->apu_stepping = true;
+		apu_run(nes->apu, nes, nes->cpu, cycles, nes->samples_out ? nes_apu_samples : NULL, nes);
+		nes->apu_stepping = stepping;
+	}
+}
+
+static void nes_apu_sync(struct nes *nes)
+{
+	nes_apu_catch_up(nes);
+
+	// the access may change the apu's next deadline, recalculate it on the next cycle
+	nes->apu_deadline = 0;
+}
+
+static void nes_apu_tick(struct nes *nes)
+{
+	nes->apu_pending++;
+
+	if (nes->apu_stepping) {
+		nes_apu_catch_up(nes);
+
+	} else if (nes->apu_pending >= nes->apu_deadline) {
+		nes_apu_catch_up(nes);
+		nes->apu_deadline = apu_next_event(nes->apu, (nes->until & NES_UNTIL_AUDIO) && nes->samples_out);
+	}
+}
+
 
 /*** MEMORY READ & WRITE ***/
 
 // https://wiki.nesdev.com/w/index.php/CPU_memory_map
 
+// RAM and cart PRG at $6000 and above are read directly through 1KB pages, a NULL page
+// falls back to the I/O registers and mapper handlers
+
+static void nes_map_ram(struct nes *nes)
+{
+	for (uint8_t x = 0; x < (0x2000 >> PAGE_SHIFT); x++)
+		nes->page[x] = nes->ram + ((x << PAGE_SHIFT) % 0x0800);
+}
+
+static void nes_unmap_cart(struct nes *nes)
+{
+	for (uint8_t x = (0x2000 >> PAGE_SHIFT); x < NUM_PAGES; x++)
+		nes->page[x] = NULL;
+}
+
 uint8_t nes_read(struct nes *nes, uint16_t addr)
 {
-	if (addr < 0x2000) {
-		return nes->ram[addr % 0x0800];
+	uint8_t *page = nes->page[addr >> PAGE_SHIFT];
+
+	if (page) {
+		return page[addr & PAGE_MASK];
 
 	} else if (addr < 0x4000) {
 		addr = 0x2000 + addr % 8;
+		nes_ppu_sync(nes);
 
 		// double 2007 read glitch and mapper 185 copy protection
 		if (addr == 0x2007 && (nes->cycle - nes->cycle_2007 == 1 || cart_block_2007(nes->cart)))
 			return ppu_read(nes->ppu, nes->cpu, nes->cart, 0x2003);
 
 		nes->cycle_2007 = nes->cycle;
-		return ppu_read(nes->ppu, nes->cpu, nes->cart, addr);
+		uint8_t v = ppu_read(nes->ppu, nes->cpu, nes->cart, addr);
+
+		if (nes->a12_hook)
+			nes_cart_schedule(nes);
+
+		return v;
 
 	} else if (addr == 0x4015) {
+		nes_apu_sync(nes);
 		nes->io_open_bus = apu_read_status(nes->apu, nes->cpu);
 		return nes->io_open_bus;
 
@@ -166,8 +369,12 @@ uint8_t nes_read(struct nes *nes, uint16_t addr)
 		return nes->io_open_bus;
 
 	} else if (addr >= 0x4020) {
+		if (addr < 0x6000)
+			nes_ppu_sync(nes);
+
 		bool mem_hit = false;
-		uint8_t v = cart_prg_read(nes->cart, nes->cpu, addr, &mem_hit);
+		uint8_t v = cart_prg_read(nes->cart, nes->cpu, nes->cycle, addr, &mem_hit);
+		nes_cart_schedule(nes);
 
 		if (mem_hit) return v;
 	}
@@ -178,8 +385,12 @@ uint8_t nes_read(struct nes *nes, uint16_t addr)
 uint8_t nes_read_dmc(struct nes *nes, uint16_t addr)
 {
 	if (nes->read_addr == 0x2007) {
+		nes_ppu_sync(nes);
 		ppu_read(nes->ppu, nes->cpu, nes->cart, 0x2007);
 		ppu_read(nes->ppu, nes->cpu, nes->cart, 0x2007);
+
+		if (nes->a12_hook)
+			nes_cart_schedule(nes);
 	}
 
 	if (nes->read_addr == 0x4016)
@@ -195,13 +406,22 @@ void nes_write(struct nes *nes, uint16_t addr, uint8_t v)
 
 	} else if (addr < 0x4000) {
 		addr = 0x2000 + addr % 8;
+		nes_ppu_sync(nes);
 
 		ppu_write(nes->ppu, nes->cpu, nes->cart, addr, v);
 		cart_ppu_write_hook(nes->cart, addr, v); //MMC5 listens here
 
+		if (nes->a12_hook)
+			nes_cart_schedule(nes);
+
 	} else if (addr < 0x4014 || addr == 0x4015 || addr == 0x4017) {
 		nes->io_open_bus = v;
+		nes_apu_sync(nes);
+
+		// a $4015 write can start a DMC DMA
+		nes->apu_stepping = true;
 		apu_write(nes->apu, nes, nes->cpu, addr, v);
+		nes->apu_stepping = false;
 
 	} else if (addr == 0x4014) {
 		nes->io_open_bus = v;
@@ -215,7 +435,9 @@ void nes_write(struct nes *nes, uint16_t addr, uint8_t v)
 		nes->io_open_bus = v;
 
 	} else {
-		cart_prg_write(nes->cart, nes->cpu, addr, v);
+		nes_ppu_sync(nes);
+		cart_prg_write(nes->cart, nes->cpu, nes->cycle, addr, v);
+		nes_cart_schedule(nes);
 	}
 }
 
@@ -239,16 +461,15 @@ void nes_pre_tick_write(struct nes *nes, uint16_t addr)
 {
 	nes->write_addr = addr;
 
-	nes->frame_count += ppu_step(nes->ppu, nes->cpu, nes->cart, nes->new_frame, nes->opaque);
-	nes->frame_count += ppu_step(nes->ppu, nes->cpu, nes->cart, nes->new_frame, nes->opaque);
-	nes->frame_count += ppu_step(nes->ppu, nes->cpu, nes->cart, nes->new_frame, nes->opaque);
+	nes_ppu_tick(nes, 3);
 
-	apu_step(nes->apu, nes, nes->cpu, nes->new_samples, nes->opaque);
+	nes_apu_tick(nes);
 }
 
 void nes_post_tick_write(struct nes *nes)
 {
-	cart_step(nes->cart, nes->cpu);
+	if (nes->cycle >= nes->next_event)
+		nes_run_events(nes);
 
 	nes->cycle++;
 	nes->odd_cycle = !nes->odd_cycle;
@@ -259,17 +480,17 @@ void nes_pre_tick_read(struct nes *nes, uint16_t addr)
 {
 	nes->read_addr = addr;
 
-	nes->frame_count += ppu_step(nes->ppu, nes->cpu, nes->cart, nes->new_frame, nes->opaque);
-	nes->frame_count += ppu_step(nes->ppu, nes->cpu, nes->cart, nes->new_frame, nes->opaque);
+	nes_ppu_tick(nes, 2);
 
-	apu_step(nes->apu, nes, nes->cpu, nes->new_samples, nes->opaque);
+	nes_apu_tick(nes);
 }
 
 void nes_post_tick_read(struct nes *nes)
 {
-	nes->frame_count += ppu_step(nes->ppu, nes->cpu, nes->cart, nes->new_frame, nes->opaque);
+	nes_ppu_tick(nes, 1);
 
-	cart_step(nes->cart, nes->cpu);
+	if (nes->cycle >= nes->next_event)
+		nes_run_events(nes);
 
 	nes->cycle++;
 	nes->odd_cycle = !nes->odd_cycle;
@@ -282,6 +503,11 @@ void nes_tick(struct nes *nes)
 	nes_post_tick_read(nes);
 }
 
+EXPORT uint64_t nes_cycles(struct nes *nes)
+{
+	return nes->cycle;
+}
+
 
 /*** RUN ***/
 
@@ -289,6 +515,257 @@ EXPORT void nes_step(struct nes *nes)
 {
 	for (uint32_t frame_count = nes->frame_count; frame_count == nes->frame_count;)
 		cpu_step(nes->cpu, nes);
+
+	// hand over this frame's audio
+	nes_apu_sync(nes);
+}
+
+// the cpu cycle by which the ppu will have run the dot at (scanline, dot). the ppu gets 3 dots per
+// cpu cycle, the count assumes the odd frame skip so one more dot covers frames without it
+static uint64_t nes_ppu_cycle(struct nes *nes, uint16_t scanline, uint16_t dot)
+{
+	return nes->cycle + (ppu_dots_until(nes->ppu, scanline, dot) + 3) / 3;
+}
+
+EXPORT uint64_t nes_run_until(struct nes *nes, uint32_t until, uint16_t scanline, uint64_t max_cycles,
+	uint32_t *fired)
+{
+	uint64_t start = nes->cycle;
+	uint64_t end = max_cycles < UINT64_MAX - start ? start + max_cycles : UINT64_MAX;
+	uint32_t frame_count = nes->frame_count;
+
+	nes->until = until;
+	nes->fired = 0;
+
+	// vblank and scanlines are known ahead of time, the ppu is brought up to date to count to them
+	uint64_t vblank = UINT64_MAX;
+	uint64_t line = UINT64_MAX;
+
+	if (until & (NES_UNTIL_VBLANK | NES_UNTIL_SCANLINE)) {
+		nes_ppu_sync(nes);
+
+		if (until & NES_UNTIL_VBLANK)
+			vblank = nes_ppu_cycle(nes, 241, 1);
+
+		if (until & NES_UNTIL_SCANLINE)
+			line = nes_ppu_cycle(nes, scanline, 256);
+	}
+
+	// the apu otherwise runs well behind, the end of the next block of samples joins its deadlines
+	if (until & NES_UNTIL_AUDIO)
+		nes->apu_deadline = 0;
+
+	while (nes->cycle < end) {
+		cpu_step(nes->cpu, nes);
+
+		if (frame_count != nes->frame_count)
+			nes->fired |= NES_UNTIL_FRAME;
+
+		if (nes->cycle >= vblank)
+			nes->fired |= NES_UNTIL_VBLANK;
+
+		if (nes->cycle >= line)
+			nes->fired |= NES_UNTIL_SCANLINE;
+
+		if (nes->fired & until)
+			break;
+	}
+
+	if (until & (NES_UNTIL_VBLANK | NES_UNTIL_SCANLINE))
+		nes_ppu_sync(nes);
+
+	// audio goes out with whole frames, as with nes_step
+	if (frame_count != nes->frame_count)
+		nes_apu_sync(nes);
+
+	if (fired)
+		*fired = nes->fired & until;
+
+	nes->until = 0;
+
+	return nes->cycle - start;
+}
+
+EXPORT uint64_t nes_run_cycles(struct nes *nes, uint64_t cycles)
+{
+	return nes_run_until(nes, 0, 0, cycles, NULL);
+}
+
+EXPORT void nes_run_until_scanline(struct nes *nes, uint16_t scanline)
+{
+	nes_run_until(nes, NES_UNTIL_SCANLINE, scanline, UINT64_MAX, NULL);
+}
+
+static void nes_route_video(struct nes *nes)
+{
+	nes->frame_out = nes->video ? nes->new_frame : NULL;
+	nes->indexes_out = nes->video ? nes->new_indexes : NULL;
+	nes->slice_out = nes->frame_out ? nes->new_slice : NULL;
+}
+
+EXPORT void nes_set_output(struct nes *nes, bool video, bool audio)
+{
+	nes_apu_sync(nes);
+
+	nes->video = video;
+	nes_route_video(nes);
+	nes->samples_out = audio ? nes->new_samples : NULL;
+}
+
+
+/*** VIDEO ***/
+
+EXPORT void nes_set_index_callback(struct nes *nes, INDEX_CALLBACK new_indexes)
+{
+	// the frame being drawn keeps its format, the ppu switches once it has gone out
+	nes_ppu_sync(nes);
+
+	nes->new_indexes = new_indexes;
+	ppu_set_indexed(nes->ppu, new_indexes != NULL);
+	nes_route_video(nes);
+}
+
+EXPORT void nes_set_slice_callback(struct nes *nes, SLICE_CALLBACK new_slice, uint16_t rows)
+{
+	nes_ppu_sync(nes);
+
+	nes->new_slice = rows > 0 ? new_slice : NULL;
+	ppu_set_slice_rows(nes->ppu, rows);
+	nes_route_video(nes);
+}
+
+EXPORT void nes_get_palette(struct nes *nes, uint32_t *rgba)
+{
+	ppu_get_palette(nes->ppu, rgba);
+}
+
+
+/*** STATE ***/
+
+// a state is a small header followed by the nes block and each component, every section is
+// aligned so the component structs can be copied in and out with plain memcpys
+
+#define STATE_MAGIC   0x53444443 // "CDDS"
+#define STATE_ALIGN   16
+#define STATE_ALIGNED(n) (((n) + STATE_ALIGN - 1) & ~((size_t) STATE_ALIGN - 1))
+
+#define NES_STATE_OFFSET offsetof(struct nes, ram)
+#define NES_STATE_SIZE   (offsetof(struct nes, cart) - NES_STATE_OFFSET)
+
+enum state_section {
+	SECTION_NES  = 0,
+	SECTION_CPU  = 1,
+	SECTION_PPU  = 2,
+	SECTION_APU  = 3,
+	SECTION_CART = 4,
+	NUM_SECTIONS,
+};
+
+struct state_header {
+	uint32_t magic;
+	uint32_t rom_crc32; //states only load back into the ROM they were saved from
+	uint32_t size[NUM_SECTIONS];
+};
+
+static void nes_state_sizes(struct nes *nes, uint32_t *size)
+{
+	size[SECTION_NES] = (uint32_t) NES_STATE_SIZE;
+	size[SECTION_CPU] = (uint32_t) cpu_state_size();
+	size[SECTION_PPU] = (uint32_t) ppu_state_size();
+	size[SECTION_APU] = (uint32_t) apu_state_size(nes->apu);
+	size[SECTION_CART] = (uint32_t) cart_state_size(nes->cart);
+}
+
+EXPORT size_t nes_state_size(struct nes *nes)
+{
+	if (!nes->cart)
+		return 0;
+
+	uint32_t size[NUM_SECTIONS];
+	nes_state_sizes(nes, size);
+
+	size_t total = STATE_ALIGNED(sizeof(struct state_header));
+
+	for (uint8_t x = 0; x < NUM_SECTIONS; x++)
+		total += STATE_ALIGNED(size[x]);
+
+	return total;
+}
+
+EXPORT void nes_state_save(struct nes *nes, void *buf)
+{
+	if (!nes->cart)
+		return;
+
+	uint8_t *b = buf;
+
+	struct state_header hdr = {.magic = STATE_MAGIC, .rom_crc32 = cart_rom_crc32(nes->cart)};
+	nes_state_sizes(nes, hdr.size);
+
+	// zero the alignment padding so equal consoles save equal buffers
+	memset(b, 0, nes_state_size(nes));
+
+	memcpy(b, &hdr, sizeof(struct state_header));
+	b += STATE_ALIGNED(sizeof(struct state_header));
+
+	memcpy(b, (uint8_t *) nes + NES_STATE_OFFSET, NES_STATE_SIZE);
+	b += STATE_ALIGNED(hdr.size[SECTION_NES]);
+
+	cpu_state_save(nes->cpu, b);
+	b += STATE_ALIGNED(hdr.size[SECTION_CPU]);
+
+	ppu_state_save(nes->ppu, b);
+	b += STATE_ALIGNED(hdr.size[SECTION_PPU]);
+
+	apu_state_save(nes->apu, b);
+	b += STATE_ALIGNED(hdr.size[SECTION_APU]);
+
+	cart_state_save(nes->cart, b);
+}
+
+EXPORT bool nes_state_load(struct nes *nes, const void *buf, size_t len)
+{
+	if (!nes->cart || len < STATE_ALIGNED(sizeof(struct state_header)))
+		return false;
+
+	struct state_header hdr;
+	memcpy(&hdr, buf, sizeof(struct state_header));
+
+	uint32_t size[NUM_SECTIONS];
+	nes_state_sizes(nes, size);
+
+	// the state must come from this ROM and the fixed size sections must match this build
+	if (hdr.magic != STATE_MAGIC || hdr.rom_crc32 != cart_rom_crc32(nes->cart) ||
+		hdr.size[SECTION_NES] != size[SECTION_NES] || hdr.size[SECTION_CPU] != size[SECTION_CPU] ||
+		hdr.size[SECTION_PPU] != size[SECTION_PPU])
+		return false;
+
+	const uint8_t *section[NUM_SECTIONS];
+	const uint8_t *b = (const uint8_t *) buf;
+	uint64_t offset = STATE_ALIGNED(sizeof(struct state_header));
+
+	// the variable sections are sized by the header, all of them have to be inside the buffer
+	for (uint8_t x = 0; x < NUM_SECTIONS; x++) {
+		section[x] = b + offset;
+		offset += STATE_ALIGNED((uint64_t) hdr.size[x]);
+	}
+
+	if (offset > len)
+		return false;
+
+	// the apu and cart check their sections before anything is touched
+	if (!apu_state_valid(nes->apu, section[SECTION_APU], hdr.size[SECTION_APU]))
+		return false;
+
+	if (!cart_state_load(nes->cart, section[SECTION_CART], hdr.size[SECTION_CART]))
+		return false;
+
+	memcpy((uint8_t *) nes + NES_STATE_OFFSET, section[SECTION_NES], NES_STATE_SIZE);
+	cpu_state_load(nes->cpu, section[SECTION_CPU]);
+	ppu_state_load(nes->ppu, section[SECTION_PPU]);
+	apu_state_load(nes->apu, section[SECTION_APU], hdr.size[SECTION_APU]);
+
+	return true;
 }
 
 
@@ -302,19 +779,25 @@ EXPORT void nes_init(struct nes **nes_out, uint32_t sample_rate, bool stereo,
 	nes->opaque = opaque;
 	nes->new_frame = new_frame;
 	nes->new_samples = new_samples;
+	nes_set_output(nes, true, true);
 
 	cpu_init(&nes->cpu);
 	ppu_init(&nes->ppu);
 	apu_init(&nes->apu, sample_rate, stereo);
+
+	nes_map_ram(nes);
+	nes_schedule(nes, EVENT_CART_IRQ, UINT64_MAX);
 }
 
 EXPORT void nes_set_stereo(struct nes *nes, bool stereo)
 {
+	nes_apu_sync(nes);
 	apu_set_stereo(nes->apu, stereo);
 }
 
 EXPORT void nes_set_sample_rate(struct nes *nes, uint32_t sample_rate)
 {
+	nes_apu_sync(nes);
 	apu_set_sample_rate(nes->apu, sample_rate);
 }
 
@@ -335,10 +818,20 @@ EXPORT void nes_destroy(struct nes **nes_out)
 
 EXPORT void nes_reset(struct nes *nes, bool hard)
 {
+	nes_ppu_catch_up(nes);
+	nes->ppu_deadline = 0;
+	nes_apu_sync(nes);
+
+	// the cart keeps running across a reset, only its clock is rebased
+	cart_step(nes->cart, nes->cpu, nes->cycle);
+	cart_set_cycle(nes->cart, 0);
+
 	nes->odd_cycle = false;
 	nes->frame_count = 0;
+	nes->polled = nes->lag = false;
 	nes->read_addr = nes->write_addr = 0;
 	nes->cycle = nes->cycle_2007 = 0;
+	nes_cart_schedule(nes);
 
 	if (hard)
 		memset(nes->ram, 0, 0x0800);
@@ -347,15 +840,24 @@ EXPORT void nes_reset(struct nes *nes, bool hard)
 	apu_reset(nes->apu, nes, nes->cpu, hard);
 	cpu_reset(nes->cpu, nes, hard);
 
-	ppu_step(nes->ppu, nes->cpu, nes->cart, nes->new_frame, nes->opaque);
+	ppu_step(nes->ppu, nes->cpu, nes->cart, nes->frame_out, nes->indexes_out, nes->slice_out, nes->opaque);
 }
 
 EXPORT void nes_cart_load(struct nes *nes, uint8_t *rom, size_t rom_len,
 	uint8_t *sram, size_t sram_len, struct nes_header *hdr)
 {
-	if (nes->cart)
+	if (nes->cart) {
+		nes_ppu_catch_up(nes);
+		nes_apu_catch_up(nes);
+		nes_unmap_cart(nes);
 		cart_destroy(&nes->cart);
+	}
+
+	cart_init(&nes->cart, nes, rom, rom_len, sram, sram_len, hdr);
+	cart_map_pages(nes->cart, nes->page);
+	nes->a12_hook = cart_has_a12_hook(nes->cart);
+	nes->scanline_hook = cart_has_scanline_hook(nes->cart);
+	cart_set_cycle(nes->cart, nes->cycle);
 
-	cart_init(&nes->cart, rom, rom_len, sram, sram_len, hdr);
 	nes_reset(nes, true);
 }
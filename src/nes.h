@@ -24,6 +24,14 @@ enum nes_button {
 	NES_RIGHT   = 0x80,
 };
 
+enum nes_until {
+	NES_UNTIL_FRAME     = 0x01,
+	NES_UNTIL_VBLANK    = 0x02,
+	NES_UNTIL_SCANLINE  = 0x04,
+	NES_UNTIL_AUDIO     = 0x08,
+	NES_UNTIL_INPUT     = 0x10,
+};
+
 enum mirror {
 	MIRROR_HORIZONTAL = 0x00110011,
 	MIRROR_VERTICAL   = 0x01010101,
@@ -40,7 +48,10 @@ enum mirror {
 
 typedef void (*SAMPLE_CALLBACK)(int16_t *samples, size_t count, void *opaque);
 typedef void (*FRAME_CALLBACK)(uint32_t *pixels, void *opaque);
-typedef void (*LOG_CALLBACK)(char *str);
+typedef void (*INDEX_CALLBACK)(uint16_t *indexes, void *opaque);
+typedef void (*SLICE_CALLBACK)(uint32_t first_row, uint32_t row_count, const uint32_t *pixels, void *opaque);
+typedef void (*INPUT_CALLBACK)(void *opaque);
+typedef void (*LOG_CALLBACK)(char *str, void *opaque);
 
 struct nes_header {
 	size_t offset;
@@ -62,14 +73,22 @@ struct nes_header {
 };
 
 struct nes;
+struct nes_pool;
 
 /*** LOG ***/
-void nes_set_log_callback(LOG_CALLBACK log_callback);
-void nes_log(const char *fmt, ...);
+void nes_set_log_callback(struct nes *nes, LOG_CALLBACK log_callback);
+void nes_log(struct nes *nes, const char *fmt, ...);
 
 /*** CONTROLLER ***/
 void nes_controller(struct nes *nes, uint8_t player, enum nes_button button, bool down);
 
+// called as the game latches the controllers ($4016 strobe going 1 -> 0), buttons set through
+// nes_controller from inside it are the ones the game reads
+void nes_set_input_callback(struct nes *nes, INPUT_CALLBACK input_poll);
+
+// true when the controllers were never latched between the last frame handed over and the one before
+bool nes_lag_frame(struct nes *nes);
+
 /*** MEMORY READ & WRITE ***/
 uint8_t nes_read(struct nes *nes, uint16_t addr);
 uint8_t nes_read_dmc(struct nes *nes, uint16_t addr);
@@ -85,10 +104,55 @@ void nes_post_tick_write(struct nes *nes);
 void nes_pre_tick_read(struct nes *nes, uint16_t addr);
 void nes_post_tick_read(struct nes *nes);
 void nes_tick(struct nes *nes);
+uint64_t nes_cycles(struct nes *nes);
 
 /*** RUN ***/
 void nes_step(struct nes *nes);
 
+// runs until the ppu has drawn the given scanline (0-261) the next time around, a frame crossed on
+// the way is handed over as with nes_step
+void nes_run_until_scanline(struct nes *nes, uint16_t scanline);
+
+// the cpu only ever stops between instructions, so both of these run whole instructions and return
+// the cycles actually run. a run can go past its mark by the rest of an instruction or interrupt
+// (up to 7 cycles) plus any DMC DMA, or by ~514 cycles when the instruction starts an OAM DMA
+uint64_t nes_run_cycles(struct nes *nes, uint64_t cycles);
+
+// runs until one of the NES_UNTIL events happens or max_cycles run out, fired gets the events
+// that stopped it (0 on running out). FRAME is a frame handed over, VBLANK the vblank flag being
+// raised, SCANLINE the given scanline being drawn, AUDIO a block of samples handed over and
+// INPUT the game latching the controllers. audio from a frame crossed on the way is handed over
+// at the end as with nes_step
+uint64_t nes_run_until(struct nes *nes, uint32_t until, uint16_t scanline, uint64_t max_cycles,
+	uint32_t *fired);
+
+// suppressed frames still advance the console, they just skip drawing pixels / mixing samples
+void nes_set_output(struct nes *nes, bool video, bool audio);
+
+/*** VIDEO ***/
+// frames come out as 9-bit palette indexes instead of RGBA, the low 6 bits are the color and the
+// high 3 the emphasis bits, the RGBA frame callback is not called while this is set. a switch made
+// mid-frame applies from the next frame, the current one still goes out whole in its old format
+// (through the palette if the index callback was removed)
+void nes_set_index_callback(struct nes *nes, INDEX_CALLBACK new_indexes);
+
+// the 8 emphasis palettes of 64 colors each, an index looks itself up directly
+void nes_get_palette(struct nes *nes, uint32_t *rgba);
+
+// RGBA rows are handed over every rows scanlines as soon as they are drawn, pixels points at
+// first_row in the frame that the frame callback later receives and is read-only. only fires
+// alongside the RGBA frame callback, 0 rows turns it off
+void nes_set_slice_callback(struct nes *nes, SLICE_CALLBACK new_slice, uint16_t rows);
+
+/*** STATE ***/
+// the size can grow as the cart maps more RAM or the sample rate changes, check it before each save
+size_t nes_state_size(struct nes *nes);
+void nes_state_save(struct nes *nes, void *buf);
+
+// len is the size of buf, states that are truncated, corrupt or from another ROM are turned away
+// with the console left untouched
+bool nes_state_load(struct nes *nes, const void *buf, size_t len);
+
 /*** INIT & DESTROY ***/
 void nes_init(struct nes **nes_out, uint32_t sample_rate, bool stereo,
 	FRAME_CALLBACK new_frame, SAMPLE_CALLBACK new_samples, void *opaque);
@@ -98,3 +162,12 @@ void nes_destroy(struct nes **nes_out);
 void nes_reset(struct nes *nes, bool hard);
 void nes_cart_load(struct nes *nes, uint8_t *rom, size_t rom_len,
 	uint8_t *sram, size_t sram_len, struct nes_header *hdr);
+
+/*** POOL ***/
+// instances stay on the worker they were added to unless it falls behind,
+// callbacks fire on whichever worker stepped the instance
+void nes_pool_init(struct nes_pool **pool_out, uint32_t threads);
+void nes_pool_destroy(struct nes_pool **pool_out);
+void nes_pool_add(struct nes_pool *pool, struct nes *nes);
+void nes_pool_remove(struct nes_pool *pool, struct nes *nes);
+void nes_pool_step_all(struct nes_pool *pool);
@@ -0,0 +1,240 @@
+#include "nes.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+
+/*** THREADS ***/
+
+#if defined(_WIN32)
+	typedef HANDLE pool_thread;
+	typedef SRWLOCK pool_mutex;
+	typedef CONDITION_VARIABLE pool_cond;
+
+	#define POOL_THREAD_FUNC(name, arg) static DWORD WINAPI name(LPVOID arg)
+
+	static void pool_thread_create(pool_thread *t, LPTHREAD_START_ROUTINE func, void *arg)
+	{
+		*t = CreateThread(NULL, 0, func, arg, 0, NULL);
+	}
+
+	static void pool_thread_join(pool_thread *t)
+	{
+		WaitForSingleObject(*t, INFINITE);
+		CloseHandle(*t);
+	}
+
+	static void pool_mutex_init(pool_mutex *m)         {InitializeSRWLock(m);}
+	static void pool_mutex_destroy(pool_mutex *m)      {m;}
+	static void pool_mutex_lock(pool_mutex *m)         {AcquireSRWLockExclusive(m);}
+	static void pool_mutex_unlock(pool_mutex *m)       {ReleaseSRWLockExclusive(m);}
+	static void pool_cond_init(pool_cond *c)           {InitializeConditionVariable(c);}
+	static void pool_cond_destroy(pool_cond *c)        {c;}
+	static void pool_cond_wait(pool_cond *c, pool_mutex *m) {SleepConditionVariableSRW(c, m, INFINITE, 0);}
+	static void pool_cond_broadcast(pool_cond *c)      {WakeAllConditionVariable(c);}
+	static void pool_cond_signal(pool_cond *c)         {WakeConditionVariable(c);}
+
+	static int32_t pool_claim(volatile int32_t *next)
+	{
+		return InterlockedIncrement((volatile LONG *) next) - 1;
+	}
+#else
+	typedef pthread_t pool_thread;
+	typedef pthread_mutex_t pool_mutex;
+	typedef pthread_cond_t pool_cond;
+
+	#define POOL_THREAD_FUNC(name, arg) static void *name(void *arg)
+
+	static void pool_thread_create(pool_thread *t, void *(*func)(void *), void *arg)
+	{
+		pthread_create(t, NULL, func, arg);
+	}
+
+	static void pool_thread_join(pool_thread *t)
+	{
+		pthread_join(*t, NULL);
+	}
+
+	static void pool_mutex_init(pool_mutex *m)         {pthread_mutex_init(m, NULL);}
+	static void pool_mutex_destroy(pool_mutex *m)      {pthread_mutex_destroy(m);}
+	static void pool_mutex_lock(pool_mutex *m)         {pthread_mutex_lock(m);}
+	static void pool_mutex_unlock(pool_mutex *m)       {pthread_mutex_unlock(m);}
+	static void pool_cond_init(pool_cond *c)           {pthread_cond_init(c, NULL);}
+	static void pool_cond_destroy(pool_cond *c)        {pthread_cond_destroy(c);}
+	static void pool_cond_wait(pool_cond *c, pool_mutex *m) {pthread_cond_wait(c, m);}
+	static void pool_cond_broadcast(pool_cond *c)      {pthread_cond_broadcast(c);}
+	static void pool_cond_signal(pool_cond *c)         {pthread_cond_signal(c);}
+
+	static int32_t pool_claim(volatile int32_t *next)
+	{
+		return __atomic_fetch_add(next, 1, __ATOMIC_RELAXED);
+	}
+#endif
+
+
+/*** POOL ***/
+
+struct pool_worker {
+	struct nes_pool *pool;
+	pool_thread thread;
+	uint32_t index;
+
+	// instances pinned to this worker, the owner starts at the front and
+	// idle workers claim from the same counter once their own list is done
+	struct nes **nes;
+	uint32_t n;
+	uint32_t cap;
+	volatile int32_t next;
+};
+
+struct nes_pool {
+	struct pool_worker *workers;
+	uint32_t n_workers;
+
+	pool_mutex mutex;
+	pool_cond start;
+	pool_cond done;
+	uint64_t generation;
+	uint32_t running;
+	bool stop;
+};
+
+static void pool_worker_drain(struct pool_worker *w)
+{
+	for (int32_t x = pool_claim(&w->next); x < (int32_t) w->n; x = pool_claim(&w->next))
+		nes_step(w->nes[x]);
+}
+
+POOL_THREAD_FUNC(pool_worker_thread, opaque)
+{
+	struct pool_worker *w = opaque;
+	struct nes_pool *pool = w->pool;
+	uint64_t generation = 0;
+
+	while (true) {
+		pool_mutex_lock(&pool->mutex);
+
+		while (!pool->stop && pool->generation == generation)
+			pool_cond_wait(&pool->start, &pool->mutex);
+
+		bool stop = pool->stop;
+		generation = pool->generation;
+		pool_mutex_unlock(&pool->mutex);
+
+		if (stop)
+			break;
+
+		// own instances first, then steal from the workers that follow
+		for (uint32_t x = 0; x < pool->n_workers; x++)
+			pool_worker_drain(&pool->workers[(w->index + x) % pool->n_workers]);
+
+		pool_mutex_lock(&pool->mutex);
+
+		if (--pool->running == 0)
+			pool_cond_signal(&pool->done);
+
+		pool_mutex_unlock(&pool->mutex);
+	}
+
+	return 0;
+}
+
+void nes_pool_add(struct nes_pool *pool, struct nes *nes)
+{
+	struct pool_worker *w = &pool->workers[0];
+
+	for (uint32_t x = 1; x < pool->n_workers; x++)
+		if (pool->workers[x].n < w->n)
+			w = &pool->workers[x];
+
+	if (w->n == w->cap) {
+		w->cap = w->cap > 0 ? w->cap * 2 : 8;
+		w->nes = realloc(w->nes, w->cap * sizeof(struct nes *));
+	}
+
+	w->nes[w->n++] = nes;
+}
+
+void nes_pool_remove(struct nes_pool *pool, struct nes *nes)
+{
+	for (uint32_t x = 0; x < pool->n_workers; x++) {
+		struct pool_worker *w = &pool->workers[x];
+
+		for (uint32_t y = 0; y < w->n; y++) {
+			if (w->nes[y] == nes) {
+				w->nes[y] = w->nes[--w->n];
+				return;
+			}
+		}
+	}
+}
+
+void nes_pool_step_all(struct nes_pool *pool)
+{
+	pool_mutex_lock(&pool->mutex);
+
+	for (uint32_t x = 0; x < pool->n_workers; x++)
+		pool->workers[x].next = 0;
+
+	pool->running = pool->n_workers;
+	pool->generation++;
+	pool_cond_broadcast(&pool->start);
+
+	while (pool->running > 0)
+		pool_cond_wait(&pool->done, &pool->mutex);
+
+	pool_mutex_unlock(&pool->mutex);
+}
+
+
+/*** INIT & DESTROY ***/
+
+void nes_pool_init(struct nes_pool **pool_out, uint32_t threads)
+{
+	struct nes_pool *pool = *pool_out = calloc(1, sizeof(struct nes_pool));
+
+	pool->n_workers = threads > 0 ? threads : 1;
+	pool->workers = calloc(pool->n_workers, sizeof(struct pool_worker));
+
+	pool_mutex_init(&pool->mutex);
+	pool_cond_init(&pool->start);
+	pool_cond_init(&pool->done);
+
+	for (uint32_t x = 0; x < pool->n_workers; x++) {
+		struct pool_worker *w = &pool->workers[x];
+
+		w->pool = pool;
+		w->index = x;
+		pool_thread_create(&w->thread, pool_worker_thread, w);
+	}
+}
+
+void nes_pool_destroy(struct nes_pool **pool_out)
+{
+	if (!pool_out || !*pool_out) return;
+
+	struct nes_pool *pool = *pool_out;
+
+	pool_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pool_cond_broadcast(&pool->start);
+	pool_mutex_unlock(&pool->mutex);
+
+	for (uint32_t x = 0; x < pool->n_workers; x++) {
+		pool_thread_join(&pool->workers[x].thread);
+		free(pool->workers[x].nes);
+	}
+
+	pool_cond_destroy(&pool->done);
+	pool_cond_destroy(&pool->start);
+	pool_mutex_destroy(&pool->mutex);
+
+	free(pool->workers);
+	free(*pool_out);
+	*pool_out = NULL;
+}
@@ -2,8 +2,26 @@
 
 #include <stdlib.h>
 #include <string.h>
-
-static uint32_t PALETTE[64] = {
+#include <stddef.h>
+
+#if !defined(PPU_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+	#define PPU_SSE2
+	#include <emmintrin.h>
+	#include <immintrin.h>
+
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define PPU_AVX2
+	#else
+		#define PPU_AVX2 __attribute__((target("avx2")))
+	#endif
+
+#elif !defined(PPU_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+	#define PPU_NEON
+	#include <arm_neon.h>
+#endif
+
+static const uint32_t PALETTE[64] = {
 	0xFF6A6D6A, 0xFF801300, 0xFF8A001E, 0xFF7A0039, 0xFF560055, 0xFF18005A, 0xFF00104F, 0xFF001C3D,
 	0xFF003225, 0xFF003D00, 0xFF004000, 0xFF243900, 0xFF552E00, 0xFF000000, 0xFF000000, 0xFF000000,
 	0xFFB9BCB9, 0xFFC75018, 0xFFE3304B, 0xFFD62273, 0xFFA91F95, 0xFF5C289D, 0xFF003798, 0xFF004C7F,
@@ -14,7 +32,7 @@ static uint32_t PALETTE[64] = {
 	0xFFAAF0F1, 0xFFA9FADA, 0xFFBCFFC9, 0xFFD7FBC3, 0xFFF6F6C4, 0xFFBEC1BE, 0xFF000000, 0xFF000000,
 };
 
-static float EMPHASIS[8][3] = {
+static const float EMPHASIS[8][3] = {
 	{1.00f, 1.00f, 1.00f}, // 000 Black
 	{1.00f, 0.85f, 0.85f}, // 001 Red
 	{0.85f, 1.00f, 0.85f}, // 010 Green
@@ -25,7 +43,7 @@ static float EMPHASIS[8][3] = {
 	{0.70f, 0.70f, 0.70f}, // 111 White
 };
 
-static uint8_t POWER_UP_PALETTE[32] = {
+static const uint8_t POWER_UP_PALETTE[32] = {
 	0x09, 0x01, 0x00, 0x01, 0x00, 0x02, 0x02, 0x0D, 0x08, 0x10, 0x08, 0x24, 0x00, 0x00, 0x04, 0x2C,
 	0x09, 0x01, 0x34, 0x03, 0x00, 0x04, 0x00, 0x14, 0x08, 0x3A, 0x00, 0x02, 0x00, 0x20, 0x2C, 0x08,
 };
@@ -61,17 +79,37 @@ struct sprite {
 	uint8_t id;
 };
 
+// one plane per field so the compositor can load 16 or 32 dots at once
 struct spr {
-	uint8_t color;
-	bool priority;
-	bool sprite0;
+	uint8_t color[256];
+	bool priority[256];
+	bool sprite0[256];
+};
+
+// the inputs of one line, the masks cover clipping of the leftmost 8 dots
+struct layers {
+	const uint8_t *bg; //already offset by fine x
+	const struct spr *spr;
+	uint8_t bg_mask[32]; //dots past 31 use the last entry
+	uint8_t spr_mask[32];
 };
 
 struct ppu {
-	uint32_t pixels[256 * 240];
+	union {
+		uint32_t pixels[256 * 240];
+		uint16_t indexes[256 * 240];
+	} frame;
+
 	uint32_t palettes[8][64];
 	uint32_t *palette;
+	bool indexed;      //the frame holds emphasis << 6 | color instead of RGBA
+	bool next_indexed; //the format the frontend asked for, latched between frames
+
+	bool (*compose)(uint8_t *line, const struct layers *layers);
+	void (*lookup)(uint32_t *pixels, const uint8_t *line, const uint32_t *colors);
+	uint16_t slice_rows;
 
+	// everything below is saved as one block
 	uint8_t palette_ram[32];
 	uint8_t oam[256];
 	uint8_t soam[8][4];
@@ -115,7 +153,7 @@ struct ppu {
 	uint8_t eval_step;
 	bool overflow;
 	struct sprite sprites[8];
-	struct spr spr[256];
+	struct spr spr;
 
 	uint8_t open_bus;
 	uint8_t read_buffer;
@@ -449,6 +487,38 @@ static void ppu_store_bg(struct ppu *ppu, uint16_t bg_dot)
 		ppu->bg[bg_dot + (7 - x)] = ppu_color(ppu->bgl, ppu->bgh, ppu->attr, x);
 }
 
+static void ppu_fetch_tile(struct ppu *ppu, struct cart *cart, uint16_t bg_dot)
+{
+	ppu->bgl = ppu_read_tile_byte(ppu, cart, ppu->nt, 0);
+	ppu->bgh = ppu_read_tile_byte(ppu, cart, ppu->nt, 8);
+
+	ppu_store_bg(ppu, bg_dot);
+	ppu_scroll_h(ppu);
+}
+
+// batched fetches take the pattern from the cart's tile cache, the reads only move the bus. returns
+// false when the cart needs the real reads, bgl/bgh are left stale
+static bool ppu_fetch_tile_cached(struct ppu *ppu, struct cart *cart, uint16_t bg_dot)
+{
+	uint16_t addr = ppu->CTRL.bg_table + (ppu->nt * 16) + GET_FY(ppu->v);
+	const uint8_t *row = cart_chr_row(cart, addr);
+
+	if (!row)
+		return false;
+
+	ppu_set_bus_v(ppu, cart, addr);
+	ppu_set_bus_v(ppu, cart, addr + 8);
+
+	uint8_t attr = (ppu->attr << 2) & 0x0C;
+
+	for (uint8_t x = 0; x < 8; x++)
+		ppu->bg[bg_dot + x] = row[x] > 0 ? row[x] | attr : 0;
+
+	ppu_scroll_h(ppu);
+
+	return true;
+}
+
 static void ppu_fetch_bg(struct ppu *ppu, struct cart *cart, uint16_t bg_dot)
 {
 	switch (ppu->dot % 8) {
@@ -515,21 +585,22 @@ static uint16_t ppu_sprite_addr(struct ppu *ppu, uint16_t row, uint8_t index, ui
 	return table + tile * 16 + row;
 }
 
-static void ppu_store_sprite_colors(struct ppu *ppu, uint8_t attr, uint8_t sprite_x, uint8_t id,
-	uint8_t low_tile, uint8_t high_tile)
+static void ppu_store_sprite_colors(struct ppu *ppu, uint8_t attr, uint8_t sprite_x, uint8_t id, const uint8_t *row)
 {
 	for (uint8_t x = 0; x < 8; x++) {
-		uint8_t shift = SPRITE_ATTR_FLIP_H(attr) ? x : 7 - x;
-		uint8_t color = ppu_color(low_tile, high_tile, SPRITE_ATTR_PALETTE(attr), shift);
+		uint8_t color = row[SPRITE_ATTR_FLIP_H(attr) ? 7 - x : x];
 		uint16_t offset = sprite_x + x;
 
+		if (color > 0)
+			color |= SPRITE_ATTR_PALETTE(attr) << 2;
+
 		if (offset < 256 && color != 0) {
-			if (!ppu->spr[offset].sprite0)
-				ppu->spr[offset].sprite0 = id == 0 && offset != 255;
+			if (!ppu->spr.sprite0[offset])
+				ppu->spr.sprite0[offset] = id == 0 && offset != 255;
 
-			if (ppu->spr[offset].color == 0) {
-				ppu->spr[offset].color = color + 16;
-				ppu->spr[offset].priority = SPRITE_ATTR_PRIORITY(attr);
+			if (ppu->spr.color[offset] == 0) {
+				ppu->spr.color[offset] = color + 16;
+				ppu->spr.priority[offset] = SPRITE_ATTR_PRIORITY(attr);
 			}
 		}
 	}
@@ -595,10 +666,48 @@ static void ppu_eval_sprites(struct ppu *ppu)
 	}
 }
 
-static void ppu_fetch_sprite(struct ppu *ppu, struct cart *cart)
+static void ppu_fetch_sprite_low(struct ppu *ppu, struct cart *cart, uint8_t n)
+{
+	struct sprite *s = &ppu->sprites[n];
+	int32_t row = ppu->scanline - ppu->soam[n][0];
+
+	s->addr = ppu_sprite_addr(ppu, (uint16_t) (row > 0 ? row : 0), ppu->soam[n][1], ppu->soam[n][2]);
+	s->low_tile = ppu_read_vram(ppu, cart, s->addr, ROM_SPRITE, false);
+}
+
+static void ppu_fetch_sprite_high(struct ppu *ppu, struct cart *cart, uint8_t n)
+{
+	struct sprite *s = &ppu->sprites[n];
+	uint8_t high_tile = ppu_read_vram(ppu, cart, s->addr + 8, ROM_SPRITE, false);
+
+	if (n < ppu->soam_n) {
+		uint8_t row[8];
+		for (uint8_t x = 0; x < 8; x++)
+			row[x] = ppu_color(s->low_tile, high_tile, 0, 7 - x);
+
+		ppu_store_sprite_colors(ppu, ppu->soam[n][2], ppu->soam[n][3], s->id, row);
+	}
+}
+
+static void ppu_fetch_sprite_high_cached(struct ppu *ppu, struct cart *cart, uint8_t n)
 {
-	int32_t n = (ppu->dot - 257) / 8;
 	struct sprite *s = &ppu->sprites[n];
+	const uint8_t *row = cart_chr_row(cart, s->addr);
+
+	if (!row) {
+		ppu_fetch_sprite_high(ppu, cart, n);
+		return;
+	}
+
+	ppu_set_bus_v(ppu, cart, s->addr + 8);
+
+	if (n < ppu->soam_n)
+		ppu_store_sprite_colors(ppu, ppu->soam[n][2], ppu->soam[n][3], s->id, row);
+}
+
+static void ppu_fetch_sprite(struct ppu *ppu, struct cart *cart)
+{
+	uint8_t n = (uint8_t) ((ppu->dot - 257) / 8);
 
 	switch (ppu->dot % 8) {
 		case 1:
@@ -607,18 +716,12 @@ static void ppu_fetch_sprite(struct ppu *ppu, struct cart *cart)
 		case 3:
 			ppu_read_attr_byte(ppu, cart, ROM_SPRITE);
 			break;
-		case 5: {
-			int32_t row = ppu->scanline - ppu->soam[n][0];
-			s->addr = ppu_sprite_addr(ppu, (uint16_t) (row > 0 ? row : 0), ppu->soam[n][1], ppu->soam[n][2]);
-			s->low_tile = ppu_read_vram(ppu, cart, s->addr, ROM_SPRITE, false);
+		case 5:
+			ppu_fetch_sprite_low(ppu, cart, n);
 			break;
-		} case 7: {
-			uint8_t high_tile = ppu_read_vram(ppu, cart, s->addr + 8, ROM_SPRITE, false);
-
-			if (n < ppu->soam_n)
-				ppu_store_sprite_colors(ppu, ppu->soam[n][2], ppu->soam[n][3], s->id, s->low_tile, high_tile);
+		case 7:
+			ppu_fetch_sprite_high(ppu, cart, n);
 			break;
-		}
 	}
 }
 
@@ -635,7 +738,12 @@ static void ppu_oam_glitch(struct ppu *ppu)
 
 // https://wiki.nesdev.com/w/index.php/PPU_rendering#Preface
 
-static void ppu_render(struct ppu *ppu, uint16_t dot, bool rendering)
+static uint16_t ppu_emphasis(struct ppu *ppu)
+{
+	return (uint16_t) ((ppu->palette - ppu->palettes[0]) / 64) << 6;
+}
+
+static void ppu_render(struct ppu *ppu, uint16_t dot, bool rendering, bool output)
 {
 	uint16_t addr = 0x3F00;
 
@@ -646,11 +754,11 @@ static void ppu_render(struct ppu *ppu, uint16_t dot, bool rendering)
 		uint8_t color = show_bg ? ppu->bg[dot + ppu->x] : 0;
 
 		if (show_sprites) {
-			if (ppu->spr[dot].sprite0 && color != 0)
+			if (ppu->spr.sprite0[dot] && color != 0)
 				SET_FLAG(ppu->STATUS, FLAG_STATUS_S);
 
-			uint8_t sprite_color = ppu->spr[dot].color;
-			if (sprite_color != 0 && (color == 0 || !ppu->spr[dot].priority))
+			uint8_t sprite_color = ppu->spr.color[dot];
+			if (sprite_color != 0 && (color == 0 || !ppu->spr.priority[dot]))
 				color = sprite_color;
 		}
 
@@ -660,8 +768,237 @@ static void ppu_render(struct ppu *ppu, uint16_t dot, bool rendering)
 		addr = ppu->v;
 	}
 
+	// sprite 0 hit is the only side effect, skip the pixel when nobody sees the frame
+	if (!output)
+		return;
+
 	uint8_t color = ppu_read_palette(ppu, addr);
-	ppu->pixels[ppu->scanline * 256 + dot] = ppu->palette[color];
+
+	if (ppu->indexed) {
+		ppu->frame.indexes[ppu->scanline * 256 + dot] = ppu_emphasis(ppu) | color;
+
+	} else {
+		ppu->frame.pixels[ppu->scanline * 256 + dot] = ppu->palette[color];
+	}
+}
+
+static void ppu_render_line(struct ppu *ppu, bool output)
+{
+	struct layers layers;
+	layers.bg = ppu->bg + ppu->x;
+	layers.spr = &ppu->spr;
+
+	// only the first 8 pixels can be clipped
+	for (uint8_t x = 0; x < 32; x++) {
+		layers.bg_mask[x] = (ppu->MASK.show_bg && (x >= 8 || ppu->MASK.clip_bg)) ? 0xFF : 0;
+		layers.spr_mask[x] = (ppu->MASK.show_sprites && (x >= 8 || ppu->MASK.clip_sprites)) ? 0xFF : 0;
+	}
+
+	uint8_t line[256];
+	if (ppu->compose(line, &layers))
+		SET_FLAG(ppu->STATUS, FLAG_STATUS_S);
+
+	// sprite 0 hit is the only side effect, skip the pixels when nobody sees the frame
+	if (!output)
+		return;
+
+	// the palette can't change during the line
+	if (ppu->indexed) {
+		uint16_t *indexes = ppu->frame.indexes + ppu->scanline * 256;
+		uint16_t colors[32];
+
+		for (uint8_t x = 0; x < 32; x++)
+			colors[x] = ppu_emphasis(ppu) | ppu_read_palette(ppu, 0x3F00 + x);
+
+		for (uint16_t dot = 0; dot < 256; dot++)
+			indexes[dot] = colors[line[dot]];
+
+	} else {
+		uint32_t colors[32];
+
+		for (uint8_t x = 0; x < 32; x++)
+			colors[x] = ppu->palette[ppu_read_palette(ppu, 0x3F00 + x)];
+
+		ppu->lookup(ppu->frame.pixels + ppu->scanline * 256, line, colors);
+	}
+}
+
+
+/*** COMPOSITING ***/
+
+// a whole line at once: background/sprite priority, sprite 0 hit, then the palette lookup. every
+// kernel must match the scalar one byte for byte
+
+static bool ppu_compose_scalar(uint8_t *line, const struct layers *layers)
+{
+	const struct spr *spr = layers->spr;
+	bool hit = false;
+
+	for (uint16_t dot = 0; dot < 256; dot++) {
+		uint8_t m = dot < 32 ? dot : 31;
+		uint8_t color = layers->bg[dot] & layers->bg_mask[m];
+
+		if (layers->spr_mask[m]) {
+			if (spr->sprite0[dot] && color != 0)
+				hit = true;
+
+			if (spr->color[dot] != 0 && (color == 0 || !spr->priority[dot]))
+				color = spr->color[dot];
+		}
+
+		line[dot] = color;
+	}
+
+	return hit;
+}
+
+static void ppu_lookup_scalar(uint32_t *pixels, const uint8_t *line, const uint32_t *colors)
+{
+	for (uint16_t dot = 0; dot < 256; dot++)
+		pixels[dot] = colors[line[dot]];
+}
+
+#if defined(PPU_SSE2)
+
+static bool ppu_compose_sse2(uint8_t *line, const struct layers *layers)
+{
+	const struct spr *spr = layers->spr;
+	__m128i zero = _mm_setzero_si128();
+	__m128i hit = zero;
+
+	for (uint16_t dot = 0; dot < 256; dot += 16) {
+		__m128i bg_mask = dot < 32 ? _mm_loadu_si128((const __m128i *) (layers->bg_mask + dot)) : _mm_set1_epi8((char) layers->bg_mask[31]);
+		__m128i spr_mask = dot < 32 ? _mm_loadu_si128((const __m128i *) (layers->spr_mask + dot)) : _mm_set1_epi8((char) layers->spr_mask[31]);
+
+		__m128i bg = _mm_and_si128(_mm_loadu_si128((const __m128i *) (layers->bg + dot)), bg_mask);
+		__m128i color = _mm_and_si128(_mm_loadu_si128((const __m128i *) (spr->color + dot)), spr_mask);
+		__m128i sprite0 = _mm_and_si128(_mm_loadu_si128((const __m128i *) (spr->sprite0 + dot)), spr_mask);
+		__m128i priority = _mm_loadu_si128((const __m128i *) (spr->priority + dot));
+
+		__m128i bg_clear = _mm_cmpeq_epi8(bg, zero);
+		hit = _mm_or_si128(hit, _mm_andnot_si128(bg_clear, sprite0));
+
+		// sprite wins when it is opaque and either in front or over a clear background
+		__m128i front = _mm_or_si128(bg_clear, _mm_cmpeq_epi8(priority, zero));
+		__m128i sel = _mm_andnot_si128(_mm_cmpeq_epi8(color, zero), front);
+
+		_mm_storeu_si128((__m128i *) (line + dot), _mm_or_si128(_mm_and_si128(sel, color), _mm_andnot_si128(sel, bg)));
+	}
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(hit, zero)) != 0xFFFF;
+}
+
+static PPU_AVX2 bool ppu_compose_avx2(uint8_t *line, const struct layers *layers)
+{
+	const struct spr *spr = layers->spr;
+	__m256i zero = _mm256_setzero_si256();
+	__m256i hit = zero;
+
+	for (uint16_t dot = 0; dot < 256; dot += 32) {
+		__m256i bg_mask = dot == 0 ? _mm256_loadu_si256((const __m256i *) layers->bg_mask) : _mm256_set1_epi8((char) layers->bg_mask[31]);
+		__m256i spr_mask = dot == 0 ? _mm256_loadu_si256((const __m256i *) layers->spr_mask) : _mm256_set1_epi8((char) layers->spr_mask[31]);
+
+		__m256i bg = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (layers->bg + dot)), bg_mask);
+		__m256i color = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (spr->color + dot)), spr_mask);
+		__m256i sprite0 = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (spr->sprite0 + dot)), spr_mask);
+		__m256i priority = _mm256_loadu_si256((const __m256i *) (spr->priority + dot));
+
+		__m256i bg_clear = _mm256_cmpeq_epi8(bg, zero);
+		hit = _mm256_or_si256(hit, _mm256_andnot_si256(bg_clear, sprite0));
+
+		__m256i front = _mm256_or_si256(bg_clear, _mm256_cmpeq_epi8(priority, zero));
+		__m256i sel = _mm256_andnot_si256(_mm256_cmpeq_epi8(color, zero), front);
+
+		_mm256_storeu_si256((__m256i *) (line + dot), _mm256_blendv_epi8(bg, color, sel));
+	}
+
+	return !_mm256_testz_si256(hit, hit);
+}
+
+// permutevar picks from 8 colors by the low 3 bits, bits 3 and 4 pick between the 4 registers
+static PPU_AVX2 void ppu_lookup_avx2(uint32_t *pixels, const uint8_t *line, const uint32_t *colors)
+{
+	__m256i c0 = _mm256_loadu_si256((const __m256i *) colors);
+	__m256i c1 = _mm256_loadu_si256((const __m256i *) (colors + 8));
+	__m256i c2 = _mm256_loadu_si256((const __m256i *) (colors + 16));
+	__m256i c3 = _mm256_loadu_si256((const __m256i *) (colors + 24));
+
+	for (uint16_t dot = 0; dot < 256; dot += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (line + dot)));
+		__m256 bit3 = _mm256_castsi256_ps(_mm256_slli_epi32(idx, 28));
+		__m256 bit4 = _mm256_castsi256_ps(_mm256_slli_epi32(idx, 27));
+
+		__m256 lo = _mm256_blendv_ps(_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(c0, idx)),
+			_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(c1, idx)), bit3);
+		__m256 hi = _mm256_blendv_ps(_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(c2, idx)),
+			_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(c3, idx)), bit3);
+
+		_mm256_storeu_si256((__m256i *) (pixels + dot), _mm256_castps_si256(_mm256_blendv_ps(lo, hi, bit4)));
+	}
+}
+
+static bool ppu_has_avx2(void)
+{
+	#if defined(_MSC_VER)
+		int32_t info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		__cpuid(info, 1);
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return false; // osxsave, avx
+		if ((_xgetbv(0) & 0x6) != 0x6) return false; // os saves ymm
+
+		__cpuidex(info, 7, 0);
+		return info[1] & (1 << 5);
+	#else
+		return __builtin_cpu_supports("avx2");
+	#endif
+}
+
+#elif defined(PPU_NEON)
+
+static bool ppu_compose_neon(uint8_t *line, const struct layers *layers)
+{
+	const struct spr *spr = layers->spr;
+	uint8x16_t hit = vdupq_n_u8(0);
+
+	for (uint16_t dot = 0; dot < 256; dot += 16) {
+		uint8x16_t bg_mask = dot < 32 ? vld1q_u8(layers->bg_mask + dot) : vdupq_n_u8(layers->bg_mask[31]);
+		uint8x16_t spr_mask = dot < 32 ? vld1q_u8(layers->spr_mask + dot) : vdupq_n_u8(layers->spr_mask[31]);
+
+		uint8x16_t bg = vandq_u8(vld1q_u8(layers->bg + dot), bg_mask);
+		uint8x16_t color = vandq_u8(vld1q_u8(spr->color + dot), spr_mask);
+		uint8x16_t sprite0 = vandq_u8(vld1q_u8((const uint8_t *) spr->sprite0 + dot), spr_mask);
+		uint8x16_t priority = vld1q_u8((const uint8_t *) spr->priority + dot);
+
+		uint8x16_t bg_clear = vceqq_u8(bg, vdupq_n_u8(0));
+		hit = vorrq_u8(hit, vbicq_u8(sprite0, bg_clear));
+
+		uint8x16_t front = vorrq_u8(bg_clear, vceqq_u8(priority, vdupq_n_u8(0)));
+		uint8x16_t sel = vbicq_u8(front, vceqq_u8(color, vdupq_n_u8(0)));
+
+		vst1q_u8(line + dot, vbslq_u8(sel, color, bg));
+	}
+
+	uint64x2_t h = vreinterpretq_u64_u8(hit);
+	return (vgetq_lane_u64(h, 0) | vgetq_lane_u64(h, 1)) != 0;
+}
+
+#endif
+
+static void ppu_select_kernels(struct ppu *ppu)
+{
+	ppu->compose = ppu_compose_scalar;
+	ppu->lookup = ppu_lookup_scalar;
+
+	#if defined(PPU_SSE2)
+		bool avx2 = ppu_has_avx2();
+		ppu->compose = avx2 ? ppu_compose_avx2 : ppu_compose_sse2;
+		ppu->lookup = avx2 ? ppu_lookup_avx2 : ppu_lookup_scalar;
+
+	#elif defined(PPU_NEON)
+		ppu->compose = ppu_compose_neon;
+	#endif
 }
 
 
@@ -709,7 +1046,7 @@ static void ppu_memory_access(struct ppu *ppu, struct cart *cart, bool pre_rende
 		ppu->OAMADDR = 0;
 
 		if (ppu->dot == 257) {
-			memset(ppu->spr, 0, sizeof(struct spr) * 256);
+			memset(&ppu->spr, 0, sizeof(struct spr));
 			ppu_scroll_copy_x(ppu);
 		}
 
@@ -718,9 +1055,70 @@ static void ppu_memory_access(struct ppu *ppu, struct cart *cart, bool pre_rende
 	}
 }
 
-uint8_t ppu_step(struct ppu *ppu, struct cpu *cpu, struct cart *cart, FRAME_CALLBACK new_frame, void *opaque)
+// rows are handed over in groups of slice_rows as soon as the last one is drawn, the final group
+// of a frame may be shorter
+
+static const uint32_t PPU_BLACK[256 * 240];
+
+static void ppu_slice(struct ppu *ppu, SLICE_CALLBACK new_slice, void *opaque)
+{
+	uint16_t row = ppu->scanline;
+
+	if ((row + 1) % ppu->slice_rows == 0 || row == 239) {
+		uint16_t first = row - row % ppu->slice_rows;
+
+		// nothing has been drawn with a real palette yet, show black. the frame is left alone, a
+		// palette write later on decides what the whole frame shows
+		const uint32_t *pixels = ppu->palette_write ? ppu->frame.pixels : PPU_BLACK;
+
+		new_slice(first, row + 1 - first, pixels + first * 256, opaque);
+	}
+}
+
+// a frame goes out in the format it was drawn in, a switch made while it was drawn applies to the
+// next one. indexes nobody takes anymore are expanded through the palette in place, back to front
+// since every pixel is twice as wide as its index
+static void ppu_output_frame(struct ppu *ppu, FRAME_CALLBACK new_frame, INDEX_CALLBACK new_indexes,
+	void *opaque)
+{
+	bool indexed = ppu->indexed;
+	ppu->indexed = ppu->next_indexed;
+
+	if (!new_frame && !new_indexes)
+		return;
+
+	// nothing has been drawn with a real palette yet, show black
+	if (!ppu->palette_write) {
+		if (indexed) {
+			for (uint32_t x = 0; x < 256 * 240; x++)
+				ppu->frame.indexes[x] = 0x0F;
+
+		} else {
+			memset(ppu->frame.pixels, 0, sizeof(ppu->frame.pixels));
+		}
+	}
+
+	if (indexed && new_indexes) {
+		new_indexes(ppu->frame.indexes, opaque);
+		return;
+	}
+
+	if (indexed) {
+		for (uint32_t x = 256 * 240; x-- > 0;) {
+			uint16_t index = ppu->frame.indexes[x];
+			ppu->frame.pixels[x] = ppu->palettes[index >> 6][index & 0x3F];
+		}
+	}
+
+	if (new_frame)
+		new_frame(ppu->frame.pixels, opaque);
+}
+
+uint8_t ppu_step(struct ppu *ppu, struct cpu *cpu, struct cart *cart, FRAME_CALLBACK new_frame,
+	INDEX_CALLBACK new_indexes, SLICE_CALLBACK new_slice, void *opaque)
 {
 	uint8_t got_frame = 0;
+	bool output = new_frame || new_indexes;
 
 	if (ppu->dot == 0) {
 		ppu->oam_n = ppu->soam_n = ppu->eval_step = 0;
@@ -733,7 +1131,10 @@ uint8_t ppu_step(struct ppu *ppu, struct cpu *cpu, struct cart *cart, FRAME_CALL
 
 	if (ppu->scanline <= 239) {
 		if (ppu->dot >= 1 && ppu->dot <= 256) //XXX DEFEAT DEVICE: sprite evaluation should begin at cycle 2
-			ppu_render(ppu, ppu->dot - 1, ppu->MASK.rendering);
+			ppu_render(ppu, ppu->dot - 1, ppu->MASK.rendering, output);
+
+		if (ppu->dot == 256 && new_slice && !ppu->indexed)
+			ppu_slice(ppu, new_slice, opaque);
 
 		if (ppu->MASK.rendering)
 			ppu_memory_access(ppu, cart, false);
@@ -741,11 +1142,8 @@ uint8_t ppu_step(struct ppu *ppu, struct cpu *cpu, struct cart *cart, FRAME_CALL
 	} else if (ppu->scanline == 240) {
 		if (ppu->dot == 0) {
 			ppu_set_bus_v(ppu, cart, ppu->v);
+			ppu_output_frame(ppu, new_frame, new_indexes, opaque);
 
-			if (!ppu->palette_write)
-				memset(ppu->pixels, 0, 256 * 240 * 4);
-
-			new_frame(ppu->pixels, opaque);
 			got_frame = 1;
 		}
 
@@ -782,22 +1180,251 @@ uint8_t ppu_step(struct ppu *ppu, struct cpu *cpu, struct cart *cart, FRAME_CALL
 	return got_frame;
 }
 
+// visible lines run in two halves when nothing can look at the ppu or cart until each is done:
+// dots 0-256 and, since mapper A12 hooks need the sprite fetches dot by dot, 257-340 separately.
+// the cart sees the same reads and hook in the same order as stepping it dot by dot
 
-/*** INIT & DESTROY ***/
+static void ppu_scanline_bg(struct ppu *ppu, struct cpu *cpu, struct cart *cart, bool output)
+{
+	ppu->oam_n = ppu->soam_n = ppu->eval_step = 0;
+	ppu->overflow = false;
+	memset(ppu->soam, 0xFF, 32);
 
-void ppu_init(struct ppu **ppu_out)
+	if (!ppu->MASK.rendering) {
+		cart_ppu_scanline_hook(cart, cpu, ppu->scanline);
+
+		for (uint16_t dot = 0; dot < 256; dot++)
+			ppu_render(ppu, dot, false, output);
+
+	} else {
+		ppu_oam_glitch(ppu);
+
+		// 32 tiles for this line, the hook lands between the first tile's attribute and pattern reads
+		bool cached = false;
+
+		for (uint16_t bg_dot = 16; bg_dot <= 264; bg_dot += 8) {
+			ppu->nt = ppu_read_nt_byte(ppu, cart, ROM_BG);
+			ppu->attr = ppu_read_attr_byte(ppu, cart, ROM_BG);
+
+			if (bg_dot == 16)
+				cart_ppu_scanline_hook(cart, cpu, ppu->scanline);
+
+			cached = ppu_fetch_tile_cached(ppu, cart, bg_dot);
+			if (!cached)
+				ppu_fetch_tile(ppu, cart, bg_dot);
+		}
+
+		// the last pattern bytes as they would have been read, v has moved on by one tile
+		if (cached) {
+			uint16_t addr = ppu->CTRL.bg_table + (ppu->nt * 16) + GET_FY(ppu->v);
+			ppu->bgl = cart_chr_read(cart, addr, ROM_BG, false);
+			ppu->bgh = cart_chr_read(cart, addr + 8, ROM_BG, false);
+		}
+
+		for (uint16_t dot = 65; dot <= 256; dot++)
+			ppu_eval_sprites(ppu);
+
+		ppu_scroll_v(ppu);
+
+		// sprites for this line were fetched on the last one
+		ppu_render_line(ppu, output);
+	}
+
+	ppu->dot = 257;
+}
+
+static void ppu_scanline_fetch(struct ppu *ppu, struct cart *cart)
 {
-	*ppu_out = calloc(1, sizeof(struct ppu));
+	if (ppu->MASK.rendering) {
+		for (uint8_t n = 0; n < 8; n++) {
+			ppu_read_nt_byte(ppu, cart, ROM_SPRITE);
+
+			if (n == 0) {
+				memset(&ppu->spr, 0, sizeof(struct spr));
+				ppu_scroll_copy_x(ppu);
+			}
+
+			ppu_read_attr_byte(ppu, cart, ROM_SPRITE);
+			ppu_fetch_sprite_low(ppu, cart, n);
+			ppu_fetch_sprite_high_cached(ppu, cart, n);
+		}
+
+		ppu->OAMADDR = 0;
+
+		// the first 2 tiles of the next line
+		for (uint16_t bg_dot = 0; bg_dot <= 8; bg_dot += 8) {
+			ppu->nt = ppu_read_nt_byte(ppu, cart, ROM_BG);
+			ppu->attr = ppu_read_attr_byte(ppu, cart, ROM_BG);
+			ppu_fetch_tile(ppu, cart, bg_dot);
+		}
+	}
+
+	ppu->dot = 0;
+	ppu->scanline++;
 }
 
-void ppu_destroy(struct ppu **ppu_out)
+uint8_t ppu_run(struct ppu *ppu, struct cpu *cpu, struct cart *cart, uint32_t dots,
+	FRAME_CALLBACK new_frame, INDEX_CALLBACK new_indexes, SLICE_CALLBACK new_slice, void *opaque)
 {
-	if (!ppu_out || *ppu_out) return;
+	uint8_t got_frame = 0;
 
-	free(*ppu_out);
-	*ppu_out = NULL;
+	while (dots > 0) {
+		if (ppu->scanline <= 239 && ppu->dot == 0 && dots >= 257) {
+			ppu_scanline_bg(ppu, cpu, cart, new_frame || new_indexes);
+			dots -= 257;
+
+			if (new_slice && !ppu->indexed)
+				ppu_slice(ppu, new_slice, opaque);
+
+		} else if (ppu->scanline <= 239 && ppu->dot == 257 && dots >= 84) {
+			ppu_scanline_fetch(ppu, cart);
+			dots -= 84;
+
+		// past the scanline hook, the post-render and vblank lines only advance the clock
+		} else if (ppu->scanline >= 240 && ppu->scanline <= 260 && ppu->dot >= 5) {
+			uint32_t n = 341 - ppu->dot;
+			if (n > dots) n = dots;
+
+			ppu->dot += (uint16_t) n;
+			dots -= n;
+
+			if (ppu->dot > 340) {
+				ppu->dot = 0;
+				ppu->scanline++;
+			}
+
+		} else {
+			got_frame += ppu_step(ppu, cpu, cart, new_frame, new_indexes, new_slice, opaque);
+			dots--;
+		}
+	}
+
+	return got_frame;
+}
+
+
+/*** DEADLINES ***/
+
+// the number of steps until the dot at (scanline, dot) has been run
+uint32_t ppu_dots_until(struct ppu *ppu, uint16_t scanline, uint16_t dot)
+{
+	int32_t now = ppu->scanline * 341 + ppu->dot;
+	int32_t target = scanline * 341 + dot;
+
+	// the odd frame skip may shorten a wrap by one dot, arriving early is always safe
+	if (target < now)
+		target += 262 * 341 - 1;
+
+	return (uint32_t) (target - now + 1);
+}
+
+// the last row of the next slice to be handed over
+static uint16_t ppu_slice_end(struct ppu *ppu)
+{
+	uint16_t rows = ppu->slice_rows;
+	uint16_t line = ppu->scanline;
+
+	if (line <= 239 && ppu->dot > 256)
+		line++;
+
+	if (line > 239)
+		return rows - 1 < 239 ? rows - 1 : 239;
+
+	uint16_t end = line - line % rows + rows - 1;
+
+	return end < 239 ? end : 239;
+}
+
+uint32_t ppu_deadline(struct ppu *ppu, bool a12_hook, bool scanline_hook, bool slices)
+{
+	// new frames and the vblank NMI are always seen in lockstep with the CPU
+	uint32_t d = ppu_dots_until(ppu, 240, 0);
+	uint32_t n = ppu_dots_until(ppu, 241, 1);
+	if (n < d) d = n;
+
+	// as are finished slices
+	if (slices) {
+		n = ppu_dots_until(ppu, ppu_slice_end(ppu), 256);
+		if (n < d) d = n;
+	}
+
+	if (scanline_hook) {
+		n = ppu_dots_until(ppu, ppu->dot <= 4 ? ppu->scanline : (ppu->scanline + 1) % 262, 4);
+		if (n < d) d = n;
+	}
+
+	// background fetches can only raise A12 if the bus is low and the bg uses the upper table,
+	// sprite fetches and the prefetch for the next line are stepped dot by dot
+	if (a12_hook && ppu->MASK.rendering) {
+		if (ppu->scanline <= 239 || ppu->scanline == 261) {
+			if (ppu->dot >= 257 || (ppu->CTRL.bg_table && !(ppu->bus_v & 0x1000)))
+				return 1;
+
+			n = ppu_dots_until(ppu, ppu->scanline, 257);
+
+		} else {
+			n = ppu_dots_until(ppu, 261, 0);
+		}
+
+		if (n < d) d = n;
+	}
+
+	return d;
+}
+
+
+/*** VIDEO ***/
+
+void ppu_get_palette(struct ppu *ppu, uint32_t *rgba)
+{
+	memcpy(rgba, ppu->palettes, sizeof(ppu->palettes));
+}
+
+void ppu_set_slice_rows(struct ppu *ppu, uint16_t rows)
+{
+	ppu->slice_rows = rows;
+}
+
+void ppu_set_indexed(struct ppu *ppu, bool indexed)
+{
+	ppu->next_indexed = indexed;
+
+	// between frames nothing of either format is in the buffer yet
+	if (ppu->scanline > 240 || (ppu->scanline == 240 && ppu->dot > 0) || (ppu->scanline == 0 && ppu->dot == 0))
+		ppu->indexed = indexed;
+}
+
+
+/*** STATE ***/
+
+// the framebuffer and emphasis palettes are left out, only the active palette index is stored
+
+#define PPU_STATE_OFFSET offsetof(struct ppu, palette_ram)
+
+size_t ppu_state_size(void)
+{
+	return 1 + sizeof(struct ppu) - PPU_STATE_OFFSET;
+}
+
+void ppu_state_save(struct ppu *ppu, void *buf)
+{
+	uint8_t *b = buf;
+
+	b[0] = (uint8_t) ((ppu->palette - ppu->palettes[0]) / 64);
+	memcpy(b + 1, (uint8_t *) ppu + PPU_STATE_OFFSET, sizeof(struct ppu) - PPU_STATE_OFFSET);
+}
+
+void ppu_state_load(struct ppu *ppu, const void *buf)
+{
+	const uint8_t *b = buf;
+
+	ppu->palette = ppu->palettes[b[0] & 0x07];
+	memcpy((uint8_t *) ppu + PPU_STATE_OFFSET, b + 1, sizeof(struct ppu) - PPU_STATE_OFFSET);
 }
 
+
+/*** INIT & DESTROY ***/
+
 static void ppu_generate_emphasis_tables(struct ppu *ppu)
 {
 	memcpy(ppu->palettes[0], PALETTE, sizeof(uint32_t) * 64);
@@ -815,14 +1442,37 @@ static void ppu_generate_emphasis_tables(struct ppu *ppu)
 	}
 }
 
+void ppu_init(struct ppu **ppu_out)
+{
+	struct ppu *ppu = *ppu_out = calloc(1, sizeof(struct ppu));
+
+	// the palettes are valid before the first reset so frontends can fetch them right away
+	ppu_generate_emphasis_tables(ppu);
+}
+
+void ppu_destroy(struct ppu **ppu_out)
+{
+	if (!ppu_out || !*ppu_out) return;
+
+	free(*ppu_out);
+	*ppu_out = NULL;
+}
+
 void ppu_reset(struct ppu *ppu)
 {
+	// chosen by the frontend, not part of the console
+	uint16_t slice_rows = ppu->slice_rows;
+	bool indexed = ppu->next_indexed;
+
 	memset(ppu, 0, sizeof(struct ppu));
+	ppu->slice_rows = slice_rows;
+	ppu->indexed = ppu->next_indexed = indexed;
 
 	memcpy(ppu->palette_ram, POWER_UP_PALETTE, 32);
 
 	ppu_generate_emphasis_tables(ppu);
 	ppu->palette = ppu->palettes[0];
+	ppu_select_kernels(ppu);
 
 	ppu->CTRL.incr = 1;
 	ppu->CTRL.sprite_h = 8;
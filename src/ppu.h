@@ -13,7 +13,24 @@ uint8_t ppu_read(struct ppu *ppu, struct cpu *cpu, struct cart *cart, uint16_t a
 void ppu_write(struct ppu *ppu, struct cpu *cpu, struct cart *cart, uint16_t addr, uint8_t v);
 
 /*** RUN ***/
-uint8_t ppu_step(struct ppu *ppu, struct cpu *cpu, struct cart *cart, FRAME_CALLBACK new_frame, void *opaque);
+uint8_t ppu_step(struct ppu *ppu, struct cpu *cpu, struct cart *cart, FRAME_CALLBACK new_frame,
+	INDEX_CALLBACK new_indexes, SLICE_CALLBACK new_slice, void *opaque);
+uint8_t ppu_run(struct ppu *ppu, struct cpu *cpu, struct cart *cart, uint32_t dots,
+	FRAME_CALLBACK new_frame, INDEX_CALLBACK new_indexes, SLICE_CALLBACK new_slice, void *opaque);
+
+/*** DEADLINES ***/
+uint32_t ppu_deadline(struct ppu *ppu, bool a12_hook, bool scanline_hook, bool slices);
+uint32_t ppu_dots_until(struct ppu *ppu, uint16_t scanline, uint16_t dot);
+
+/*** VIDEO ***/
+void ppu_get_palette(struct ppu *ppu, uint32_t *rgba);
+void ppu_set_slice_rows(struct ppu *ppu, uint16_t rows);
+void ppu_set_indexed(struct ppu *ppu, bool indexed);
+
+/*** STATE ***/
+size_t ppu_state_size(void);
+void ppu_state_save(struct ppu *ppu, void *buf);
+void ppu_state_load(struct ppu *ppu, const void *buf);
 
 /*** INIT & DESTROY ***/
 void ppu_init(struct ppu **ppu_out);
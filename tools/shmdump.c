@@ -0,0 +1,231 @@
+// reference consumer for the -shm output sink, dumps the frames to Y4M and the samples to WAV
+// cddNES-shmdump /proc/<pid>/fd/<fd> out.y4m out.wav [frames]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "../ui/shm.h"
+
+struct dump {
+	struct shm_region *r;
+	FILE *y4m;
+	FILE *wav;
+	uint8_t planes[3][SHM_WIDTH * SHM_HEIGHT];
+	int16_t samples[SHM_SAMPLES * 2];
+	uint64_t frame;
+	uint64_t block;
+	uint64_t limit;
+	uint64_t dumped;
+	uint64_t dropped;
+	uint64_t audio_bytes;
+	uint32_t sample_rate;
+};
+
+
+/*** WAV ***/
+
+static void dump_u32(FILE *f, uint32_t v)
+{
+	uint8_t b[4] = {v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24};
+	fwrite(b, 1, 4, f);
+}
+
+static void dump_u16(FILE *f, uint16_t v)
+{
+	uint8_t b[2] = {v & 0xFF, v >> 8};
+	fwrite(b, 1, 2, f);
+}
+
+static void dump_wav_header(struct dump *ctx)
+{
+	rewind(ctx->wav);
+	fwrite("RIFF", 1, 4, ctx->wav);
+	dump_u32(ctx->wav, 36 + (uint32_t) ctx->audio_bytes);
+	fwrite("WAVEfmt ", 1, 8, ctx->wav);
+	dump_u32(ctx->wav, 16);
+	dump_u16(ctx->wav, 1);
+	dump_u16(ctx->wav, 2);
+	dump_u32(ctx->wav, ctx->sample_rate);
+	dump_u32(ctx->wav, ctx->sample_rate * 4);
+	dump_u16(ctx->wav, 4);
+	dump_u16(ctx->wav, 16);
+	fwrite("data", 1, 4, ctx->wav);
+	dump_u32(ctx->wav, (uint32_t) ctx->audio_bytes);
+	fseek(ctx->wav, 0, SEEK_END);
+}
+
+
+/*** CONSUME ***/
+
+// BT.601 limited range, chroma is kept at full resolution (C444)
+
+static void dump_convert(struct dump *ctx, const uint32_t *pixels)
+{
+	for (int32_t x = 0; x < SHM_WIDTH * SHM_HEIGHT; x++) {
+		int32_t r = pixels[x] & 0xFF;
+		int32_t g = (pixels[x] >> 8) & 0xFF;
+		int32_t b = (pixels[x] >> 16) & 0xFF;
+
+		ctx->planes[0][x] = (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		ctx->planes[1][x] = (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		ctx->planes[2][x] = (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+}
+
+static bool dump_frames(struct dump *ctx)
+{
+	struct shm_header *hdr = &ctx->r->hdr;
+	uint64_t written = __atomic_load_n(&hdr->frames_written, __ATOMIC_ACQUIRE);
+
+	// the oldest slot is the one the next write goes into, it can't be read safely
+	if (written - ctx->frame >= SHM_FRAMES) {
+		ctx->dropped += written - ctx->frame - SHM_FRAMES + 1;
+		ctx->frame = written - SHM_FRAMES + 1;
+	}
+
+	bool progress = ctx->frame < written;
+
+	for (; ctx->frame < written && ctx->frame < ctx->limit; ctx->frame++) {
+		dump_convert(ctx, ctx->r->frames[ctx->frame % SHM_FRAMES].pixels);
+
+		// the converted copy is only good if the slot wasn't reused while it was being read
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&hdr->frames_written, __ATOMIC_RELAXED) - ctx->frame >= SHM_FRAMES) {
+			ctx->dropped++;
+			continue;
+		}
+
+		fwrite("FRAME\n", 1, 6, ctx->y4m);
+		fwrite(ctx->planes, 1, sizeof(ctx->planes), ctx->y4m);
+		ctx->dumped++;
+	}
+
+	return progress;
+}
+
+static bool dump_blocks(struct dump *ctx)
+{
+	struct shm_header *hdr = &ctx->r->hdr;
+	uint64_t written = __atomic_load_n(&hdr->blocks_written, __ATOMIC_ACQUIRE);
+
+	if (written - ctx->block >= SHM_BLOCKS)
+		ctx->block = written - SHM_BLOCKS + 1;
+
+	bool progress = ctx->block < written;
+
+	for (; ctx->block < written; ctx->block++) {
+		struct shm_block b = ctx->r->blocks[ctx->block % SHM_BLOCKS];
+
+		if (b.count > SHM_SAMPLES)
+			continue;
+
+		uint64_t start = b.offset % SHM_SAMPLES;
+		uint32_t first = SHM_SAMPLES - (uint32_t) start;
+		if (first > b.count) first = b.count;
+
+		memcpy(ctx->samples, ctx->r->samples + start * 2, (size_t) first * 4);
+		memcpy(ctx->samples + first * 2, ctx->r->samples, (size_t) (b.count - first) * 4);
+
+		// the block and its samples are only good if neither slot was reused while being copied
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&hdr->blocks_written, __ATOMIC_RELAXED) - ctx->block >= SHM_BLOCKS)
+			continue;
+
+		if (__atomic_load_n(&hdr->samples_written, __ATOMIC_RELAXED) - b.offset >= SHM_SAMPLES)
+			continue;
+
+		// samples are only taken for the frames being dumped
+		if (b.frame >= ctx->limit)
+			continue;
+
+		if (ctx->sample_rate == 0)
+			ctx->sample_rate = b.sample_rate;
+
+		fwrite(ctx->samples, 4, b.count, ctx->wav);
+		ctx->audio_bytes += (uint64_t) b.count * 4;
+	}
+
+	return progress;
+}
+
+int32_t main(int32_t argc, char **argv)
+{
+	if (argc < 4) {
+		printf("usage: cddNES-shmdump /proc/<pid>/fd/<fd> out.y4m out.wav [frames]\n");
+		return 1;
+	}
+
+	struct dump *ctx = calloc(1, sizeof(struct dump));
+	ctx->limit = argc > 4 ? strtoull(argv[4], NULL, 10) : UINT64_MAX;
+
+	int fd = open(argv[1], O_RDWR);
+	if (fd < 0) {printf("open=%s\n", argv[1]); return 1;}
+
+	ctx->r = mmap(NULL, sizeof(struct shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ctx->r == MAP_FAILED) {printf("mmap=MAP_FAILED\n"); return 1;}
+
+	struct shm_header *hdr = &ctx->r->hdr;
+
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || hdr->version != SHM_VERSION) {
+		printf("not a cddNES v%d sink\n", SHM_VERSION);
+		return 1;
+	}
+
+	ctx->y4m = fopen(argv[2], "wb");
+	ctx->wav = fopen(argv[3], "wb");
+	if (!ctx->y4m || !ctx->wav) {printf("fopen=NULL\n"); return 1;}
+
+	// 60.0988 Hz and the NES's 8:7 pixel aspect
+	fprintf(ctx->y4m, "YUV4MPEG2 W%u H%u F39375000:655171 Ip A8:7 C444\n", hdr->width, hdr->height);
+	dump_wav_header(ctx);
+
+	// start at whatever is current rather than the backlog
+	ctx->frame = __atomic_load_n(&hdr->frames_written, __ATOMIC_ACQUIRE);
+	ctx->block = __atomic_load_n(&hdr->blocks_written, __ATOMIC_ACQUIRE);
+	if (ctx->limit != UINT64_MAX)
+		ctx->limit += ctx->frame;
+
+	while (ctx->frame < ctx->limit) {
+		uint32_t seq = __atomic_load_n(&hdr->seq, __ATOMIC_SEQ_CST);
+		bool closed = __atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE);
+
+		bool progress = dump_frames(ctx);
+		progress = dump_blocks(ctx) || progress;
+
+		if (closed)
+			break;
+
+		if (!progress) {
+			__atomic_add_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+			syscall(SYS_futex, &hdr->seq, FUTEX_WAIT, seq, NULL, NULL, 0);
+			__atomic_sub_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	if (ctx->sample_rate == 0)
+		ctx->sample_rate = 44100;
+
+	dump_wav_header(ctx);
+
+	printf("frames=%llu dropped=%llu audio_bytes=%llu\n", (unsigned long long) ctx->dumped,
+		(unsigned long long) ctx->dropped, (unsigned long long) ctx->audio_bytes);
+
+	fclose(ctx->y4m);
+	fclose(ctx->wav);
+	munmap(ctx->r, sizeof(struct shm_region));
+	close(fd);
+	free(ctx);
+
+	return 0;
+}
@@ -1,5 +1,6 @@
 #include "args.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -51,6 +52,21 @@ static void args_assign(char split[2][MAX_ARG_LEN], struct args *args)
 
 	} else if (!strcmp(split[0], "-headless")) {
 		args->headless = true;
+
+	} else if (!strcmp(split[0], "-shm")) {
+		args->shm = true;
+
+	} else if (!strcmp(split[0], "-netplay")) {
+		args->netplay = (uint16_t) atoi(split[1]);
+
+	} else if (!strcmp(split[0], "-peer")) {
+		snprintf(args->peer, MAX_PEER_LEN, "%s", split[1]);
+
+	} else if (!strcmp(split[0], "-player")) {
+		args->player = (uint8_t) atoi(split[1]);
+
+	} else if (!strcmp(split[0], "-delay")) {
+		args->delay = (uint8_t) atoi(split[1]);
 	}
 }
 
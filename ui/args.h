@@ -6,12 +6,20 @@
 #include "api.h"
 
 #define MAX_ROM_LEN 1024
+#define MAX_PEER_LEN 256
 
 struct args {
 	char rom[MAX_ROM_LEN];
 	char session[SESSION_ID_LEN];
 	bool console;
 	bool headless;
+	bool shm;
+
+	// Netplay
+	uint16_t netplay;
+	char peer[MAX_PEER_LEN];
+	uint8_t player;
+	uint8_t delay;
 };
 
 void args_parse(int32_t argc, char **argv, struct args *args);
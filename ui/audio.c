@@ -6,18 +6,72 @@
 
 #include "SDL2/SDL.h"
 
-#include "../src/nes.h"
+#include "handoff.h"
 
-#define NEXT_ADJUST  lrint(60.0 * 1.5)
-#define ADJUST_INT   50
 #define CHANNELS     2
+#define DEVICE_MS    5
+#define MAX_SKEW     0.005
+#define SKEW_RANGE   0.25
+#define LEVEL_SHIFT  5
 
 struct audio {
-	struct audio_timer timer;
 	SDL_AudioDeviceID dev;
+	struct handoff_ring *ring;
+	uint32_t sample_rate;
+	uint32_t target;
+	uint32_t device_frames;
+
+	// only touched by the device callback
+	bool playing;
+	double level;
+
+	// read from the other threads
+	SDL_atomic_t level_frames;
+	SDL_atomic_t started;
+	SDL_atomic_t underruns;
+	SDL_atomic_t overruns;
 };
 
-int32_t audio_init(struct audio **ctx_out, uint32_t sample_rate)
+
+/*** DEVICE CALLBACK ***/
+
+// the device pulls from the ring on its own thread. it stays silent until the ring holds the
+// target latency, and goes back to filling after an underrun so a stall doesn't turn into crackle
+
+static void audio_callback(void *opaque, Uint8 *stream, int len)
+{
+	struct audio *ctx = (struct audio *) opaque;
+
+	uint32_t want = (uint32_t) len / (sizeof(int16_t) * CHANNELS);
+	uint32_t queued = handoff_ring_queued(ctx->ring);
+
+	if (!ctx->playing && queued >= ctx->target) {
+		ctx->playing = true;
+		ctx->level = (double) (queued + ctx->device_frames);
+		SDL_AtomicSet(&ctx->started, 1);
+	}
+
+	uint32_t got = ctx->playing ? handoff_ring_read(ctx->ring, stream, want) : 0;
+	memset(stream + got * sizeof(int16_t) * CHANNELS, 0, (want - got) * sizeof(int16_t) * CHANNELS);
+
+	if (ctx->playing && got < want) {
+		SDL_AtomicAdd(&ctx->underruns, 1);
+		SDL_AtomicSet(&ctx->started, 0);
+		ctx->playing = false;
+		return;
+	}
+
+	// what the next sample written will wait through, smoothed over the producer's bursts
+	double level = (double) (handoff_ring_queued(ctx->ring) + ctx->device_frames);
+	ctx->level += (level - ctx->level) / (double) (1 << LEVEL_SHIFT);
+
+	SDL_AtomicSet(&ctx->level_frames, (int) lrint(ctx->level));
+}
+
+
+/*** AUDIO ***/
+
+int32_t audio_init(struct audio **ctx_out, uint32_t sample_rate, uint32_t latency_ms)
 {
 	struct audio *ctx = *ctx_out = calloc(1, sizeof(struct audio));
 
@@ -36,16 +90,38 @@ int32_t audio_init(struct audio **ctx_out, uint32_t sample_rate)
 	}
 	#endif
 
+	// the device buffer is kept small, the ring holds the rest of the latency
+	uint32_t device_frames = 1;
+	while (device_frames < sample_rate * DEVICE_MS / 1000)
+		device_frames <<= 1;
+
 	SDL_AudioSpec want = {0};
 	want.freq = sample_rate;
 	want.format = AUDIO_S16;
 	want.channels = CHANNELS;
-	want.samples = 1024;
+	want.samples = (Uint16) device_frames;
+	want.callback = audio_callback;
+	want.userdata = ctx;
 
 	SDL_AudioSpec have = {0};
 	ctx->dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
 	if (ctx->dev == 0) {r = -1; goto except;}
 
+	ctx->sample_rate = sample_rate;
+	ctx->device_frames = have.samples;
+	ctx->target = sample_rate * latency_ms / 1000;
+
+	if (ctx->target > ctx->device_frames) {
+		ctx->target -= ctx->device_frames;
+
+	} else {
+		ctx->target = 1;
+	}
+
+	handoff_ring_init(&ctx->ring, ctx->target * 4, sizeof(int16_t) * CHANNELS);
+
+	SDL_PauseAudioDevice(ctx->dev, 0);
+
 	except:
 
 	if (r != 0)
@@ -67,71 +143,47 @@ void audio_destroy(struct audio **ctx_out)
 		SDL_CloseAudioDevice(ctx->dev);
 	}
 
+	handoff_ring_destroy(&ctx->ring);
+
 	free(ctx);
 	*ctx_out = NULL;
 }
 
-int32_t audio_play(struct audio *ctx, struct audio_timer *timer, int16_t *frames, size_t count)
+void audio_queue(struct audio *ctx, const int16_t *frames, size_t count)
 {
-	uint32_t queued_bytes = SDL_GetQueuedAudioSize(ctx->dev);
-	uint32_t queued_frames = (queued_bytes / sizeof(int16_t)) / CHANNELS;
-
-	// let the buffer accumulate before playing
-	if (queued_frames > timer->buf && !timer->playing) {
-		SDL_PauseAudioDevice(ctx->dev, 0);
-		timer->playing = true;
-	}
+	// anything past twice the target is dropped rather than left to drain at the skew limit
+	uint32_t queued = handoff_ring_queued(ctx->ring);
+	uint32_t room = (queued < ctx->target * 2) ? ctx->target * 2 - queued : 0;
+	uint32_t n = count > room ? room : (uint32_t) count;
 
-	int32_t e = SDL_QueueAudio(ctx->dev, frames, (Uint32) (count  * sizeof(int16_t) * CHANNELS));
-
-	return (e == 0) ? 0 : -1;
+	if (handoff_ring_write(ctx->ring, frames, n) < count)
+		SDL_AtomicAdd(&ctx->overruns, 1);
 }
 
 
-/*** TIMING / SAMPLE RATE ***/
+/*** RATE CONTROL ***/
 
-struct audio_timer audio_timer_init(bool playing, uint32_t sample_rate)
-{
-	struct audio_timer timer;
-	memset(&timer, 0, sizeof(struct audio_timer));
+// proportional control on the smoothed latency. the rate moves by at most MAX_SKEW, reached when
+// the latency is off by SKEW_RANGE of the target, which stays well under what can be heard as pitch
 
-	timer.buf = (sample_rate / 100) * 10; // 100 ms
-	timer.sample_rate = sample_rate;
-	timer.playing = playing;
-	timer.pfrequency = (double) SDL_GetPerformanceFrequency();
-
-	return timer;
-}
-
-void audio_timer_add_frames(struct audio_timer *timer, size_t count)
+int32_t audio_rate_adjust(struct audio *ctx)
 {
-	timer->ms += 1000.0 * ((double) count / (double) timer->sample_rate);
-
-	double counter = (double) SDL_GetPerformanceCounter();
-
-	if (timer->start > 0.1)
-		timer->ms -= 1000.0 * (counter - timer->start) / timer->pfrequency;
+	if (!SDL_AtomicGet(&ctx->started))
+		return 0;
 
-	if (timer->ms < 0.0)
-		timer->ms = 0.0;
+	double target = (double) (ctx->target + ctx->device_frames);
+	double error = ((double) SDL_AtomicGet(&ctx->level_frames) - target) / (target * SKEW_RANGE);
 
-	timer->start = counter;
-	timer->queued_frames = lrint((timer->ms / 1000.0) * (double) timer->sample_rate);
-}
-
-int32_t audio_timer_rate_adjust(struct audio_timer *timer)
-{
-	if (timer->playing && timer->next_adjust++ > NEXT_ADJUST) {
-		timer->adjustment += (timer->queued_frames > timer->buf && timer->prev_queued < timer->queued_frames) ? -ADJUST_INT :
-			(timer->queued_frames < timer->buf && timer->prev_queued > timer->queued_frames) ? ADJUST_INT : 0;
-		timer->next_adjust = 0;
-		timer->prev_queued = timer->queued_frames;
-	}
+	if (error > 1.0) error = 1.0;
+	if (error < -1.0) error = -1.0;
 
-	return timer->adjustment;
+	return (int32_t) lrint(-error * MAX_SKEW * (double) ctx->sample_rate);
 }
 
-bool audio_timer_past_buffer(struct audio_timer *timer)
+void audio_get_stats(struct audio *ctx, struct audio_stats *stats)
 {
-	return timer->queued_frames > timer->buf;
+	stats->latency_ms = SDL_AtomicGet(&ctx->started) ?
+		1000.0 * (double) SDL_AtomicGet(&ctx->level_frames) / (double) ctx->sample_rate : 0.0;
+	stats->underruns = (uint32_t) SDL_AtomicGet(&ctx->underruns);
+	stats->overruns = (uint32_t) SDL_AtomicGet(&ctx->overruns);
 }
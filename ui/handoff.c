@@ -0,0 +1,148 @@
+#include "handoff.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL2/SDL.h"
+
+#define FRAME_FRESH 0x4
+
+
+/*** FRAMES ***/
+
+// state holds the middle slot plus a fresh bit, each side swaps its own slot with the middle one
+
+struct handoff_frames {
+	struct frame slots[3];
+	SDL_atomic_t state;
+	int32_t back;
+	int32_t front;
+	bool published;
+};
+
+void handoff_frames_init(struct handoff_frames **hf_out)
+{
+	struct handoff_frames *hf = *hf_out = calloc(1, sizeof(struct handoff_frames));
+
+	hf->back = 0;
+	hf->front = 1;
+	SDL_AtomicSet(&hf->state, 2);
+}
+
+void handoff_frames_destroy(struct handoff_frames **hf_out)
+{
+	if (!hf_out || !*hf_out) return;
+
+	free(*hf_out);
+	*hf_out = NULL;
+}
+
+struct frame *handoff_frames_back(struct handoff_frames *hf)
+{
+	return &hf->slots[hf->back];
+}
+
+void handoff_frames_publish(struct handoff_frames *hf)
+{
+	hf->back = SDL_AtomicSet(&hf->state, hf->back | FRAME_FRESH) & 0x3;
+}
+
+struct frame *handoff_frames_front(struct handoff_frames *hf, bool *fresh)
+{
+	*fresh = SDL_AtomicGet(&hf->state) & FRAME_FRESH;
+
+	if (*fresh) {
+		hf->front = SDL_AtomicSet(&hf->state, hf->front) & 0x3;
+		hf->published = true;
+	}
+
+	return hf->published ? &hf->slots[hf->front] : NULL;
+}
+
+
+/*** RING ***/
+
+// head and tail only ever grow, their difference is the fill level even across wraparound
+
+struct handoff_ring {
+	uint8_t *buf;
+	uint32_t mask;
+	size_t elem;
+	SDL_atomic_t head; //written by the producer
+	SDL_atomic_t tail; //written by the consumer
+};
+
+void handoff_ring_init(struct handoff_ring **ring_out, uint32_t size, size_t elem)
+{
+	struct handoff_ring *ring = *ring_out = calloc(1, sizeof(struct handoff_ring));
+
+	uint32_t n = 1;
+	while (n < size)
+		n <<= 1;
+
+	ring->buf = calloc(n, elem);
+	ring->mask = n - 1;
+	ring->elem = elem;
+}
+
+void handoff_ring_destroy(struct handoff_ring **ring_out)
+{
+	if (!ring_out || !*ring_out) return;
+
+	struct handoff_ring *ring = *ring_out;
+
+	free(ring->buf);
+	free(ring);
+	*ring_out = NULL;
+}
+
+static void handoff_ring_copy(struct handoff_ring *ring, uint32_t pos, void *dst, const void *src, uint32_t n, bool in)
+{
+	uint32_t start = pos & ring->mask;
+	uint32_t first = ring->mask + 1 - start;
+	if (first > n) first = n;
+
+	uint8_t *a = ring->buf + start * ring->elem;
+	uint8_t *b = ring->buf;
+
+	if (in) {
+		memcpy(a, src, first * ring->elem);
+		memcpy(b, (const uint8_t *) src + first * ring->elem, (n - first) * ring->elem);
+
+	} else {
+		memcpy(dst, a, first * ring->elem);
+		memcpy((uint8_t *) dst + first * ring->elem, b, (n - first) * ring->elem);
+	}
+}
+
+uint32_t handoff_ring_write(struct handoff_ring *ring, const void *buf, uint32_t n)
+{
+	uint32_t head = (uint32_t) SDL_AtomicGet(&ring->head);
+	uint32_t space = ring->mask + 1 - (head - (uint32_t) SDL_AtomicGet(&ring->tail));
+	if (n > space) n = space;
+
+	handoff_ring_copy(ring, head, NULL, buf, n, true);
+
+	// the data is in place before the consumer can see the new head
+	SDL_AtomicSet(&ring->head, (int) (head + n));
+
+	return n;
+}
+
+uint32_t handoff_ring_read(struct handoff_ring *ring, void *buf, uint32_t n)
+{
+	uint32_t tail = (uint32_t) SDL_AtomicGet(&ring->tail);
+	uint32_t queued = (uint32_t) SDL_AtomicGet(&ring->head) - tail;
+	if (n > queued) n = queued;
+
+	handoff_ring_copy(ring, tail, buf, NULL, n, false);
+
+	SDL_AtomicSet(&ring->tail, (int) (tail + n));
+
+	return n;
+}
+
+uint32_t handoff_ring_queued(struct handoff_ring *ring)
+{
+	return (uint32_t) SDL_AtomicGet(&ring->head) - (uint32_t) SDL_AtomicGet(&ring->tail);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../src/nes.h"
+
+// everything here has exactly one producer thread and one consumer thread
+
+struct frame {
+	bool indexed;
+
+	union {
+		uint32_t pixels[256 * 240];
+		uint16_t indexes[256 * 240];
+	} data;
+};
+
+struct input_event {
+	int8_t player; //-1 for the local netplay player
+	bool down;
+	enum nes_button button;
+};
+
+struct handoff_frames;
+struct handoff_ring;
+
+/*** FRAMES ***/
+// a triple buffer, the producer always has a free slot and the consumer always gets the newest frame
+void handoff_frames_init(struct handoff_frames **hf_out);
+void handoff_frames_destroy(struct handoff_frames **hf_out);
+struct frame *handoff_frames_back(struct handoff_frames *hf);
+void handoff_frames_publish(struct handoff_frames *hf);
+
+// NULL until the first frame is published, fresh is set when it wasn't seen before
+struct frame *handoff_frames_front(struct handoff_frames *hf, bool *fresh);
+
+/*** RING ***/
+// size is in elements and rounded up to a power of 2, writes that don't fit are cut short
+void handoff_ring_init(struct handoff_ring **ring_out, uint32_t size, size_t elem);
+void handoff_ring_destroy(struct handoff_ring **ring_out);
+uint32_t handoff_ring_write(struct handoff_ring *ring, const void *buf, uint32_t n);
+uint32_t handoff_ring_read(struct handoff_ring *ring, void *buf, uint32_t n);
+uint32_t handoff_ring_queued(struct handoff_ring *ring);
@@ -17,12 +17,22 @@
 #include "settings.h"
 #include "fs.h"
 #include "audio.h"
+#include "netplay.h"
+#include "handoff.h"
+#include "pacer.h"
+#include "shm.h"
 
 #define NES_W 256
 #define NES_H 240
 #define WINDOW_W (NES_W * 3)
 #define WINDOW_H (NES_H * 3)
 #define MULTIPLAYER 1
+#define RUN_AHEAD_MAX 3
+#define FAST_FORWARD_MS 12.0
+#define NES_FPS 60.0988
+#define AUDIO_RING 16384
+#define AUDIO_LATENCY 30
+#define INPUT_RING 256
 
 #define GAME_ID "1PkOI9mOWWueqygCthcfx7iFXtM"
 
@@ -30,7 +40,6 @@ struct cdd {
 	struct nes *nes;
 	struct render *render;
 	struct api *api;
-	struct audio_timer atimer;
 	struct audio *audio;
 	struct settings *settings;
 	struct args args;
@@ -39,9 +48,11 @@ struct cdd {
 	uint32_t cropped[NES_W * NES_H];
 	char crc32[10];
 	bool done;
+	bool fast_forward;
 
 	// Audio
 	uint32_t sample_rate;
+	uint32_t audio_latency;
 	bool stereo;
 
 	// Video
@@ -56,6 +67,32 @@ struct cdd {
 	ParsecHostConfig host_cfg;
 	bool hosting;
 	int32_t pairing[4];
+
+	// Run-Ahead
+	uint8_t run_ahead;
+	double run_ahead_ms;
+	SDL_atomic_t run_ahead_us;
+	void *state;
+	size_t state_size; // allocated
+	size_t state_len;  // saved
+
+	// Netplay
+	struct netplay_transport *transport;
+	struct netplay *netplay;
+
+	// Emulation thread, the lock is held while it steps and by the main thread to touch the nes
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	struct pacer *frame_pacer;
+	struct pacer *present_pacer;
+	SDL_atomic_t lag_frames;
+
+	// Shared memory output for an external encoder
+	struct shm *shm;
+	SDL_atomic_t stop;
+	struct handoff_frames *frames;
+	struct handoff_ring *samples;
+	struct handoff_ring *input;
 };
 
 
@@ -154,12 +191,123 @@ static void cddnes_parsec_to_sdl(ParsecMessage *msg, SDL_Event *event)
 
 
 
+/*** LATE INPUT ***/
+
+// input queued by the main thread is applied right as the game latches the controllers instead of
+// when the emulation frame starts. frames run as a burst at the start of each period, so this only
+// gains the wall time it takes to run up to the latch, not the emulated time before it. netplay
+// input stays on its fixed frames
+
+static void cddnes_input_poll(void *opaque)
+{
+	struct cdd *cdd = (struct cdd *) opaque;
+
+	if (cdd->netplay)
+		return;
+
+	for (struct input_event in; handoff_ring_read(cdd->input, &in, 1) > 0;)
+		nes_controller(cdd->nes, in.player, in.button, in.down);
+}
+
+
+
+/*** RUN-AHEAD ***/
+
+// https://docs.libretro.com/guides/runahead/
+// the real frame runs with video off and keeps its audio, then the state is saved, the next
+// frames are run with the same input and the last one is shown before the state is restored
+
+static void cddnes_load_run_ahead(struct cdd *cdd)
+{
+	char key[32];
+	snprintf(key, 32, "run_ahead_%s", cdd->crc32);
+
+	int32_t frames = settings_get_int32(cdd->settings, key, 0);
+	cdd->run_ahead = (frames > 0 && frames <= RUN_AHEAD_MAX) ? (uint8_t) frames : 0;
+	cdd->run_ahead_ms = 0.0;
+	SDL_AtomicSet(&cdd->run_ahead_us, 0);
+}
+
+static void cddnes_step(struct cdd *cdd)
+{
+	if (cdd->run_ahead == 0 || nes_state_size(cdd->nes) == 0) {
+		nes_step(cdd->nes);
+		return;
+	}
+
+	nes_set_output(cdd->nes, false, true);
+	nes_step(cdd->nes);
+
+	uint64_t start = SDL_GetPerformanceCounter();
+
+	// the frame can map cart RAM for the first time, which grows the state
+	size_t size = nes_state_size(cdd->nes);
+	if (size > cdd->state_size) {
+		cdd->state = realloc(cdd->state, size);
+		cdd->state_size = size;
+	}
+
+	nes_state_save(cdd->nes, cdd->state);
+	cdd->state_len = size;
+
+	// input taken from the ring during these would be lost with the restore
+	nes_set_input_callback(cdd->nes, NULL);
+
+	for (uint8_t x = 1; x <= cdd->run_ahead; x++) {
+		nes_set_output(cdd->nes, x == cdd->run_ahead, false);
+		nes_step(cdd->nes);
+	}
+
+	bool restored = nes_state_load(cdd->nes, cdd->state, cdd->state_len);
+	nes_set_output(cdd->nes, true, true);
+	nes_set_input_callback(cdd->nes, cddnes_input_poll);
+
+	// the console would stay ahead for good, stop running ahead rather than drift further
+	if (!restored) {
+		printf("Run-ahead state failed to load, run-ahead disabled\n");
+		cdd->run_ahead = 0;
+		cdd->run_ahead_ms = 0.0;
+		SDL_AtomicSet(&cdd->run_ahead_us, 0);
+		return;
+	}
+
+	// smoothed cost of the save, speculative frames and restore
+	double ms = 1000.0 * ((double) (SDL_GetPerformanceCounter() - start)) /
+		(double) SDL_GetPerformanceFrequency();
+	cdd->run_ahead_ms = cdd->run_ahead_ms > 0.0 ? cdd->run_ahead_ms * 0.95 + ms * 0.05 : ms;
+	SDL_AtomicSet(&cdd->run_ahead_us, lrint(cdd->run_ahead_ms * 1000.0));
+}
+
+
+/*** FAST-FORWARD ***/
+
+// frames run with no pixels or samples until most of a display frame has passed, then one
+// more is drawn so the screen keeps moving, audio stays muted the whole time
+
+static void cddnes_fast_forward_step(struct cdd *cdd, uint64_t frame_start)
+{
+	double freq = (double) SDL_GetPerformanceFrequency();
+
+	nes_set_output(cdd->nes, false, false);
+
+	while (1000.0 * ((double) (SDL_GetPerformanceCounter() - frame_start)) / freq < FAST_FORWARD_MS)
+		nes_step(cdd->nes);
+
+	nes_set_output(cdd->nes, true, false);
+	nes_step(cdd->nes);
+
+	nes_set_output(cdd->nes, true, true);
+}
+
+
 /*** UI CALLBACKS ***/
 
 static void cddnes_open(char *path, char *name, void *opaque)
 {
 	struct cdd *cdd = (struct cdd *) opaque;
 
+	SDL_LockMutex(cdd->lock);
+
 	if (cdd->crc32[0] != '\0')
 		fs_save_sram(cdd->nes, cdd->crc32);
 
@@ -171,6 +319,11 @@ static void cddnes_open(char *path, char *name, void *opaque)
 	char full_path[MAX_FILE_NAME];
 	fs_path(full_path, path, name);
 	fs_load_rom(cdd->nes, full_path, cdd->crc32);
+
+	cddnes_load_run_ahead(cdd);
+	SDL_AtomicSet(&cdd->lag_frames, 0);
+
+	SDL_UnlockMutex(cdd->lock);
 }
 
 static void cddnes_exit(void *opaque)
@@ -184,7 +337,9 @@ static void cddnes_reset(void *opaque)
 {
 	struct cdd *cdd = (struct cdd *) opaque;
 
+	SDL_LockMutex(cdd->lock);
 	nes_reset(cdd->nes, false);
+	SDL_UnlockMutex(cdd->lock);
 }
 
 static ParsecStatus cddnes_host(bool enabled, bool logout, void *opaque)
@@ -251,21 +406,39 @@ static void cddnes_stereo(void *opaque)
 {
 	struct cdd *cdd = (struct cdd *) opaque;
 
+	SDL_LockMutex(cdd->lock);
 	cdd->stereo = !cdd->stereo;
 	nes_set_stereo(cdd->nes, cdd->stereo);
+	SDL_UnlockMutex(cdd->lock);
 }
 
 static void cddnes_sample_rate(uint32_t sample_rate, void *opaque)
 {
 	struct cdd *cdd = (struct cdd *) opaque;
 
+	// the emulation thread writes into the device's ring, so it can't run while the device is replaced
+	SDL_LockMutex(cdd->lock);
 	cdd->sample_rate = sample_rate;
 	nes_set_sample_rate(cdd->nes, sample_rate);
 
 	audio_destroy(&cdd->audio);
+	audio_init(&cdd->audio, cdd->sample_rate, cdd->audio_latency);
+	SDL_UnlockMutex(cdd->lock);
+}
+
+static void cddnes_audio_latency(uint32_t ms, void *opaque)
+{
+	struct cdd *cdd = (struct cdd *) opaque;
+
+	SDL_LockMutex(cdd->lock);
+	cdd->audio_latency = ms;
 
-	cdd->atimer = audio_timer_init(cdd->args.headless, cdd->sample_rate);
-	audio_init(&cdd->audio, sample_rate);
+	if (cdd->audio) {
+		audio_destroy(&cdd->audio);
+		audio_init(&cdd->audio, cdd->sample_rate, cdd->audio_latency);
+	}
+
+	SDL_UnlockMutex(cdd->lock);
 }
 
 static void cddnes_sampler(enum sampler sampler, void *opaque)
@@ -299,6 +472,30 @@ static void cddnes_aspect(uint32_t aspect, void *opaque)
 	cdd->aspect = aspect;
 }
 
+static void cddnes_fast_forward(bool enabled, void *opaque)
+{
+	struct cdd *cdd = (struct cdd *) opaque;
+
+	SDL_LockMutex(cdd->lock);
+	cdd->fast_forward = enabled;
+	SDL_UnlockMutex(cdd->lock);
+}
+
+static void cddnes_run_ahead(uint8_t frames, void *opaque)
+{
+	struct cdd *cdd = (struct cdd *) opaque;
+
+	SDL_LockMutex(cdd->lock);
+	cdd->run_ahead = frames;
+	cdd->run_ahead_ms = 0.0;
+	SDL_AtomicSet(&cdd->run_ahead_us, 0);
+	SDL_UnlockMutex(cdd->lock);
+
+	char key[32];
+	snprintf(key, 32, "run_ahead_%s", cdd->crc32);
+	settings_set_int32(cdd->settings, key, frames);
+}
+
 static void cddnes_overscan(int32_t index, int32_t crop, void *opaque)
 {
 	struct cdd *cdd = (struct cdd *) opaque;
@@ -323,48 +520,113 @@ static void cddnes_crop_copy(uint32_t *dest, uint32_t *src, struct rect *crop)
 			src + row * NES_W + crop->left, 4 * (NES_W - crop->left - crop->right));
 }
 
-static void cddnes_log(char *str)
+static void cddnes_log(char *str, void *opaque)
 {
+	opaque;
+
 	printf("[D CDDNES] %s\n", str);
 }
 
-static void cddnes_new_frame(uint32_t *pixels, void *opaque)
+static void cddnes_draw_size(struct cdd *cdd, int32_t *w, int32_t *h)
 {
-	struct cdd *cdd = (struct cdd *) opaque;
-
-	bool crop = cdd->overscan.top > 0 || cdd->overscan.right > 0
-		|| cdd->overscan.bottom > 0 || cdd->overscan.left > 0;
-
-	if (crop)
-		cddnes_crop_copy(cdd->cropped, pixels, &cdd->overscan);
-
-	int32_t w = WINDOW_W;
-	int32_t h = WINDOW_H;
+	*w = WINDOW_W;
+	*h = WINDOW_H;
 
 	if (cdd->window) {
 		if (cdd->mode == RENDER_GL) {
-			SDL_GL_GetDrawableSize(cdd->window, &w, &h);
+			SDL_GL_GetDrawableSize(cdd->window, w, h);
 
 		} else {
-			SDL_GetWindowSize(cdd->window, &w, &h);
+			SDL_GetWindowSize(cdd->window, w, h);
 		}
 	}
+}
 
-	render_draw(cdd->render, w, h, crop ? cdd->cropped : pixels, cdd->aspect);
+// the nes callbacks fire on the emulation thread, frames and samples are handed to the main thread
+
+static void cddnes_new_frame(uint32_t *pixels, void *opaque)
+{
+	struct cdd *cdd = (struct cdd *) opaque;
+
+	struct frame *frame = handoff_frames_back(cdd->frames);
+	frame->indexed = false;
+	memcpy(frame->data.pixels, pixels, sizeof(frame->data.pixels));
+
+	handoff_frames_publish(cdd->frames);
+
+	if (cdd->shm)
+		shm_write_frame(cdd->shm, pixels);
+}
+
+static void cddnes_new_indexes(uint16_t *indexes, void *opaque)
+{
+	struct cdd *cdd = (struct cdd *) opaque;
+
+	struct frame *frame = handoff_frames_back(cdd->frames);
+	frame->indexed = true;
+	memcpy(frame->data.indexes, indexes, sizeof(frame->data.indexes));
+
+	handoff_frames_publish(cdd->frames);
 }
 
 static void cddnes_new_samples(int16_t *samples, size_t count, void *opaque)
 {
 	struct cdd *cdd = (struct cdd *) opaque;
 
+	// the audio device pulls from its own ring, parsec gets a copy through the main thread
+	if (cdd->audio)
+		audio_queue(cdd->audio, samples, count);
+
 	if (cdd->parsec)
-		ParsecHostSubmitAudio(cdd->parsec, PCM_FORMAT_INT16, cdd->sample_rate,
-			(uint8_t *) samples, (uint32_t) count);
+		handoff_ring_write(cdd->samples, samples, (uint32_t) count);
+
+	if (cdd->shm)
+		shm_write_samples(cdd->shm, samples, count, cdd->sample_rate);
+}
 
-	audio_timer_add_frames(&cdd->atimer, count);
 
-	if (cdd->audio)
-		audio_play(cdd->audio, &cdd->atimer, samples, count);
+
+/*** PRESENTATION ***/
+
+// the newest finished frame is drawn every time, even when it was already shown, so the UI always
+// has a fresh backdrop
+
+static void cddnes_draw(struct cdd *cdd)
+{
+	bool fresh = false;
+	struct frame *frame = handoff_frames_front(cdd->frames, &fresh);
+
+	if (!frame)
+		return;
+
+	int32_t w, h;
+	cddnes_draw_size(cdd, &w, &h);
+
+	// the renderer does the palette lookup and cropping
+	if (frame->indexed) {
+		if (render_indexed(cdd->render))
+			render_draw_indexes(cdd->render, w, h, frame->data.indexes, &cdd->overscan, cdd->aspect);
+
+		return;
+	}
+
+	uint32_t *pixels = frame->data.pixels;
+
+	bool crop = cdd->overscan.top > 0 || cdd->overscan.right > 0
+		|| cdd->overscan.bottom > 0 || cdd->overscan.left > 0;
+
+	if (crop)
+		cddnes_crop_copy(cdd->cropped, pixels, &cdd->overscan);
+
+	render_draw(cdd->render, w, h, crop ? cdd->cropped : pixels, cdd->aspect);
+}
+
+static void cddnes_submit_audio(struct cdd *cdd)
+{
+	int16_t samples[1024 * 2];
+
+	for (uint32_t count; (count = handoff_ring_read(cdd->samples, samples, 1024)) > 0;)
+		ParsecHostSubmitAudio(cdd->parsec, PCM_FORMAT_INT16, cdd->sample_rate, (uint8_t *) samples, count);
 }
 
 
@@ -414,7 +676,8 @@ static int8_t cddnes_find_pairing(int32_t *pairing, int32_t id)
 	return -1;
 }
 
-static void cddnes_sdl_input(struct nes *nes, struct render *render, SDL_Event *event, int32_t *pairing, int32_t id)
+static void cddnes_sdl_input(struct handoff_ring *input, bool netplay, struct render *render, SDL_Event *event,
+	int32_t *pairing, int32_t id)
 {
 	enum nes_button button = 0;
 	bool down = false;
@@ -435,15 +698,17 @@ static void cddnes_sdl_input(struct nes *nes, struct render *render, SDL_Event *
 			break;
 	}
 
-	if (button != 0) {
-		int8_t player = MULTIPLAYER ? cddnes_find_pairing(pairing, id) : 0;
+	// during netplay local input is fed to the session which applies it to the right player
+	struct input_event in = {.player = -1, .down = down, .button = button};
 
-		if (player != -1)
-			nes_controller(nes, player, button, down);
-	}
+	if (button != 0 && !netplay)
+		in.player = MULTIPLAYER ? cddnes_find_pairing(pairing, id) : 0;
+
+	if (button != 0 && (netplay || in.player != -1))
+		handoff_ring_write(input, &in, 1);
 }
 
-static void cddnes_poll_parsec(struct nes *nes, ParsecDSO *parsec, int32_t *pairing, struct render *render)
+static void cddnes_poll_parsec(struct handoff_ring *input, ParsecDSO *parsec, int32_t *pairing, struct render *render)
 {
 	ParsecGuest guest;
 
@@ -451,15 +716,15 @@ static void cddnes_poll_parsec(struct nes *nes, ParsecDSO *parsec, int32_t *pair
 		SDL_Event event = {0};
 		cddnes_parsec_to_sdl(&msg, &event);
 		render_ui_sdl_input(render, &event);
-		cddnes_sdl_input(nes, render, &event, pairing, guest.id);
+		cddnes_sdl_input(input, false, render, &event, pairing, guest.id);
 	}
 }
 
-static bool cddnes_poll_sdl(struct nes *nes, int32_t *pairing, struct render *render)
+static bool cddnes_poll_sdl(struct handoff_ring *input, bool netplay, int32_t *pairing, struct render *render)
 {
 	for (SDL_Event event; SDL_PollEvent(&event);) {
 		render_ui_sdl_input(render, &event);
-		cddnes_sdl_input(nes, render, &event, pairing, -1);
+		cddnes_sdl_input(input, netplay, render, &event, pairing, -1);
 
 		switch (event.type) {
 			case SDL_QUIT:
@@ -487,19 +752,90 @@ static bool cddnes_need_delay(SDL_Window *window)
 	return mode.refresh_rate > 62;
 }
 
-static void cddnes_delay_frame(uint64_t frame_start, bool past_buffer)
+
+
+/*** EMULATION THREAD ***/
+
+// frames are run on the console's own 60.0988 Hz clock, independent of the display
+
+static void cddnes_emu_frame(struct cdd *cdd, uint64_t frame_start)
 {
-	double diff = 1000.0 * ((double) (SDL_GetPerformanceCounter() - frame_start)) /
-		(double) SDL_GetPerformanceFrequency();
-	double delay = (past_buffer ? 17.0 : 15.0) - diff;
+	// other input stays queued for the latch
+	if (cdd->netplay) {
+		for (struct input_event in; handoff_ring_read(cdd->input, &in, 1) > 0;) {
+			if (in.player == -1) {
+				netplay_button(cdd->netplay, in.button, in.down);
+
+			} else {
+				nes_controller(cdd->nes, in.player, in.button, in.down);
+			}
+		}
+	}
+
+	// continue emulation, fires NES audio and frame callbacks
+	if (cdd->netplay) {
+		netplay_step(cdd->netplay);
+
+	} else if (cdd->fast_forward) {
+		cddnes_fast_forward_step(cdd, frame_start);
+
+	} else {
+		cddnes_step(cdd);
+	}
+
+	// nothing took the input this frame, apply it anyway so the ring can't back up
+	if (nes_lag_frame(cdd->nes)) {
+		SDL_AtomicAdd(&cdd->lag_frames, 1);
+		cddnes_input_poll(cdd);
+	}
+
+	// the sample rate follows the device's latency, fast-forward output is muted so there is none to follow
+	int32_t adjust = (cdd->audio && !cdd->fast_forward) ? audio_rate_adjust(cdd->audio) : 0;
+	nes_set_sample_rate(cdd->nes, cdd->sample_rate + adjust);
 
-	if (delay > 0.0)
-		SDL_Delay(lrint(delay));
+	// a correction that persists is clock drift against the audio device, the frame clock takes it over
+	pacer_correct(cdd->frame_pacer, (double) adjust / (double) cdd->sample_rate);
+}
+
+static int cddnes_emu_thread(void *opaque)
+{
+	struct cdd *cdd = (struct cdd *) opaque;
+
+	while (!SDL_AtomicGet(&cdd->stop)) {
+		uint64_t frame_start = SDL_GetPerformanceCounter();
+
+		SDL_LockMutex(cdd->lock);
+		cddnes_emu_frame(cdd, frame_start);
+		bool fast_forward = cdd->fast_forward;
+		SDL_UnlockMutex(cdd->lock);
+
+		// fast-forward never waits
+		if (fast_forward) {
+			pacer_reset(cdd->frame_pacer);
+
+		} else {
+			pacer_wait(cdd->frame_pacer);
+		}
+	}
+
+	return 0;
+}
+
+static void cddnes_stop_emu(struct cdd *cdd)
+{
+	if (!cdd->thread)
+		return;
+
+	SDL_AtomicSet(&cdd->stop, 1);
+	SDL_WaitThread(cdd->thread, NULL);
+	cdd->thread = NULL;
 }
 
 static void cddnes_load_settings(struct cdd *cdd)
 {
 	cdd->sample_rate = settings_get_int32(cdd->settings, "sample_rate", 44100);
+	cdd->audio_latency = settings_get_int32(cdd->settings, "audio_latency", AUDIO_LATENCY);
+	if (cdd->audio_latency < 20 || cdd->audio_latency > 40) cdd->audio_latency = AUDIO_LATENCY;
 	cdd->stereo = settings_get_bool(cdd->settings, "stereo", true);
 	cdd->vsync = settings_get_bool(cdd->settings, "vsync", true);
 	cdd->mode = settings_get_int32(cdd->settings, "mode", RENDER_GL);
@@ -514,6 +850,7 @@ static void cddnes_load_settings(struct cdd *cdd)
 static void cddnes_save_settings(struct cdd *cdd)
 {
 	settings_set_int32(cdd->settings, "sample_rate", cdd->sample_rate);
+	settings_set_int32(cdd->settings, "audio_latency", cdd->audio_latency);
 	settings_set_bool(cdd->settings, "stereo", cdd->stereo);
 	settings_set_bool(cdd->settings, "vsync", cdd->vsync);
 	settings_set_int32(cdd->settings, "mode", cdd->mode);
@@ -561,8 +898,6 @@ int32_t main(int32_t argc, char **argv)
 
 	int32_t e = 0;
 
-	cdd->atimer = audio_timer_init(cdd->args.headless, cdd->sample_rate);
-
 	if (!cdd->args.headless) {
 		e = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_TIMER);
 		if (e != 0) {printf("SDL_Init=%d\n", e); goto except;}
@@ -571,7 +906,7 @@ int32_t main(int32_t argc, char **argv)
 		cdd->window = SDL_CreateWindow("cddNES", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_W, WINDOW_H, flags);
 		if (cdd->window == NULL) {printf("SDL_CreateWindow=0\n"); goto except;}
 
-		e = audio_init(&cdd->audio, cdd->sample_rate);
+		e = audio_init(&cdd->audio, cdd->sample_rate, cdd->audio_latency);
 		if (e != 0) {printf("audio_init=%d\n", e); goto except;}
 	}
 
@@ -583,15 +918,44 @@ int32_t main(int32_t argc, char **argv)
 	if (cdd->parsec)
 		ParsecSetLogCallback(cdd->parsec, cddnes_parsec_log, NULL);
 
+	cdd->lock = SDL_CreateMutex();
+	pacer_init(&cdd->frame_pacer, NES_FPS);
+	pacer_init(&cdd->present_pacer, NES_FPS);
+	handoff_frames_init(&cdd->frames);
+	handoff_ring_init(&cdd->samples, AUDIO_RING, sizeof(int16_t) * 2);
+	handoff_ring_init(&cdd->input, INPUT_RING, sizeof(struct input_event));
+
+	if (cdd->args.shm) {
+		e = shm_init(&cdd->shm);
+		if (e != 0) {printf("shm_init=%d\n", e); goto except;}
+
+		char path[64];
+		shm_get_path(cdd->shm, path, 64);
+		printf("shm=%s\n", path);
+	}
+
 	nes_init(&cdd->nes, cdd->sample_rate, cdd->stereo, cddnes_new_frame, cddnes_new_samples, cdd);
-	nes_set_log_callback(cddnes_log);
+	nes_set_input_callback(cdd->nes, cddnes_input_poll);
+	nes_set_log_callback(cdd->nes, cddnes_log);
 
 	cddnes_clean_rom_name(cdd->host_cfg.desc, (cdd->args.rom[0] != '\0') ? cdd->args.rom : "Alfonzo Melee", HOST_DESC_LEN);
 	fs_load_rom(cdd->nes, cdd->args.rom, cdd->crc32);
+	cddnes_load_run_ahead(cdd);
 
 	if (cdd->parsec && cdd->args.session[0] != '\0')
 		cddnes_host(true, false, cdd);
 
+	if (cdd->args.netplay != 0) {
+		e = netplay_udp_init(&cdd->transport, cdd->args.netplay, cdd->args.peer);
+		if (e != 0) {printf("netplay_udp_init=%d\n", e); goto except;}
+
+		uint8_t player = cdd->args.player > 1 ? 1 : 0;
+		netplay_init(&cdd->netplay, cdd->nes, cdd->transport, player, cdd->args.delay);
+	}
+
+	cdd->thread = SDL_CreateThread(cddnes_emu_thread, "cddNES emulation", cdd);
+	if (!cdd->thread) {e = -1; printf("SDL_CreateThread=0\n"); goto except;}
+
 	while (!cdd->done) {
 		// init renderer and UI or look for render mode changes
 		if (cdd->reset) {
@@ -601,22 +965,34 @@ int32_t main(int32_t argc, char **argv)
 
 			struct ui_cbs cbs = {.open = cddnes_open, .exit = cddnes_exit, .reset = cddnes_reset,
 				.host = cddnes_host, .login = cddnes_login, .stereo = cddnes_stereo,
-				.sample_rate = cddnes_sample_rate, .sampler = cddnes_sampler, .mode = cddnes_mode,
+				.sample_rate = cddnes_sample_rate, .audio_latency = cddnes_audio_latency, .sampler = cddnes_sampler, .mode = cddnes_mode,
 				.vsync = cddnes_vsync, .aspect = cddnes_aspect, .overscan = cddnes_overscan,
-				.invite = cddnes_invite, .poll_code = cddnes_poll_code};
+				.invite = cddnes_invite, .poll_code = cddnes_poll_code, .run_ahead = cddnes_run_ahead,
+				.fast_forward = cddnes_fast_forward};
 			render_ui_init(cdd->render, cdd->window, &cbs, cdd);
 
+			// hand frames over as palette indexes when the renderer can look them up itself
+			SDL_LockMutex(cdd->lock);
+
+			if (render_indexed(cdd->render)) {
+				uint32_t palette[8 * 64];
+				nes_get_palette(cdd->nes, palette);
+				render_set_palette(cdd->render, palette);
+			}
+
+			// the shared memory sink wants finished RGBA frames
+			nes_set_index_callback(cdd->nes, render_indexed(cdd->render) && !cdd->shm ? cddnes_new_indexes : NULL);
+			SDL_UnlockMutex(cdd->lock);
+
 			if (cdd->mode == 0)
 				render_ui_set_popup(cdd->render, "Press ESC to hide/show the menu bar.", POPUP_TIMEOUT);
 
 			cdd->reset = false;
 		}
 
-		uint64_t frame_start = SDL_GetPerformanceCounter();
-
 		// poll input from parsec and locally via SDL
 		if (cdd->parsec) {
-			cddnes_poll_parsec(cdd->nes, cdd->parsec, cdd->pairing, cdd->render);
+			cddnes_poll_parsec(cdd->input, cdd->parsec, cdd->pairing, cdd->render);
 
 			for (ParsecHostEvent event; ParsecHostPollEvents(cdd->parsec, 0, &event);)
 				if (event.type == HOST_EVENT_GUEST_STATE_CHANGE)
@@ -624,16 +1000,31 @@ int32_t main(int32_t argc, char **argv)
 		}
 
 		if (cdd->window)
-			cdd->done = cddnes_poll_sdl(cdd->nes, cdd->pairing, cdd->render);
+			cdd->done = cddnes_poll_sdl(cdd->input, cdd->netplay != NULL, cdd->pairing, cdd->render);
 
-		// continue emulation, fires NES audio and frame callbacks
-		nes_step(cdd->nes);
+		// emulation runs on its own thread, pick up whatever it has finished since the last pass
+		if (cdd->parsec)
+			cddnes_submit_audio(cdd);
+
+		cddnes_draw(cdd);
+
+		struct audio_stats astats = {0};
+		if (cdd->audio)
+			audio_get_stats(cdd->audio, &astats);
+
+		uint32_t pacing[PACER_BINS], pacing_us[PACER_BINS];
+		pacer_get_histogram(cdd->frame_pacer, pacing, pacing_us);
 
 		// draws the UI overlay and fires events
 		struct ui_props props = {.parsec = cdd->parsec, .pairing = cdd->pairing,
 			.sample_rate = cdd->sample_rate, .stereo = cdd->stereo, .sampler = cdd->sampler,
+			.audio_latency = cdd->audio_latency, .audio_latency_ms = astats.latency_ms,
+			.underruns = astats.underruns, .overruns = astats.overruns,
 			.mode = cdd->mode, .logged_in = cdd->args.session[0], .hosting = cdd->hosting,
-			.vsync = cdd->vsync, .aspect = cdd->aspect, .overscan = cdd->overscan};
+			.vsync = cdd->vsync, .aspect = cdd->aspect, .overscan = cdd->overscan,
+			.run_ahead = cdd->run_ahead, .run_ahead_ms = SDL_AtomicGet(&cdd->run_ahead_us) / 1000.0, .fast_forward = cdd->fast_forward,
+			.pacing = pacing, .pacing_us = pacing_us, .pacing_bins = PACER_BINS,
+			.lag_frames = (uint32_t) SDL_AtomicGet(&cdd->lag_frames)};
 		render_ui_draw(cdd->render, cdd->window, &props);
 
 		// submits the final render to Parsec
@@ -644,21 +1035,30 @@ int32_t main(int32_t argc, char **argv)
 		render_present(cdd->render);
 
 		// if vsync is off or refresh rate is high, the next frame needs to be delayed
-		if (!cdd->vsync || cdd->args.headless || cddnes_need_delay(cdd->window)) {
-			cddnes_delay_frame(frame_start, audio_timer_past_buffer(&cdd->atimer));
-			nes_set_sample_rate(cdd->nes, cdd->sample_rate);
-
-		// adjust sample rate to compensate for variations in refresh rate
-		} else {
-			nes_set_sample_rate(cdd->nes, cdd->sample_rate + audio_timer_rate_adjust(&cdd->atimer));
-		}
+		if (!cdd->vsync || cdd->args.headless || cddnes_need_delay(cdd->window))
+			pacer_wait(cdd->present_pacer);
 	}
 
+	cddnes_stop_emu(cdd);
 	fs_save_sram(cdd->nes, cdd->crc32);
 
 	except:
 
+	cddnes_stop_emu(cdd);
+
+	netplay_destroy(&cdd->netplay);
+	netplay_transport_destroy(&cdd->transport);
 	nes_destroy(&cdd->nes);
+	handoff_ring_destroy(&cdd->input);
+	handoff_ring_destroy(&cdd->samples);
+	handoff_frames_destroy(&cdd->frames);
+	pacer_destroy(&cdd->present_pacer);
+	pacer_destroy(&cdd->frame_pacer);
+	shm_destroy(&cdd->shm);
+
+	if (cdd->lock)
+		SDL_DestroyMutex(cdd->lock);
+
 	ParsecDestroy(cdd->parsec);
 	api_destroy(&cdd->api);
 	render_destroy(&cdd->render);
@@ -672,6 +1072,7 @@ int32_t main(int32_t argc, char **argv)
 	cddnes_save_settings(cdd);
 	settings_close(&cdd->settings);
 
+	free(cdd->state);
 	free(cdd);
 
 	return 0;
@@ -0,0 +1,589 @@
+#include "netplay.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+#else
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <netdb.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#define NETPLAY_MAGIC   0x31504E43 // "CNP1"
+#define NETPLAY_RING    128
+#define NETPLAY_STATES  16
+#define NETPLAY_HISTORY 64
+#define NETPLAY_HEADER  13
+#define NETPLAY_PACKET  (NETPLAY_HEADER + NETPLAY_HISTORY)
+
+#define LOOPBACK_QUEUE 256
+
+
+/*** TRANSPORT ***/
+
+struct transport_ops {
+	void (*send)(struct netplay_transport *t, const uint8_t *buf, size_t size);
+	size_t (*recv)(struct netplay_transport *t, uint8_t *buf, size_t size);
+	void (*destroy)(struct netplay_transport *t);
+};
+
+struct netplay_transport {
+	const struct transport_ops *ops;
+};
+
+void netplay_transport_destroy(struct netplay_transport **t_out)
+{
+	if (!t_out || !*t_out) return;
+
+	(*t_out)->ops->destroy(*t_out);
+	*t_out = NULL;
+}
+
+
+/*** UDP ***/
+
+#if defined(_WIN32)
+	typedef SOCKET udp_socket;
+	#define UDP_INVALID INVALID_SOCKET
+
+	static void udp_close(udp_socket s)
+	{
+		closesocket(s);
+		WSACleanup();
+	}
+
+	static void udp_nonblocking(udp_socket s)
+	{
+		u_long mode = 1;
+		ioctlsocket(s, FIONBIO, &mode);
+	}
+#else
+	typedef int32_t udp_socket;
+	#define UDP_INVALID -1
+
+	static void udp_close(udp_socket s)
+	{
+		close(s);
+	}
+
+	static void udp_nonblocking(udp_socket s)
+	{
+		fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+	}
+#endif
+
+struct udp {
+	struct netplay_transport t;
+	udp_socket s;
+	struct sockaddr_in peer;
+};
+
+static void udp_send(struct netplay_transport *t, const uint8_t *buf, size_t size)
+{
+	struct udp *udp = (struct udp *) t;
+
+	sendto(udp->s, (const char *) buf, (int32_t) size, 0, (struct sockaddr *) &udp->peer, sizeof(struct sockaddr_in));
+}
+
+static size_t udp_recv(struct netplay_transport *t, uint8_t *buf, size_t size)
+{
+	struct udp *udp = (struct udp *) t;
+
+	while (true) {
+		struct sockaddr_in from;
+		socklen_t from_len = sizeof(struct sockaddr_in);
+
+		int32_t n = recvfrom(udp->s, (char *) buf, (int32_t) size, 0, (struct sockaddr *) &from, &from_len);
+		if (n <= 0)
+			return 0;
+
+		// drop anything that isn't from the peer
+		if (from.sin_addr.s_addr == udp->peer.sin_addr.s_addr && from.sin_port == udp->peer.sin_port)
+			return n;
+	}
+}
+
+static void udp_destroy(struct netplay_transport *t)
+{
+	struct udp *udp = (struct udp *) t;
+
+	udp_close(udp->s);
+	free(udp);
+}
+
+static const struct transport_ops UDP_OPS = {
+	.send = udp_send,
+	.recv = udp_recv,
+	.destroy = udp_destroy,
+};
+
+int32_t netplay_udp_init(struct netplay_transport **t_out, uint16_t port, char *peer)
+{
+	int32_t r = 0;
+
+	#if defined(_WIN32)
+		WSADATA wsa;
+		if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return -1;
+	#endif
+
+	struct udp *udp = calloc(1, sizeof(struct udp));
+	udp->t.ops = &UDP_OPS;
+	udp->s = UDP_INVALID;
+
+	char host[256];
+	snprintf(host, 256, "%s", peer);
+
+	char *service = strrchr(host, ':');
+	if (!service) {r = -1; goto except;}
+	*service++ = '\0';
+
+	struct addrinfo hints = {0};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	struct addrinfo *res = NULL;
+	if (getaddrinfo(host, service, &hints, &res) != 0) {r = -2; goto except;}
+
+	memcpy(&udp->peer, res->ai_addr, sizeof(struct sockaddr_in));
+	freeaddrinfo(res);
+
+	udp->s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (udp->s == UDP_INVALID) {r = -3; goto except;}
+
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if (bind(udp->s, (struct sockaddr *) &addr, sizeof(struct sockaddr_in)) != 0) {r = -4; goto except;}
+
+	udp_nonblocking(udp->s);
+
+	except:
+
+	if (r != 0) {
+		if (udp->s != UDP_INVALID) {
+			udp_close(udp->s);
+
+		} else {
+			#if defined(_WIN32)
+				WSACleanup();
+			#endif
+		}
+
+		free(udp);
+		udp = NULL;
+	}
+
+	*t_out = (struct netplay_transport *) udp;
+
+	return r;
+}
+
+
+/*** LOOPBACK ***/
+
+// an in-process pair for testing, each side has its own queue and clock so latency and
+// loss can be injected without touching the network
+
+struct loopback_packet {
+	uint32_t due;
+	size_t size;
+	uint8_t data[NETPLAY_PACKET];
+};
+
+struct loopback_link {
+	struct loopback_packet queue[2][LOOPBACK_QUEUE];
+	uint32_t head[2];
+	uint32_t tail[2];
+	uint32_t now[2];
+	uint32_t latency;
+	uint32_t loss;
+	uint32_t rng;
+	uint32_t refs;
+};
+
+struct loopback {
+	struct netplay_transport t;
+	struct loopback_link *link;
+	uint8_t side;
+};
+
+static void loopback_send(struct netplay_transport *t, const uint8_t *buf, size_t size)
+{
+	struct loopback *lb = (struct loopback *) t;
+	struct loopback_link *link = lb->link;
+	uint8_t to = !lb->side;
+
+	link->now[lb->side]++;
+
+	link->rng = link->rng * 1103515245 + 12345;
+	if ((link->rng >> 16) % 100 < link->loss)
+		return;
+
+	if (link->tail[to] - link->head[to] == LOOPBACK_QUEUE || size > NETPLAY_PACKET)
+		return;
+
+	struct loopback_packet *p = &link->queue[to][link->tail[to]++ % LOOPBACK_QUEUE];
+	p->due = link->now[to] + link->latency;
+	p->size = size;
+	memcpy(p->data, buf, size);
+}
+
+static size_t loopback_recv(struct netplay_transport *t, uint8_t *buf, size_t size)
+{
+	struct loopback *lb = (struct loopback *) t;
+	struct loopback_link *link = lb->link;
+	uint8_t side = lb->side;
+
+	if (link->head[side] == link->tail[side])
+		return 0;
+
+	struct loopback_packet *p = &link->queue[side][link->head[side] % LOOPBACK_QUEUE];
+	if (p->due > link->now[side] || p->size > size)
+		return 0;
+
+	link->head[side]++;
+	memcpy(buf, p->data, p->size);
+
+	return p->size;
+}
+
+static void loopback_destroy(struct netplay_transport *t)
+{
+	struct loopback *lb = (struct loopback *) t;
+
+	if (--lb->link->refs == 0)
+		free(lb->link);
+
+	free(lb);
+}
+
+static const struct transport_ops LOOPBACK_OPS = {
+	.send = loopback_send,
+	.recv = loopback_recv,
+	.destroy = loopback_destroy,
+};
+
+void netplay_loopback_init(struct netplay_transport **a_out, struct netplay_transport **b_out,
+	uint32_t latency, uint32_t loss)
+{
+	struct loopback_link *link = calloc(1, sizeof(struct loopback_link));
+	link->latency = latency;
+	link->loss = loss;
+	link->rng = 1;
+	link->refs = 2;
+
+	struct loopback *a = calloc(1, sizeof(struct loopback));
+	a->t.ops = &LOOPBACK_OPS;
+	a->link = link;
+	a->side = 0;
+
+	struct loopback *b = calloc(1, sizeof(struct loopback));
+	b->t.ops = &LOOPBACK_OPS;
+	b->link = link;
+	b->side = 1;
+
+	*a_out = (struct netplay_transport *) a;
+	*b_out = (struct netplay_transport *) b;
+}
+
+
+/*** PACKETS ***/
+
+// magic, first frame, ack, count, then one byte of buttons per frame, all little endian
+
+static void netplay_put32(uint8_t *b, uint32_t v)
+{
+	b[0] = v & 0xFF;
+	b[1] = (v >> 8) & 0xFF;
+	b[2] = (v >> 16) & 0xFF;
+	b[3] = v >> 24;
+}
+
+static uint32_t netplay_get32(const uint8_t *b)
+{
+	return b[0] | b[1] << 8 | b[2] << 16 | (uint32_t) b[3] << 24;
+}
+
+
+/*** SESSION ***/
+
+// https://words.infil.net/w02-netcode.html
+// local input is delayed by a few frames, the remote side is predicted to hold its last
+// confirmed buttons and the frames after a misprediction are re-simulated from a saved state
+
+struct netplay_input {
+	uint32_t tag; // frame + 1, 0 when empty
+	uint8_t buttons;
+};
+
+struct netplay_state {
+	void *buf;
+	size_t size; // allocated
+	size_t len;  // saved
+};
+
+struct netplay {
+	struct nes *nes;
+	struct netplay_transport *transport;
+	uint8_t player;
+	uint8_t delay;
+	uint8_t buttons;
+
+	uint32_t frame;        // next frame to run
+	uint32_t local_frame;  // next frame local input is recorded for
+	uint32_t remote_frame; // remote input is confirmed for every frame below this
+	uint32_t remote_ack;   // the peer has every local input below this
+	uint32_t rollback;     // earliest mispredicted frame, UINT32_MAX when none
+
+	struct netplay_input local[NETPLAY_RING];
+	struct netplay_input remote[NETPLAY_RING];
+	uint8_t used[NETPLAY_RING]; // remote buttons each frame actually ran with
+	struct netplay_state states[NETPLAY_STATES];
+};
+
+static void netplay_set_input(struct netplay_input *ring, uint32_t frame, uint8_t buttons)
+{
+	struct netplay_input *in = &ring[frame % NETPLAY_RING];
+
+	in->tag = frame + 1;
+	in->buttons = buttons;
+}
+
+static bool netplay_get_input(struct netplay_input *ring, uint32_t frame, uint8_t *buttons)
+{
+	struct netplay_input *in = &ring[frame % NETPLAY_RING];
+
+	if (in->tag != frame + 1)
+		return false;
+
+	*buttons = in->buttons;
+
+	return true;
+}
+
+static void netplay_send(struct netplay *net)
+{
+	uint32_t first = net->remote_ack;
+	if (net->local_frame - first > NETPLAY_HISTORY)
+		first = net->local_frame - NETPLAY_HISTORY;
+
+	uint8_t n = (uint8_t) (net->local_frame - first);
+
+	uint8_t buf[NETPLAY_PACKET];
+	netplay_put32(buf, NETPLAY_MAGIC);
+	netplay_put32(buf + 4, first);
+	netplay_put32(buf + 8, net->remote_frame);
+	buf[12] = n;
+
+	for (uint8_t x = 0; x < n; x++)
+		buf[NETPLAY_HEADER + x] = net->local[(first + x) % NETPLAY_RING].buttons;
+
+	net->transport->ops->send(net->transport, buf, NETPLAY_HEADER + n);
+}
+
+static void netplay_receive(struct netplay *net)
+{
+	uint8_t buf[NETPLAY_PACKET];
+
+	for (size_t size; (size = net->transport->ops->recv(net->transport, buf, NETPLAY_PACKET)) > 0;) {
+		if (size < NETPLAY_HEADER || netplay_get32(buf) != NETPLAY_MAGIC || size < (size_t) NETPLAY_HEADER + buf[12])
+			continue;
+
+		uint32_t first = netplay_get32(buf + 4);
+		uint32_t ack = netplay_get32(buf + 8);
+
+		if (ack > net->remote_ack && ack <= net->local_frame)
+			net->remote_ack = ack;
+
+		for (uint8_t x = 0; x < buf[12]; x++) {
+			uint32_t frame = first + x;
+
+			if (frame >= net->remote_frame && frame - net->remote_frame < NETPLAY_RING)
+				netplay_set_input(net->remote, frame, buf[NETPLAY_HEADER + x]);
+		}
+	}
+
+	// confirm in order, anything already run with the wrong prediction has to be redone
+	for (uint8_t buttons; netplay_get_input(net->remote, net->remote_frame, &buttons); net->remote_frame++)
+		if (net->remote_frame < net->frame && buttons != net->used[net->remote_frame % NETPLAY_RING] &&
+			net->remote_frame < net->rollback)
+			net->rollback = net->remote_frame;
+}
+
+static void netplay_apply(struct nes *nes, uint8_t player, uint8_t buttons)
+{
+	for (uint8_t x = 0; x < 8; x++)
+		nes_controller(nes, player, (enum nes_button) (1 << x), buttons & (1 << x));
+}
+
+static void netplay_run_frame(struct netplay *net, uint32_t frame, bool output)
+{
+	struct netplay_state *state = &net->states[frame % NETPLAY_STATES];
+
+	size_t size = nes_state_size(net->nes);
+	if (size > state->size) {
+		state->buf = realloc(state->buf, size);
+		state->size = size;
+	}
+
+	nes_state_save(net->nes, state->buf);
+	state->len = size;
+
+	uint8_t local = 0;
+	netplay_get_input(net->local, frame, &local);
+
+	// predict the remote side keeps holding whatever it last confirmed
+	uint8_t remote = 0;
+	if (!netplay_get_input(net->remote, frame, &remote) && net->remote_frame > 0)
+		netplay_get_input(net->remote, net->remote_frame - 1, &remote);
+
+	net->used[frame % NETPLAY_RING] = remote;
+
+	netplay_apply(net->nes, net->player, local);
+	netplay_apply(net->nes, !net->player, remote);
+
+	nes_set_output(net->nes, output, output);
+	nes_step(net->nes);
+}
+
+void netplay_button(struct netplay *net, enum nes_button button, bool down)
+{
+	if (down) {
+		net->buttons |= button;
+
+	} else {
+		net->buttons &= ~button;
+	}
+}
+
+uint32_t netplay_step(struct netplay *net)
+{
+	netplay_receive(net);
+
+	// too far ahead of the peer to roll back, wait for it to catch up
+	bool stalled = net->frame >= net->remote_frame + NETPLAY_MAX_ROLLBACK;
+
+	if (!stalled)
+		netplay_set_input(net->local, net->local_frame++, net->buttons);
+
+	netplay_send(net);
+
+	if (stalled)
+		return 0;
+
+	uint32_t frames = 1;
+
+	if (net->rollback < net->frame) {
+		struct netplay_state *state = &net->states[net->rollback % NETPLAY_STATES];
+		nes_state_load(net->nes, state->buf, state->len);
+
+		for (uint32_t x = net->rollback; x < net->frame; x++, frames++)
+			netplay_run_frame(net, x, false);
+	}
+
+	net->rollback = UINT32_MAX;
+
+	netplay_run_frame(net, net->frame++, true);
+
+	return frames;
+}
+
+
+/*** INIT & DESTROY ***/
+
+void netplay_init(struct netplay **net_out, struct nes *nes, struct netplay_transport *transport,
+	uint8_t player, uint8_t delay)
+{
+	struct netplay *net = *net_out = calloc(1, sizeof(struct netplay));
+
+	net->nes = nes;
+	net->transport = transport;
+	net->player = player > 0 ? 1 : 0;
+	net->delay = delay > NETPLAY_MAX_DELAY ? NETPLAY_MAX_DELAY : delay;
+	net->rollback = UINT32_MAX;
+
+	// the first frames have no local input yet, both sides agree they are empty
+	for (; net->local_frame < net->delay; net->local_frame++)
+		netplay_set_input(net->local, net->local_frame, 0);
+}
+
+void netplay_destroy(struct netplay **net_out)
+{
+	if (!net_out || !*net_out) return;
+
+	struct netplay *net = *net_out;
+
+	nes_set_output(net->nes, true, true);
+
+	for (uint32_t x = 0; x < NETPLAY_STATES; x++)
+		free(net->states[x].buf);
+
+	free(net);
+	*net_out = NULL;
+}
+
+
+/*** SELF TEST ***/
+
+#define TEST_DELAY 2
+
+// once every input before the frame is confirmed and no rollback is pending, its saved state is final
+static bool netplay_test_settled(struct netplay *net, uint32_t frame)
+{
+	return net->frame > frame && net->remote_frame > frame && net->rollback == UINT32_MAX;
+}
+
+bool netplay_check_loopback(struct nes *nes[2], uint32_t frames, uint32_t latency, uint32_t loss)
+{
+	struct netplay_transport *t[2] = {0};
+	struct netplay *net[2] = {0};
+	struct netplay_state final[2] = {0};
+	uint32_t rng = 1;
+
+	netplay_loopback_init(&t[0], &t[1], latency, loss);
+
+	for (uint8_t x = 0; x < 2; x++)
+		netplay_init(&net[x], nes[x], t[x], x, TEST_DELAY);
+
+	// each side changes its buttons at its own rate so both mispredict, then holds them so
+	// the sessions can settle
+	for (uint32_t step = 0; (!final[0].buf || !final[1].buf) && step < frames * 4; step++) {
+		for (uint8_t x = 0; x < 2; x++) {
+			struct netplay *n = net[x];
+
+			if (n->local_frame < frames && step % (5 + 2 * x) == 0) {
+				rng = rng * 1103515245 + 12345;
+				n->buttons = (uint8_t) (rng >> 16);
+			}
+
+			netplay_step(n);
+
+			if (!final[x].buf && netplay_test_settled(n, frames)) {
+				struct netplay_state *state = &n->states[frames % NETPLAY_STATES];
+
+				final[x].buf = malloc(state->len);
+				final[x].len = state->len;
+				memcpy(final[x].buf, state->buf, state->len);
+			}
+		}
+	}
+
+	bool match = final[0].buf && final[1].buf && final[0].len == final[1].len &&
+		!memcmp(final[0].buf, final[1].buf, final[0].len);
+
+	for (uint8_t x = 0; x < 2; x++) {
+		free(final[x].buf);
+		netplay_destroy(&net[x]);
+		netplay_transport_destroy(&t[x]);
+	}
+
+	return match;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../src/nes.h"
+
+#define NETPLAY_MAX_ROLLBACK 8
+#define NETPLAY_MAX_DELAY    8
+
+struct netplay;
+struct netplay_transport;
+
+/*** TRANSPORTS ***/
+// peer is "host:port", loopback latency is counted in packets sent by the receiving end (one per frame),
+// loss is a percentage
+int32_t netplay_udp_init(struct netplay_transport **t_out, uint16_t port, char *peer);
+void netplay_loopback_init(struct netplay_transport **a_out, struct netplay_transport **b_out,
+	uint32_t latency, uint32_t loss);
+void netplay_transport_destroy(struct netplay_transport **t_out);
+
+/*** SESSION ***/
+// both sides must start from the same ROM, SRAM and reset, the local player is 0 or 1
+void netplay_init(struct netplay **net_out, struct nes *nes, struct netplay_transport *transport,
+	uint8_t player, uint8_t delay);
+void netplay_destroy(struct netplay **net_out);
+void netplay_button(struct netplay *net, enum nes_button button, bool down);
+
+// returns the number of frames run including re-simulated ones, 0 while waiting on the peer
+uint32_t netplay_step(struct netplay *net);
+
+
+/*** SELF TEST ***/
+// runs two sessions over a loopback pair on consoles with the same cart and reset, true when
+// both reach the same state for the given frame
+bool netplay_check_loopback(struct nes *nes[2], uint32_t frames, uint32_t latency, uint32_t loss);
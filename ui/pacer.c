@@ -0,0 +1,140 @@
+#include "pacer.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#if defined(__linux__)
+	#include <time.h>
+	#include <errno.h>
+#endif
+
+#include "SDL2/SDL.h"
+
+#define SPIN_NS     500000
+#define STALL       4
+#define DRIFT_RATE  (1.0 / 600.0)
+#define DRIFT_MAX   0.01
+
+static const uint32_t PACER_LIMITS[PACER_BINS] = {
+	25, 50, 100, 250, 500, 1000, 2000, UINT32_MAX,
+};
+
+struct pacer {
+	double period;
+	double drift;
+	uint64_t next;
+	bool started;
+	SDL_atomic_t bins[PACER_BINS];
+};
+
+
+/*** CLOCK ***/
+
+// nanoseconds on a monotonic clock. linux sleeps to an absolute deadline, elsewhere a relative
+// SDL_Delay undershoots by a millisecond and the spin takes up the rest
+
+static uint64_t pacer_now(void)
+{
+	#if defined(__linux__)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+
+	#else
+	static double freq = 0.0;
+	if (freq == 0.0)
+		freq = (double) SDL_GetPerformanceFrequency();
+
+	return (uint64_t) ((double) SDL_GetPerformanceCounter() * (1000000000.0 / freq));
+	#endif
+}
+
+static void pacer_sleep_until(uint64_t deadline)
+{
+	#if defined(__linux__)
+	struct timespec ts;
+	ts.tv_sec = (time_t) (deadline / 1000000000);
+	ts.tv_nsec = (long) (deadline % 1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+
+	#else
+	uint64_t now = pacer_now();
+
+	if (deadline > now + 1000000)
+		SDL_Delay((Uint32) ((deadline - now) / 1000000) - 1);
+	#endif
+}
+
+
+/*** PACER ***/
+
+void pacer_init(struct pacer **pacer_out, double hz)
+{
+	struct pacer *pacer = *pacer_out = calloc(1, sizeof(struct pacer));
+
+	pacer->period = 1000000000.0 / hz;
+}
+
+void pacer_destroy(struct pacer **pacer_out)
+{
+	if (!pacer_out || !*pacer_out) return;
+
+	free(*pacer_out);
+	*pacer_out = NULL;
+}
+
+void pacer_reset(struct pacer *pacer)
+{
+	pacer->next = pacer_now();
+	pacer->started = true;
+}
+
+void pacer_wait(struct pacer *pacer)
+{
+	if (!pacer->started)
+		pacer_reset(pacer);
+
+	uint64_t period = (uint64_t) (pacer->period * (1.0 - pacer->drift));
+	pacer->next += period;
+
+	// after a long stall the clock restarts instead of racing to catch up
+	uint64_t now = pacer_now();
+
+	if (now > pacer->next + STALL * period) {
+		pacer->next = now;
+		return;
+	}
+
+	if (pacer->next > now + SPIN_NS)
+		pacer_sleep_until(pacer->next - SPIN_NS);
+
+	while ((now = pacer_now()) < pacer->next);
+
+	uint64_t late_us = (now - pacer->next) / 1000;
+
+	for (int32_t x = 0; x < PACER_BINS; x++) {
+		if (late_us < PACER_LIMITS[x]) {
+			SDL_AtomicAdd(&pacer->bins[x], 1);
+			break;
+		}
+	}
+}
+
+void pacer_correct(struct pacer *pacer, double ratio)
+{
+	// integrated slowly, so short term corrections are left to whoever asked for them
+	pacer->drift += ratio * DRIFT_RATE;
+
+	if (pacer->drift > DRIFT_MAX) pacer->drift = DRIFT_MAX;
+	if (pacer->drift < -DRIFT_MAX) pacer->drift = -DRIFT_MAX;
+}
+
+void pacer_get_histogram(struct pacer *pacer, uint32_t *counts, uint32_t *limits_us)
+{
+	for (int32_t x = 0; x < PACER_BINS; x++) {
+		counts[x] = (uint32_t) SDL_AtomicGet(&pacer->bins[x]);
+		limits_us[x] = PACER_LIMITS[x];
+	}
+}
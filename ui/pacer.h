@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#define PACER_BINS 8
+
+struct pacer;
+
+void pacer_init(struct pacer **pacer_out, double hz);
+void pacer_destroy(struct pacer **pacer_out);
+
+// sleeps until the next deadline then advances it by one period, deadlines are absolute so
+// lateness in one frame never accumulates into the next
+void pacer_wait(struct pacer *pacer);
+
+// the next deadline becomes now, for after stalls or when running unpaced
+void pacer_reset(struct pacer *pacer);
+
+// ratio > 0 asks for frames to come faster, only persistent requests move the clock
+void pacer_correct(struct pacer *pacer, double ratio);
+
+// how late each wakeup was, counts[x] holds wakeups under limits_us[x]
+void pacer_get_histogram(struct pacer *pacer, uint32_t *counts, uint32_t *limits_us);
@@ -56,6 +56,54 @@ static const GLchar *FRAG =
 	"    gl_FragColor = texture2D(sample0, v_texcoord); \n"
 	"}                                                  \n";
 
+// indexes hold 2 pixels per RGBA texel as low/high byte pairs, the palette is 64 colors wide with
+// one row per emphasis setting. cropping and linear filtering happen after the lookup
+static const GLchar *FRAG_INDEXED =
+	VSTR
+	"                                                                          \n"
+	"varying vec2 v_texcoord;                                                  \n"
+	"                                                                          \n"
+	"uniform sampler2D indexes;                                                \n"
+	"uniform sampler2D palette;                                                \n"
+	"uniform vec2 crop_lo;                                                     \n"
+	"uniform vec2 crop_hi;                                                     \n"
+	"uniform vec2 crop_adj;                                                    \n"
+	"uniform float filtered;                                                   \n"
+	"                                                                          \n"
+	"vec4 color_at(vec2 p) {                                                   \n"
+	"    vec2 src = clamp(p, vec2(0.0), vec2(255.0, 239.0)) - crop_adj;        \n"
+	"                                                                          \n"
+	"    if (src.x < crop_lo.x || src.y < crop_lo.y ||                         \n"
+	"        src.x >= crop_hi.x || src.y >= crop_hi.y)                         \n"
+	"        return vec4(0.0);                                                 \n"
+	"                                                                          \n"
+	"    vec2 uv = vec2((floor(src.x / 2.0) + 0.5) / 128.0, (src.y + 0.5) / 240.0); \n"
+	"    vec4 t = texture2D(indexes, uv);                                      \n"
+	"    vec2 b = mod(src.x, 2.0) < 0.5 ? t.rg : t.ba;                         \n"
+	"                                                                          \n"
+	"    float i = floor(b.x * 255.0 + 0.5) + floor(b.y * 255.0 + 0.5) * 256.0; \n"
+	"    float e = floor(i / 64.0);                                            \n"
+	"                                                                          \n"
+	"    return texture2D(palette, vec2((i - e * 64.0 + 0.5) / 64.0, (e + 0.5) / 8.0)); \n"
+	"}                                                                         \n"
+	"                                                                          \n"
+	"void main(void) {                                                         \n"
+	"    vec2 p = v_texcoord * vec2(256.0, 240.0);                             \n"
+	"                                                                          \n"
+	"    if (filtered < 0.5) {                                                 \n"
+	"        gl_FragColor = color_at(floor(p));                                \n"
+	"                                                                          \n"
+	"    } else {                                                              \n"
+	"        vec2 q = p - 0.5;                                                 \n"
+	"        vec2 b = floor(q);                                                \n"
+	"        vec2 f = q - b;                                                   \n"
+	"                                                                          \n"
+	"        vec4 top = mix(color_at(b), color_at(b + vec2(1.0, 0.0)), f.x);   \n"
+	"        vec4 bot = mix(color_at(b + vec2(0.0, 1.0)), color_at(b + vec2(1.0, 1.0)), f.x); \n"
+	"        gl_FragColor = mix(top, bot, f.y);                                \n"
+	"    }                                                                     \n"
+	"}                                                                         \n";
+
 struct gl {
 	SDL_Window *window;
 	SDL_GLContext ctx;
@@ -71,6 +119,16 @@ struct gl {
 	GLTexture2D staging;
 	GLFramebuffer staging_fb;
 
+	// palette index frames
+	GLProgram prog_indexed;
+	GLFragmentShader fs_indexed;
+	GLTexture2D tex_indexes;
+	GLTexture2D tex_palette;
+	GLLocation crop_lo;
+	GLLocation crop_hi;
+	GLLocation crop_adj;
+	GLLocation filtered;
+
 	uint32_t w;
 	uint32_t h;
 	bool dummy_window;
@@ -90,6 +148,21 @@ void gl_set_sampler(struct render_mod *mod, enum sampler sampler)
 	}
 }
 
+static GLTexture2D gl_create_nearest_texture(GLsizei w, GLsizei h)
+{
+	GLTexture2D tex = 0;
+
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	return tex;
+}
+
 static int32_t gl_log_shader_errors(GLShader shader)
 {
 	GLint e = 0;
@@ -211,6 +284,32 @@ int32_t gl_init(struct render_mod **mod_out, void *window, bool vsync,
 
 	glGenFramebuffers(1, &gl->staging_fb);
 
+	gl->fs_indexed = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(gl->fs_indexed, 1, &FRAG_INDEXED, NULL);
+	glCompileShader(gl->fs_indexed);
+	e = gl_log_shader_errors(gl->fs_indexed);
+	if (e != 0) goto except;
+
+	gl->prog_indexed = glCreateProgram();
+	glAttachShader(gl->prog_indexed, gl->vs);
+	glAttachShader(gl->prog_indexed, gl->fs_indexed);
+
+	glBindAttribLocation(gl->prog_indexed, 0, "position");
+	glBindAttribLocation(gl->prog_indexed, 1, "texcoord");
+
+	glLinkProgram(gl->prog_indexed);
+	glUseProgram(gl->prog_indexed);
+
+	glUniform1i(glGetUniformLocation(gl->prog_indexed, "indexes"), 0);
+	glUniform1i(glGetUniformLocation(gl->prog_indexed, "palette"), 1);
+	gl->crop_lo = glGetUniformLocation(gl->prog_indexed, "crop_lo");
+	gl->crop_hi = glGetUniformLocation(gl->prog_indexed, "crop_hi");
+	gl->crop_adj = glGetUniformLocation(gl->prog_indexed, "crop_adj");
+	gl->filtered = glGetUniformLocation(gl->prog_indexed, "filtered");
+
+	gl->tex_indexes = gl_create_nearest_texture(width / 2, height);
+	gl->tex_palette = gl_create_nearest_texture(64, 8);
+
 	e = glGetError();
 	if (e != 0) e = -1;
 
@@ -235,6 +334,18 @@ void gl_destroy(struct render_mod **mod_out)
 		if (GL_PROC_SUCCESS) {
 			SDL_GL_MakeCurrent(gl->window, gl->ctx);
 
+			if (gl->tex_palette != 0)
+				glDeleteTextures(1, &gl->tex_palette);
+
+			if (gl->tex_indexes != 0)
+				glDeleteTextures(1, &gl->tex_indexes);
+
+			if (gl->fs_indexed != 0)
+				glDeleteShader(gl->fs_indexed);
+
+			if (gl->prog_indexed != 0)
+				glDeleteProgram(gl->prog_indexed);
+
 			if (gl->staging != 0)
 				glDeleteTextures(1, &gl->staging);
 
@@ -323,11 +434,9 @@ static void gl_set_viewport(uint32_t window_w, uint32_t window_h, float ratio)
 	glViewport(x, y, lrint(swidth), lrint(sheight));
 }
 
-void gl_draw(struct render_mod *mod, uint32_t window_w, uint32_t window_h, uint32_t *pixels, uint32_t aspect)
+static void gl_bind_quad(struct gl *gl, GLProgram prog, uint32_t window_w, uint32_t window_h, uint32_t aspect)
 {
-	struct gl *gl = (struct gl *) mod;
-
-	glUseProgram(gl->prog);
+	glUseProgram(prog);
 	glBindBuffer(GL_ARRAY_BUFFER, gl->vb);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl->eb);
 
@@ -339,15 +448,58 @@ void gl_draw(struct render_mod *mod, uint32_t window_w, uint32_t window_h, uint3
 
 	gl_refresh_staging_texture(gl, window_w, window_h);
 	gl_set_viewport(window_w, window_h, ASPECT_RATIO(aspect));
+}
 
-	glBindTexture(GL_TEXTURE_2D, gl->tex);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 240, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
+static void gl_draw_quad(struct gl *gl)
+{
 	glBindFramebuffer(GL_FRAMEBUFFER, gl->staging_fb);
 	glClear(GL_COLOR_BUFFER_BIT);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
 }
 
+void gl_draw(struct render_mod *mod, uint32_t window_w, uint32_t window_h, uint32_t *pixels, uint32_t aspect)
+{
+	struct gl *gl = (struct gl *) mod;
+
+	gl_bind_quad(gl, gl->prog, window_w, window_h, aspect);
+
+	glBindTexture(GL_TEXTURE_2D, gl->tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 240, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+	gl_draw_quad(gl);
+}
+
+void gl_draw_indexes(struct render_mod *mod, uint32_t window_w, uint32_t window_h, uint16_t *indexes,
+	struct rect *crop, uint32_t aspect)
+{
+	struct gl *gl = (struct gl *) mod;
+
+	gl_bind_quad(gl, gl->prog_indexed, window_w, window_h, aspect);
+
+	// half the upload of RGBA, 2 pixels per texel
+	glBindTexture(GL_TEXTURE_2D, gl->tex_indexes);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, 240, GL_RGBA, GL_UNSIGNED_BYTE, indexes);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, gl->tex_palette);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform2f(gl->crop_lo, (GLfloat) crop->left, (GLfloat) crop->top);
+	glUniform2f(gl->crop_hi, (GLfloat) (256 - crop->right), (GLfloat) (240 - crop->bottom));
+	glUniform2f(gl->crop_adj, (GLfloat) ((crop->right - crop->left) / 2), (GLfloat) ((crop->bottom - crop->top) / 2));
+	glUniform1f(gl->filtered, gl->sampler == (GLfloat) GL_LINEAR ? 1.0f : 0.0f);
+
+	gl_draw_quad(gl);
+}
+
+void gl_set_palette(struct render_mod *mod, const uint32_t *rgba)
+{
+	struct gl *gl = (struct gl *) mod;
+
+	glBindTexture(GL_TEXTURE_2D, gl->tex_palette);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 64, 8, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+}
+
 enum ParsecStatus gl_submit_parsec(struct render_mod *mod, ParsecDSO *parsec)
 {
 	struct gl *gl = (struct gl *) mod;
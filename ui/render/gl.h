@@ -12,6 +12,9 @@ int32_t gl_init(struct render_mod **mod_out, void *window, bool vsync,
 void gl_destroy(struct render_mod **mod_out);
 void gl_get_device(struct render_mod *mod, struct render_device **device, struct render_context **context);
 void gl_draw(struct render_mod *mod, uint32_t window_w, uint32_t window_h, uint32_t *pixels, uint32_t aspect);
+void gl_draw_indexes(struct render_mod *mod, uint32_t window_w, uint32_t window_h, uint16_t *indexes,
+	struct rect *crop, uint32_t aspect);
+void gl_set_palette(struct render_mod *mod, const uint32_t *rgba);
 enum ParsecStatus gl_submit_parsec(struct render_mod *mod, ParsecDSO *parsec);
 void gl_present(struct render_mod *mod);
 void gl_set_sampler(struct render_mod *mod, enum sampler sampler);
@@ -58,6 +58,21 @@ struct ui_props {
 	// Audio
 	uint32_t sample_rate;
 	bool stereo;
+	uint32_t audio_latency;
+	double audio_latency_ms;
+	uint32_t underruns;
+	uint32_t overruns;
+
+	// Emulation
+	bool fast_forward;
+	const uint32_t *pacing;
+	const uint32_t *pacing_us;
+	uint32_t pacing_bins;
+	uint32_t lag_frames;
+
+	// Run-Ahead
+	uint8_t run_ahead;
+	double run_ahead_ms;
 };
 
 struct ui_cbs {
@@ -69,10 +84,13 @@ struct ui_cbs {
 	int32_t (*poll_code)(char *hash, void *opaque);
 	void (*stereo)(void *opaque);
 	void (*sample_rate)(uint32_t sample_rate, void *opaque);
+	void (*audio_latency)(uint32_t ms, void *opaque);
 	void (*sampler)(enum sampler, void *opaque);
 	void (*mode)(enum render_mode, void *opaque);
 	void (*vsync)(bool vsync, void *opaque);
 	void (*aspect)(uint32_t aspect, void *opaque);
 	void (*overscan)(int32_t index, int32_t crop, void *opaque);
 	bool (*invite)(char *code, void *opaque);
+	void (*run_ahead)(uint8_t frames, void *opaque);
+	void (*fast_forward)(bool enabled, void *opaque);
 };
@@ -23,6 +23,11 @@ struct render_callbacks {
 	enum ParsecStatus (*submit_parsec)(struct render_mod *mod, ParsecDSO *parsec);
 	void (*present)(struct render_mod *mod);
 	void (*sampler)(struct render_mod *mod, enum sampler sampler);
+
+	// optional, palette index frames are drawn through a shader lookup
+	void (*draw_indexes)(struct render_mod *mod, uint32_t window_w, uint32_t window_h, uint16_t *indexes,
+		struct rect *crop, uint32_t aspect);
+	void (*palette)(struct render_mod *mod, const uint32_t *rgba);
 };
 
 struct render {
@@ -33,7 +38,7 @@ struct render {
 };
 
 static struct render_callbacks CBS[] = {
-	[RENDER_GL]    = {gl_init,    gl_destroy,    gl_get_device,    gl_draw,    gl_submit_parsec,    gl_present,    gl_set_sampler},
+	[RENDER_GL]    = {gl_init,    gl_destroy,    gl_get_device,    gl_draw,    gl_submit_parsec,    gl_present,    gl_set_sampler,    gl_draw_indexes, gl_set_palette},
 
 	#if defined(_WIN32)
 	[RENDER_D3D9]  = {d3d9_init,  d3d9_destroy,  d3d9_get_device,  d3d9_draw,  d3d9_submit_parsec,  d3d9_present,  d3d9_set_sampler},
@@ -79,6 +84,22 @@ void render_draw(struct render *render, int32_t w, int32_t h, uint32_t *pixels,
 	render->cbs.draw(render->mod, w, h, pixels, aspect);
 }
 
+bool render_indexed(struct render *render)
+{
+	return render->cbs.draw_indexes != NULL;
+}
+
+void render_draw_indexes(struct render *render, int32_t w, int32_t h, uint16_t *indexes,
+	struct rect *crop, uint32_t aspect)
+{
+	render->cbs.draw_indexes(render->mod, w, h, indexes, crop, aspect);
+}
+
+void render_set_palette(struct render *render, const uint32_t *rgba)
+{
+	render->cbs.palette(render->mod, rgba);
+}
+
 enum ParsecStatus render_submit_parsec(struct render *render, ParsecDSO *parsec)
 {
 	return render->cbs.submit_parsec(render->mod, parsec);
@@ -13,6 +13,12 @@ int32_t render_init(struct render **render_out, enum render_mode mode, void *win
 	bool vsync, uint32_t width, uint32_t height, enum sampler sampler);
 void render_destroy(struct render **render_out);
 void render_draw(struct render *render, int32_t w, int32_t h, uint32_t *pixels, uint32_t aspect);
+
+// only valid when render_indexed is true, indexes are the 9-bit nes palette indexes
+bool render_indexed(struct render *render);
+void render_draw_indexes(struct render *render, int32_t w, int32_t h, uint16_t *indexes,
+	struct rect *crop, uint32_t aspect);
+void render_set_palette(struct render *render, const uint32_t *rgba);
 enum ParsecStatus render_submit_parsec(struct render *render, ParsecDSO *parsec);
 void render_present(struct render *render);
 void render_set_sampler(struct render *render, enum sampler sampler);
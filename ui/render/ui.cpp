@@ -108,6 +108,11 @@ void ui_sdl_input(struct ui *ctx, SDL_Event *event)
 		if (ctrl && io.KeysDown[SDL_SCANCODE_R])
 			ctx->cbs.reset(ctx->opaque);
 	}
+
+	// Fast-Forward while held
+	if ((event->type == SDL_KEYDOWN || event->type == SDL_KEYUP) && !event->key.repeat &&
+		event->key.keysym.scancode == SDL_SCANCODE_TAB && !ui_block_keyboard(ctx))
+		ctx->cbs.fast_forward(event->type == SDL_KEYDOWN, ctx->opaque);
 }
 
 bool ui_block_keyboard(struct ui *ctx)
@@ -154,6 +159,48 @@ static void ui_menu(struct ui *ctx, struct ui_props *props)
 			if (ImGui::MenuItem("Reset", "Ctrl+R"))
 				ctx->cbs.reset(ctx->opaque);
 
+			if (ImGui::MenuItem("Fast-Forward", "Tab", props->fast_forward, true))
+				ctx->cbs.fast_forward(!props->fast_forward, ctx->opaque);
+
+			// Frame pacing error histogram
+			if (props->pacing && ImGui::BeginMenu("Pacing", true)) {
+				for (uint32_t x = 0; x < props->pacing_bins; x++) {
+					if (props->pacing_us[x] == UINT32_MAX) {
+						ImGui::TextDisabled(">= %u us: %u", props->pacing_us[x - 1], props->pacing[x]);
+
+					} else {
+						ImGui::TextDisabled("< %u us: %u", props->pacing_us[x], props->pacing[x]);
+					}
+				}
+
+				ImGui::EndMenu();
+			}
+
+			// Frames where the game never read the controllers
+			ImGui::TextDisabled("Lag Frames: %u", props->lag_frames);
+
+			// Run-Ahead
+			ImGui::Separator();
+			if (ImGui::BeginMenu("Run-Ahead", true)) {
+				if (ImGui::MenuItem("Off", "", props->run_ahead == 0, true))
+					ctx->cbs.run_ahead(0, ctx->opaque);
+
+				for (uint8_t x = 1; x <= 3; x++) {
+					char label[32];
+					snprintf(label, 32, "%u Frame%s", x, x > 1 ? "s" : "");
+
+					if (ImGui::MenuItem(label, "", props->run_ahead == x, true))
+						ctx->cbs.run_ahead(x, ctx->opaque);
+				}
+
+				if (props->run_ahead > 0) {
+					ImGui::Separator();
+					ImGui::TextDisabled("Overhead: %.2f ms/frame", props->run_ahead_ms);
+				}
+
+				ImGui::EndMenu();
+			}
+
 			ImGui::EndMenu();
 		}
 
@@ -248,6 +295,25 @@ static void ui_menu(struct ui *ctx, struct ui_props *props)
 					ctx->cbs.sample_rate(rates[x], ctx->opaque);
 			}
 
+			// Latency
+			ImGui::Separator();
+			if (ImGui::BeginMenu("Latency", true)) {
+				for (uint32_t ms = 20; ms <= 40; ms += 10) {
+					char label[32];
+					snprintf(label, 32, "%u ms", ms);
+
+					if (ImGui::MenuItem(label, "", props->audio_latency == ms, true))
+						ctx->cbs.audio_latency(ms, ctx->opaque);
+				}
+
+				ImGui::Separator();
+				ImGui::TextDisabled("Current: %.1f ms", props->audio_latency_ms);
+				ImGui::TextDisabled("Underruns: %u", props->underruns);
+				ImGui::TextDisabled("Overruns: %u", props->overruns);
+
+				ImGui::EndMenu();
+			}
+
 			ImGui::EndMenu();
 		}
 
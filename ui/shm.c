@@ -0,0 +1,187 @@
+#include "shm.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+	#include <limits.h>
+	#include <time.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <linux/futex.h>
+#endif
+
+struct shm {
+	int fd;
+	struct shm_region *r;
+	uint64_t frame;
+};
+
+
+/*** SIGNAL ***/
+
+#if defined(__linux__)
+
+static uint64_t shm_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static void shm_signal(struct shm *shm)
+{
+	struct shm_header *hdr = &shm->r->hdr;
+
+	__atomic_add_fetch(&hdr->seq, 1, __ATOMIC_SEQ_CST);
+
+	// not FUTEX_PRIVATE, the waiter lives in another process
+	if (__atomic_load_n(&hdr->waiters, __ATOMIC_SEQ_CST) > 0)
+		syscall(SYS_futex, &hdr->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+#endif
+
+
+/*** SINK ***/
+
+// the producer never waits on a consumer, one that falls more than a ring behind loses entries
+
+void shm_write_frame(struct shm *shm, const uint32_t *pixels)
+{
+	#if defined(__linux__)
+	struct shm_header *hdr = &shm->r->hdr;
+	uint64_t n = hdr->frames_written;
+
+	struct shm_frame *f = &shm->r->frames[n % SHM_FRAMES];
+	f->frame = shm->frame++;
+	f->time_ns = shm_now();
+	memcpy(f->pixels, pixels, sizeof(f->pixels));
+
+	__atomic_store_n(&hdr->frames_written, n + 1, __ATOMIC_RELEASE);
+	shm_signal(shm);
+
+	#else
+	shm;
+	pixels;
+	#endif
+}
+
+void shm_write_samples(struct shm *shm, const int16_t *samples, size_t count, uint32_t sample_rate)
+{
+	#if defined(__linux__)
+	struct shm_header *hdr = &shm->r->hdr;
+	uint64_t n = hdr->blocks_written;
+	uint64_t offset = hdr->samples_written;
+
+	if (count > SHM_SAMPLES)
+		count = SHM_SAMPLES;
+
+	// the samples about to be overwritten are given up before any of them are touched
+	__atomic_store_n(&hdr->samples_written, offset + count, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	uint64_t start = offset % SHM_SAMPLES;
+	size_t first = SHM_SAMPLES - start;
+	if (first > count) first = count;
+
+	memcpy(shm->r->samples + start * 2, samples, first * sizeof(int16_t) * 2);
+	memcpy(shm->r->samples, samples + first * 2, (count - first) * sizeof(int16_t) * 2);
+
+	struct shm_block *b = &shm->r->blocks[n % SHM_BLOCKS];
+	b->frame = shm->frame;
+	b->time_ns = shm_now();
+	b->offset = offset;
+	b->count = (uint32_t) count;
+	b->sample_rate = sample_rate;
+
+	__atomic_store_n(&hdr->blocks_written, n + 1, __ATOMIC_RELEASE);
+	shm_signal(shm);
+
+	#else
+	shm;
+	samples;
+	count;
+	sample_rate;
+	#endif
+}
+
+void shm_get_path(struct shm *shm, char *path, size_t size)
+{
+	#if defined(__linux__)
+	snprintf(path, size, "/proc/%d/fd/%d", (int) getpid(), shm->fd);
+
+	#else
+	shm;
+	snprintf(path, size, "%s", "");
+	#endif
+}
+
+
+/*** INIT & DESTROY ***/
+
+int32_t shm_init(struct shm **shm_out)
+{
+	struct shm *shm = *shm_out = calloc(1, sizeof(struct shm));
+	shm->fd = -1;
+
+	int32_t r = 0;
+
+	#if defined(__linux__)
+	shm->fd = (int) syscall(SYS_memfd_create, "cddNES", 0);
+	if (shm->fd < 0) {r = -1; goto except;}
+
+	if (ftruncate(shm->fd, sizeof(struct shm_region)) != 0) {r = -1; goto except;}
+
+	void *map = mmap(NULL, sizeof(struct shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+	if (map == MAP_FAILED) {r = -1; goto except;}
+
+	shm->r = map;
+
+	struct shm_header *hdr = &shm->r->hdr;
+	hdr->version = SHM_VERSION;
+	hdr->width = SHM_WIDTH;
+	hdr->height = SHM_HEIGHT;
+	hdr->frame_slots = SHM_FRAMES;
+	hdr->block_slots = SHM_BLOCKS;
+	hdr->sample_slots = SHM_SAMPLES;
+	hdr->channels = 2;
+
+	// the magic goes in last, a consumer that sees it sees the rest of the header
+	__atomic_store_n(&hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+	except:
+	#else
+	r = -1;
+	#endif
+
+	if (r != 0)
+		shm_destroy(shm_out);
+
+	return r;
+}
+
+void shm_destroy(struct shm **shm_out)
+{
+	if (!shm_out || !*shm_out) return;
+
+	struct shm *shm = *shm_out;
+
+	#if defined(__linux__)
+	if (shm->r) {
+		__atomic_store_n(&shm->r->hdr.closed, 1, __ATOMIC_RELEASE);
+		shm_signal(shm);
+
+		munmap(shm->r, sizeof(struct shm_region));
+	}
+
+	if (shm->fd >= 0)
+		close(shm->fd);
+	#endif
+
+	free(shm);
+	*shm_out = NULL;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*** LAYOUT ***/
+// shared with the consumer process, which maps /proc/<pid>/fd/<fd> as printed at startup.
+// counters only ever grow, an entry n lives in slot n % count. writers fill the slot first and
+// then release the counter, so while entry n + count is being written the counter still reads
+// n + count. a reader that finds the counter at n + count or beyond after copying entry n can't
+// trust the copy
+
+#define SHM_MAGIC    0x4D485343 //CSHM
+#define SHM_VERSION  1
+#define SHM_WIDTH    256
+#define SHM_HEIGHT   240
+#define SHM_FRAMES   8
+#define SHM_BLOCKS   1024
+#define SHM_SAMPLES  (1 << 16)
+
+struct shm_frame {
+	uint64_t frame;
+	uint64_t time_ns; //CLOCK_MONOTONIC
+	uint32_t pixels[SHM_WIDTH * SHM_HEIGHT]; //RGBA
+};
+
+// a SAMPLE_CALLBACK block, its stereo frames start at offset in the sample ring and may wrap
+struct shm_block {
+	uint64_t frame;
+	uint64_t time_ns;
+	uint64_t offset;
+	uint32_t count;
+	uint32_t sample_rate;
+};
+
+struct shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frame_slots;
+	uint32_t block_slots;
+	uint32_t sample_slots;
+	uint32_t channels;
+
+	// futex word, bumped after every write. consumers add themselves to waiters before sleeping
+	// on it so the producer can skip the wake syscall when nobody is waiting
+	uint32_t seq;
+	uint32_t waiters;
+	uint32_t closed;
+	uint32_t _pad;
+
+	uint64_t frames_written;
+	uint64_t blocks_written;
+
+	// unlike the others this is bumped before the samples are copied in, so it also covers a
+	// write in progress. sample n can't be trusted once it reaches n + sample_slots
+	uint64_t samples_written;
+};
+
+struct shm_region {
+	struct shm_header hdr;
+	struct shm_frame frames[SHM_FRAMES];
+	struct shm_block blocks[SHM_BLOCKS];
+	int16_t samples[SHM_SAMPLES * 2];
+};
+
+/*** SINK ***/
+// linux only, init fails elsewhere
+struct shm;
+
+int32_t shm_init(struct shm **shm_out);
+void shm_destroy(struct shm **shm_out);
+void shm_get_path(struct shm *shm, char *path, size_t size);
+void shm_write_frame(struct shm *shm, const uint32_t *pixels);
+void shm_write_samples(struct shm *shm, const int16_t *samples, size_t count, uint32_t sample_rate);